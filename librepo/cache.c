@@ -0,0 +1,228 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2012  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+#include "setup.h"
+#include "util.h"
+#include "cache.h"
+#include "handle_internal.h"
+
+/** Permissions of cache entries */
+#define LR_CACHE_ENTRY_MODE     0444
+
+int
+lr_copy_file(const char *src, const char *dst)
+{
+    int in, out;
+    int rc = 0;
+    ssize_t len;
+    char buf[65536];
+
+    in = open(src, O_RDONLY);
+    if (in < 0)
+        return -1;
+    out = open(dst, O_CREAT|O_TRUNC|O_WRONLY, 0660);
+    if (out < 0) {
+        close(in);
+        return -1;
+    }
+
+#ifdef FICLONE
+    if (ioctl(out, FICLONE, in) == 0) {
+        close(in);
+        return close(out) ? -1 : 0;
+    }
+#endif
+
+    while ((len = read(in, buf, sizeof(buf))) > 0)
+        if (write(out, buf, len) != len) {
+            rc = -1;
+            break;
+        }
+    if (len < 0)
+        rc = -1;
+
+    close(in);
+    if (close(out))
+        rc = -1;
+    if (rc)
+        unlink(dst);
+    return rc;
+}
+
+int
+lr_clone_file(const char *src, const char *dst)
+{
+    unlink(dst);
+    if (link(src, dst) == 0)
+        return 0;
+    return lr_copy_file(src, dst);
+}
+
+/** Return malloced path of the cache subdirectory for the checksum type
+ * or NULL if the cache is disabled or the checksum is unknown.
+ * The directory is created if create is not 0.
+ */
+static char *
+lr_cache_dir(lr_Handle handle, lr_ChecksumType checksum_type, int create)
+{
+    const char *type;
+    char *dir;
+
+    if (!handle->cachedir || checksum_type == LR_CHECKSUM_UNKNOWN)
+        return NULL;
+
+    type = lr_checksum_type_to_str(checksum_type);
+    if (!type)
+        return NULL;
+
+    dir = lr_pathconcat(handle->cachedir, type, NULL);
+    if (create) {
+        if (mkdir(handle->cachedir, 0775) && errno != EEXIST) {
+            DPRINTF("%s: mkdir(%s): %s\n",
+                    __func__, handle->cachedir, strerror(errno));
+            lr_free(dir);
+            return NULL;
+        }
+        if (mkdir(dir, 0775) && errno != EEXIST) {
+            DPRINTF("%s: mkdir(%s): %s\n", __func__, dir, strerror(errno));
+            lr_free(dir);
+            return NULL;
+        }
+    }
+
+    return dir;
+}
+
+/** Checksum is used as a file name - it must be a plain hex string */
+static int
+lr_cache_valid_checksum(const char *checksum)
+{
+    if (!checksum || !*checksum)
+        return 0;
+    return strspn(checksum, "0123456789abcdefABCDEF") == strlen(checksum);
+}
+
+int
+lr_cache_get(lr_Handle handle,
+             lr_ChecksumType checksum_type,
+             const char *checksum,
+             const char *path)
+{
+    int fd, ret;
+    char *dir, *entry;
+
+    if (!lr_cache_valid_checksum(checksum))
+        return 0;
+
+    dir = lr_cache_dir(handle, checksum_type, 0);
+    if (!dir)
+        return 0;
+    entry = lr_pathconcat(dir, checksum, NULL);
+    lr_free(dir);
+
+    /* Entries share their inode with the files materialized from them,
+     * so they are always verified, even if LR_CHECK_CHECKSUM is disabled */
+    fd = open(entry, O_RDONLY);
+    if (fd < 0) {
+        lr_free(entry);
+        return 0;
+    }
+    ret = lr_checksum_fd_compare(checksum_type, fd, checksum,
+                                 handle->checksumcache);
+    close(fd);
+    if (ret) {
+        DPRINTF("%s: Removing broken cache entry %s\n", __func__, entry);
+        unlink(entry);
+        lr_free(entry);
+        return 0;
+    }
+
+    if (lr_clone_file(entry, path)) {
+        DPRINTF("%s: Cannot materialize %s to %s: %s\n",
+                __func__, entry, path, strerror(errno));
+        lr_free(entry);
+        return 0;
+    }
+
+    DPRINTF("%s: %s taken from the cache %s\n", __func__, path, entry);
+    lr_free(entry);
+    return 1;
+}
+
+void
+lr_cache_put(lr_Handle handle,
+             lr_ChecksumType checksum_type,
+             const char *checksum,
+             const char *path)
+{
+    int fd;
+    char *dir, *entry, *tmp;
+
+    if (!(handle->checks & LR_CHECK_CHECKSUM)
+        || !lr_cache_valid_checksum(checksum))
+        return;
+
+    dir = lr_cache_dir(handle, checksum_type, 1);
+    if (!dir)
+        return;
+    entry = lr_pathconcat(dir, checksum, NULL);
+
+    if (access(entry, F_OK) == 0) {
+        /* Already cached */
+        lr_free(dir);
+        lr_free(entry);
+        return;
+    }
+
+    /* Prepare a complete read-only copy under a temporary name first.
+     * The file itself is not linked to the cache, it stays writable
+     * and its later modification cannot damage the entry. */
+    tmp = lr_pathconcat(dir, ".tmp.XXXXXX", NULL);
+    fd = mkstemp(tmp);
+    if (fd < 0) {
+        DPRINTF("%s: mkstemp(%s): %s\n", __func__, tmp, strerror(errno));
+    } else {
+        close(fd);
+        if (lr_copy_file(path, tmp))
+            DPRINTF("%s: Cannot copy %s to %s: %s\n",
+                    __func__, path, tmp, strerror(errno));
+        else if (chmod(tmp, LR_CACHE_ENTRY_MODE))
+            DPRINTF("%s: chmod(%s): %s\n", __func__, tmp, strerror(errno));
+        else if (link(tmp, entry) && errno != EEXIST)
+            DPRINTF("%s: link(%s, %s): %s\n",
+                    __func__, tmp, entry, strerror(errno));
+        unlink(tmp);
+    }
+
+    lr_free(dir);
+    lr_free(entry);
+    lr_free(tmp);
+}
@@ -0,0 +1,91 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2012  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#ifndef LR_CACHE_H
+#define LR_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "types.h"
+#include "handle.h"
+#include "checksum.h"
+
+/* Content addressed cache (LRO_CACHEDIR)
+ *
+ * Files are stored as <cachedir>/<checksum_type>/<checksum>. An entry is
+ * a read-only copy (or reflink) of the stored file and it is never
+ * modified once it exists. Files materialized from the cache are usually
+ * hardlinks to the entry, so they are read-only too. An entry is
+ * published by link(2), which fails if the entry already exists, so
+ * concurrent processes never see a partly written file and no other
+ * locking is needed.
+ */
+
+/** Copy src to dst. Reflink is used if possible, the data are copied
+ * otherwise. Existing dst is truncated.
+ * @param src               Source path.
+ * @param dst               Destination path.
+ * @return                  0 on success, -1 on error (errno is set).
+ */
+int lr_copy_file(const char *src, const char *dst);
+
+/** Make dst the same file as src. Hardlink is used if possible, then
+ * reflink and the data are copied as the last resort.
+ * Existing dst is replaced.
+ * @param src               Source path.
+ * @param dst               Destination path.
+ * @return                  0 on success, -1 on error (errno is set).
+ */
+int lr_clone_file(const char *src, const char *dst);
+
+/** Materialize the file with the given checksum from the cache to the path.
+ * The cached file is always verified first (regardless of
+ * LR_CHECK_CHECKSUM) and removed from the cache if it is broken.
+ * @param handle            Librepo handle.
+ * @param checksum_type     Checksum type.
+ * @param checksum          Checksum value.
+ * @param path              Destination path.
+ * @return                  1 if the file was taken from the cache, 0 otherwise.
+ */
+int lr_cache_get(lr_Handle handle,
+                 lr_ChecksumType checksum_type,
+                 const char *checksum,
+                 const char *path);
+
+/** Store a copy of the file to the cache. The file itself is left
+ * untouched. It must already be verified against the checksum, so
+ * nothing is stored if LR_CHECK_CHECKSUM is disabled.
+ * Failure to store the file is not an error.
+ * @param handle            Librepo handle.
+ * @param checksum_type     Checksum type.
+ * @param checksum          Checksum value.
+ * @param path              Path of the downloaded file.
+ */
+void lr_cache_put(lr_Handle handle,
+                  lr_ChecksumType checksum_type,
+                  const char *checksum,
+                  const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -17,9 +17,18 @@
  * USA.
  */
 
+#define _POSIX_C_SOURCE 200809L
+#include <assert.h>
+#include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/xattr.h>
 
 #include <openssl/evp.h>
 
@@ -27,9 +36,28 @@
 #include "checksum.h"
 #include "util.h"
 
-#define BUFFER_SIZE             2048
 #define MAX_CHECKSUM_NAME_LEN   7
 
+/* Prefix of the extended attribute name used by the checksum cache.
+ * The checksum type (e.g. "sha256") is appended. */
+#define CHECKSUM_XATTR_PREFIX   "user.librepo.checksum."
+#define CHECKSUM_XATTR_MAX_LEN  256
+
+/* Size of buffer used by read() when a file is checksummed */
+#ifndef LR_CHECKSUM_BUFFER_SIZE
+#define LR_CHECKSUM_BUFFER_SIZE     (256*1024)
+#endif
+
+/* Regular files bigger than this are mapped to memory instead of read() */
+#ifndef LR_CHECKSUM_MMAP_THRESHOLD
+#define LR_CHECKSUM_MMAP_THRESHOLD  (4*1024*1024)
+#endif
+
+/* Size of the window which is mapped to memory at once */
+#ifndef LR_CHECKSUM_MMAP_WINDOW
+#define LR_CHECKSUM_MMAP_WINDOW     (64*1024*1024)
+#endif
+
 lr_ChecksumType
 lr_checksum_type(const char *type)
 {
@@ -98,16 +126,15 @@ lr_checksum_type_to_str(lr_ChecksumType type)
     return NULL;
 }
 
-char *
-lr_checksum_fd(lr_ChecksumType type, int fd)
+struct _lr_ChecksumCtx {
+    EVP_MD_CTX *ctx;    /*!< OpenSSL digest context */
+};
+
+lr_ChecksumCtx
+lr_checksumctx_new(lr_ChecksumType type)
 {
     int rc;
-    unsigned int len;
-    ssize_t readed;
-    char buf[BUFFER_SIZE];
-    unsigned char raw_checksum[EVP_MAX_MD_SIZE];
-    char *checksum;
-    EVP_MD_CTX *ctx;
+    lr_ChecksumCtx ctx;
     const EVP_MD *ctx_type;
 
     switch (type) {
@@ -121,27 +148,126 @@ lr_checksum_fd(lr_ChecksumType type, int fd)
         case LR_CHECKSUM_SHA512:    ctx_type = EVP_sha512(); break;
         case LR_CHECKSUM_UNKNOWN:
         default:
-            DEBUGASSERT(0);
             return NULL;
     }
 
-    ctx = EVP_MD_CTX_create();
-    rc = EVP_DigestInit_ex(ctx, ctx_type, NULL);
+    ctx = lr_malloc0(sizeof(struct _lr_ChecksumCtx));
+    ctx->ctx = EVP_MD_CTX_create();
+    rc = EVP_DigestInit_ex(ctx->ctx, ctx_type, NULL);
     if (!rc) {
-        EVP_MD_CTX_destroy(ctx);
+        lr_checksumctx_free(ctx);
         return NULL;
     }
 
-    while ((readed = read(fd, buf, BUFFER_SIZE)) > 0)
-        EVP_DigestUpdate(ctx, buf, readed);
+    return ctx;
+}
 
-    if (readed == -1) {
-        EVP_MD_CTX_destroy(ctx);
-        return NULL;
+int
+lr_checksumctx_update(lr_ChecksumCtx ctx, const void *buf, size_t len)
+{
+    assert(ctx);
+    return EVP_DigestUpdate(ctx->ctx, buf, len) ? 0 : 1;
+}
+
+/** Pass the rest of the file (from the current offset) to all contexts
+ * using mmap().
+ * @return      0 on success, 1 on error, -1 if the mmap() is not usable
+ *              and nothing was processed (caller should use read()).
+ */
+static int
+lr_checksumctxs_update_mmap(lr_ChecksumCtx *ctxs,
+                            int count,
+                            int fd,
+                            off_t start,
+                            off_t size)
+{
+    long pagesize = sysconf(_SC_PAGESIZE);
+    off_t begin = start - (start % pagesize);  // Must be page aligned
+    off_t offset = begin;
+
+    while (offset < size) {
+        void *map;
+        size_t skip = (offset < start) ? (size_t) (start - offset) : 0;
+        size_t len = LR_CHECKSUM_MMAP_WINDOW;
+        int rc = 0;
+
+        if ((off_t) len > size - offset)
+            len = size - offset;
+
+        map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, offset);
+        if (map == MAP_FAILED)
+            return (offset == begin) ? -1 : 1;
+
+        posix_madvise(map, len, POSIX_MADV_SEQUENTIAL);
+        for (int x = 0; x < count && !rc; x++)
+            rc = lr_checksumctx_update(ctxs[x], (char *) map + skip, len - skip);
+        munmap(map, len);
+        if (rc)
+            return 1;
+
+        offset += len;
     }
 
-    EVP_DigestFinal_ex(ctx, raw_checksum, &len);
-    EVP_MD_CTX_destroy(ctx);
+    // Behave like read() - leave the file offset at the end of file
+    if (lseek(fd, size, SEEK_SET) == (off_t) -1)
+        return 1;
+
+    return 0;
+}
+
+/** Pass all data readable from the fd to all contexts. */
+static int
+lr_checksumctxs_update_fd(lr_ChecksumCtx *ctxs, int count, int fd)
+{
+    int ret = 0;
+    ssize_t readed;
+    char *buf;
+    struct stat st;
+    off_t start;
+
+    start = lseek(fd, 0, SEEK_CUR);
+    if (start != (off_t) -1 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        posix_fadvise(fd, start, 0, POSIX_FADV_SEQUENTIAL);
+
+        if (st.st_size - start >= LR_CHECKSUM_MMAP_THRESHOLD) {
+            ret = lr_checksumctxs_update_mmap(ctxs, count, fd, start, st.st_size);
+            if (ret != -1)
+                return ret;
+            ret = 0;
+        }
+    }
+
+    buf = lr_malloc(LR_CHECKSUM_BUFFER_SIZE);
+    while (!ret && (readed = read(fd, buf, LR_CHECKSUM_BUFFER_SIZE)) > 0)
+        for (int x = 0; x < count && !ret; x++)
+            ret = lr_checksumctx_update(ctxs[x], buf, readed);
+
+    if (!ret && readed == -1)
+        ret = 1;
+
+    lr_free(buf);
+    return ret;
+}
+
+int
+lr_checksumctx_update_fd(lr_ChecksumCtx ctx, int fd)
+{
+    assert(ctx);
+    return lr_checksumctxs_update_fd(&ctx, 1, fd);
+}
+
+char *
+lr_checksumctx_final(lr_ChecksumCtx ctx)
+{
+    unsigned int len;
+    unsigned char raw_checksum[EVP_MAX_MD_SIZE];
+    char *checksum;
+
+    assert(ctx);
+
+    if (!EVP_DigestFinal_ex(ctx->ctx, raw_checksum, &len))
+        return NULL;
+
     checksum = lr_malloc0(sizeof(char) * (len * 2 + 1));
     for (size_t x = 0; x < len; x++)
         sprintf(checksum+(x*2), "%02x", raw_checksum[x]);
@@ -149,23 +275,180 @@ lr_checksum_fd(lr_ChecksumType type, int fd)
     return checksum;
 }
 
+void
+lr_checksumctx_free(lr_ChecksumCtx ctx)
+{
+    if (!ctx)
+        return;
+    EVP_MD_CTX_destroy(ctx->ctx);
+    lr_free(ctx);
+}
+
+char *
+lr_checksum_fd(lr_ChecksumType type, int fd)
+{
+    char *checksum = NULL;
+    lr_ChecksumCtx ctx;
+
+    ctx = lr_checksumctx_new(type);
+    if (!ctx) {
+        DEBUGASSERT(0);
+        return NULL;
+    }
+
+    if (!lr_checksumctx_update_fd(ctx, fd))
+        checksum = lr_checksumctx_final(ctx);
+
+    lr_checksumctx_free(ctx);
+    return checksum;
+}
+
 int
-lr_checksum_fd_cmp(lr_ChecksumType type, int fd, const char *expected)
+lr_checksum_fd_multi(const lr_ChecksumType *types,
+                     int count,
+                     int fd,
+                     char **checksums)
+{
+    int ret = 0;
+    lr_ChecksumCtx *ctxs;
+
+    assert(types || count == 0);
+    assert(checksums || count == 0);
+
+    for (int x = 0; x < count; x++)
+        checksums[x] = NULL;
+
+    ctxs = lr_malloc0(sizeof(lr_ChecksumCtx) * count);
+    for (int x = 0; x < count && !ret; x++)
+        if (!(ctxs[x] = lr_checksumctx_new(types[x])))
+            ret = 1;
+
+    if (!ret)
+        ret = lr_checksumctxs_update_fd(ctxs, count, fd);
+
+    for (int x = 0; x < count && !ret; x++)
+        if (!(checksums[x] = lr_checksumctx_final(ctxs[x])))
+            ret = 1;
+
+    for (int x = 0; x < count; x++) {
+        lr_checksumctx_free(ctxs[x]);
+        if (ret) {
+            lr_free(checksums[x]);
+            checksums[x] = NULL;
+        }
+    }
+    lr_free(ctxs);
+
+    return ret;
+}
+
+/** Build the key which must match the cached value. The key identifies
+ * the file content by inode, size and modification time.
+ * @return      0 on success, 1 if the file cannot be stat()ed.
+ */
+static int
+lr_checksum_cache_key(int fd, char *key, size_t len)
+{
+    struct stat st;
+
+    if (fstat(fd, &st))
+        return 1;
+
+    snprintf(key, len, "%llu:%lld:%lld.%09ld:",
+             (unsigned long long) st.st_ino,
+             (long long) st.st_size,
+             (long long) st.st_mtim.tv_sec,
+             (long) st.st_mtim.tv_nsec);
+    return 0;
+}
+
+char *
+lr_checksum_cache_get(lr_ChecksumType type, int fd)
+{
+    ssize_t len;
+    size_t key_len;
+    char *name;
+    char key[CHECKSUM_XATTR_MAX_LEN];
+    char value[CHECKSUM_XATTR_MAX_LEN];
+
+    if (type == LR_CHECKSUM_UNKNOWN || lr_checksum_cache_key(fd, key, sizeof(key)))
+        return NULL;
+
+    name = lr_strconcat(CHECKSUM_XATTR_PREFIX,
+                        lr_checksum_type_to_str(type), NULL);
+    len = fgetxattr(fd, name, value, sizeof(value) - 1);
+    lr_free(name);
+    if (len < 0)
+        return NULL;
+    value[len] = '\0';
+
+    key_len = strlen(key);
+    if (strncmp(value, key, key_len) || value[key_len] == '\0') {
+        DPRINTF("%s: Cached checksum is outdated\n", __func__);
+        return NULL;
+    }
+
+    return lr_strdup(value + key_len);
+}
+
+int
+lr_checksum_cache_set(lr_ChecksumType type, int fd, const char *checksum)
+{
+    int rc;
+    char *name, *value;
+    char key[CHECKSUM_XATTR_MAX_LEN];
+
+    if (type == LR_CHECKSUM_UNKNOWN || !checksum
+        || lr_checksum_cache_key(fd, key, sizeof(key)))
+        return 1;
+
+    name = lr_strconcat(CHECKSUM_XATTR_PREFIX,
+                        lr_checksum_type_to_str(type), NULL);
+    value = lr_strconcat(key, checksum, NULL);
+    rc = fsetxattr(fd, name, value, strlen(value), 0);
+    if (rc)
+        DPRINTF("%s: Cannot set %s: %s\n", __func__, name, strerror(errno));
+    lr_free(name);
+    lr_free(value);
+
+    return rc ? 1 : 0;
+}
+
+int
+lr_checksum_fd_compare(lr_ChecksumType type,
+                       int fd,
+                       const char *expected,
+                       int caching)
 {
     int ret;
-    char *checksum;
+    char *checksum = NULL;
 
     DEBUGASSERT(fd >= 0);
 
     if (!expected)
         return 1;
 
-    checksum = lr_checksum_fd(type, fd);
+    if (caching) {
+        checksum = lr_checksum_cache_get(type, fd);
+        if (checksum)
+            DPRINTF("%s: Using cached checksum\n", __func__);
+    }
+
     if (!checksum) {
-        return 1;
+        checksum = lr_checksum_fd(type, fd);
+        if (!checksum)
+            return 1;
+        if (caching)
+            lr_checksum_cache_set(type, fd, checksum);
     }
 
     ret = strcmp(expected, checksum);
     lr_free(checksum);
     return ret;
 }
+
+int
+lr_checksum_fd_cmp(lr_ChecksumType type, int fd, const char *expected)
+{
+    return lr_checksum_fd_compare(type, fd, expected, 0);
+}
@@ -24,6 +24,8 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
+
 /** \defgroup checksum Functions for checksum calculating and checking.
  */
 
@@ -77,6 +79,110 @@ char *lr_checksum_fd(lr_ChecksumType type, int fd);
  */
 int lr_checksum_fd_cmp(lr_ChecksumType type, int fd, const char *expected);
 
+/** \ingroup checksum
+ * Calculate checksum for data pointed by file descriptor and compare it
+ * to the expected checksum. If caching is enabled, the calculated
+ * checksum is stored to an extended attribute of the file
+ * (user.librepo.checksum.TYPE) together with inode, size and mtime of
+ * the file and it is used (instead of reading the file) as long as
+ * these still match.
+ * @param type      Checksum type
+ * @param fd        Opened file descriptor. Note: Function call only read()
+ *                  on the descriptor and do not perform close() or seek()
+ *                  to the beginning of file.
+ * @param expected  Expected checksum value
+ * @param caching   Use the checksum cache
+ * @return          0 if calculated checksum == expected checksum
+ */
+int lr_checksum_fd_compare(lr_ChecksumType type,
+                           int fd,
+                           const char *expected,
+                           int caching);
+
+/** \ingroup checksum
+ * Get checksum of the file from the checksum cache (extended attribute
+ * of the file). Nothing is read from the file.
+ * @param type      Checksum type
+ * @param fd        Opened file descriptor
+ * @return          Malloced checksum or NULL if there is no cached
+ *                  checksum or if it is outdated (file was changed).
+ */
+char *lr_checksum_cache_get(lr_ChecksumType type, int fd);
+
+/** \ingroup checksum
+ * Store the checksum of the file to the checksum cache (extended
+ * attribute of the file).
+ * @param type      Checksum type
+ * @param fd        Opened file descriptor
+ * @param checksum  Checksum of the current content of the file
+ * @return          0 on success, 1 on error (e.g. extended attributes
+ *                  are not supported by the filesystem)
+ */
+int lr_checksum_cache_set(lr_ChecksumType type, int fd, const char *checksum);
+
+/** \ingroup checksum
+ * Calculate several checksums of the file by a single pass over its data.
+ * @param types     Array of checksum types
+ * @param count     Number of items in the types array
+ * @param fd        Opened file descriptor. Note: Function call only read()
+ *                  on the descriptor and do not perform close() or seek()
+ *                  to the beginning of file.
+ * @param checksums Array of count items where the malloced checksum
+ *                  strings are stored (in order of types).
+ * @return          0 on success, 1 on error (unknown type or read error).
+ *                  On error all checksums items are set to NULL.
+ */
+int lr_checksum_fd_multi(const lr_ChecksumType *types,
+                         int count,
+                         int fd,
+                         char **checksums);
+
+/** \ingroup checksum
+ * Context for an incremental checksum calculation. Data could be
+ * passed to the context by parts as they come (e.g. during download).
+ */
+typedef struct _lr_ChecksumCtx *lr_ChecksumCtx;
+
+/** \ingroup checksum
+ * Create new checksum context.
+ * @param type      Checksum type
+ * @return          New checksum context or NULL if the checksum type
+ *                  is not supported.
+ */
+lr_ChecksumCtx lr_checksumctx_new(lr_ChecksumType type);
+
+/** \ingroup checksum
+ * Pass data to the checksum context.
+ * @param ctx       Checksum context
+ * @param buf       Data
+ * @param len       Length of the data
+ * @return          0 on success, 1 on error
+ */
+int lr_checksumctx_update(lr_ChecksumCtx ctx, const void *buf, size_t len);
+
+/** \ingroup checksum
+ * Pass all data readable from the file descriptor to the checksum context.
+ * @param ctx       Checksum context
+ * @param fd        Opened file descriptor. Note: Function call only read()
+ *                  on the descriptor and do not perform close() or seek()
+ *                  to the beginning of file.
+ * @return          0 on success, 1 on error
+ */
+int lr_checksumctx_update_fd(lr_ChecksumCtx ctx, int fd);
+
+/** \ingroup checksum
+ * Finish the calculation. The context cannot be updated anymore.
+ * @param ctx       Checksum context
+ * @return          Malloced string with the checksum or NULL on error
+ */
+char *lr_checksumctx_final(lr_ChecksumCtx ctx);
+
+/** \ingroup checksum
+ * Free the checksum context.
+ * @param ctx       Checksum context
+ */
+void lr_checksumctx_free(lr_ChecksumCtx ctx);
+
 #ifdef __cplusplus
 }
 #endif
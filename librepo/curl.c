@@ -19,13 +19,19 @@
 
 #define _POSIX_SOURCE   200112L
 #define _BSD_SOURCE
+#define _GNU_SOURCE     /* fallocate() */
 
 #include <assert.h>
 #include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <time.h>
 #include <string.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
 #include <curl/curl.h>
 
 #include "setup.h"
@@ -34,6 +40,340 @@
 #include "util.h"
 #include "handle_internal.h"
 #include "curltargetlist.h"
+#include "mirrorstats.h"
+
+#define LR_EVENTLOOP_MAXEVENTS  64      /* Max events per one epoll_wait() */
+#define LR_EVENTLOOP_TIMEOUT    1000    /* Max time (ms) in one epoll_wait() */
+
+/* Event loop stuff */
+
+/* The event loop drives a curl multi handle by the
+ * curl_multi_socket_action() interface. Sockets are watched by epoll and
+ * curl timeouts are delivered via timerfd, so no fd_set is used and the
+ * number of parallel transfers is not limited by FD_SETSIZE. */
+
+struct _lr_EventLoop {
+    CURLM *cm_h;        /*!< curl multi handle driven by the loop */
+    int epfd;           /*!< epoll instance */
+    int tfd;            /*!< timerfd with the curl timeout */
+    int still_running;  /*!< number of still running transfers */
+};
+typedef struct _lr_EventLoop * lr_EventLoop;
+
+static int
+lr_eventloop_socket_cb(CURL *easy,
+                       curl_socket_t s,
+                       int what,
+                       void *userp,
+                       void *socketp)
+{
+    struct epoll_event ev;
+    lr_EventLoop loop = userp;
+
+    LR_UNUSED(easy);
+    LR_UNUSED(socketp);
+
+    if (what == CURL_POLL_REMOVE) {
+        /* Socket could be already closed - ignore errors */
+        epoll_ctl(loop->epfd, EPOLL_CTL_DEL, s, NULL);
+        return 0;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.data.fd = s;
+    if (what & CURL_POLL_IN)
+        ev.events |= EPOLLIN;
+    if (what & CURL_POLL_OUT)
+        ev.events |= EPOLLOUT;
+
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_MOD, s, &ev) == -1) {
+        if (errno != ENOENT
+            || epoll_ctl(loop->epfd, EPOLL_CTL_ADD, s, &ev) == -1)
+        {
+            DPRINTF("%s: epoll_ctl: %s\n", __func__, strerror(errno));
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int
+lr_eventloop_timer_cb(CURLM *cm_h, long timeout_ms, void *userp)
+{
+    struct itimerspec its;
+    lr_EventLoop loop = userp;
+
+    LR_UNUSED(cm_h);
+
+    memset(&its, 0, sizeof(its));
+    if (timeout_ms > 0) {
+        its.it_value.tv_sec = timeout_ms / 1000;
+        its.it_value.tv_nsec = (timeout_ms % 1000) * 1000000;
+    } else if (timeout_ms == 0) {
+        /* Timeout already expired - call socket_action as soon as possible.
+         * (Zeroed it_value would disarm the timer) */
+        its.it_value.tv_nsec = 1;
+    }
+    /* timeout_ms == -1 means delete the timer (zeroed its disarms it) */
+
+    if (timerfd_settime(loop->tfd, 0, &its, NULL) == -1) {
+        DPRINTF("%s: timerfd_settime: %s\n", __func__, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+static int
+lr_eventloop_init(lr_EventLoop loop, CURLM *cm_h)
+{
+    struct epoll_event ev;
+
+    loop->cm_h = cm_h;
+    loop->still_running = 0;
+    loop->tfd = -1;
+
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epfd == -1) {
+        DPRINTF("%s: epoll_create1: %s\n", __func__, strerror(errno));
+        return LRE_IO;
+    }
+
+    loop->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+    if (loop->tfd == -1) {
+        DPRINTF("%s: timerfd_create: %s\n", __func__, strerror(errno));
+        close(loop->epfd);
+        loop->epfd = -1;
+        return LRE_IO;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = loop->tfd;
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, loop->tfd, &ev) == -1) {
+        DPRINTF("%s: epoll_ctl: %s\n", __func__, strerror(errno));
+        close(loop->tfd);
+        close(loop->epfd);
+        loop->tfd = loop->epfd = -1;
+        return LRE_IO;
+    }
+
+    curl_multi_setopt(cm_h, CURLMOPT_SOCKETFUNCTION, lr_eventloop_socket_cb);
+    curl_multi_setopt(cm_h, CURLMOPT_SOCKETDATA, loop);
+    curl_multi_setopt(cm_h, CURLMOPT_TIMERFUNCTION, lr_eventloop_timer_cb);
+    curl_multi_setopt(cm_h, CURLMOPT_TIMERDATA, loop);
+
+    return LRE_OK;
+}
+
+static void
+lr_eventloop_cleanup(lr_EventLoop loop)
+{
+    if (loop->cm_h) {
+        /* Curl could call the callbacks even during curl_multi_cleanup() */
+        curl_multi_setopt(loop->cm_h, CURLMOPT_SOCKETFUNCTION, NULL);
+        curl_multi_setopt(loop->cm_h, CURLMOPT_TIMERFUNCTION, NULL);
+        loop->cm_h = NULL;
+    }
+    if (loop->tfd != -1)
+        close(loop->tfd);
+    if (loop->epfd != -1)
+        close(loop->epfd);
+    loop->tfd = loop->epfd = -1;
+}
+
+/** Kick off transfers which were added to the multi handle */
+static CURLMcode
+lr_eventloop_start(lr_EventLoop loop)
+{
+    return curl_multi_socket_action(loop->cm_h,
+                                    CURL_SOCKET_TIMEOUT,
+                                    0,
+                                    &loop->still_running);
+}
+
+/** Wait for events and let curl process them (one iteration of the loop) */
+static CURLMcode
+lr_eventloop_wait(lr_EventLoop loop)
+{
+    int nfds;
+    CURLMcode cm_rc = CURLM_OK;
+    struct epoll_event events[LR_EVENTLOOP_MAXEVENTS];
+
+    nfds = epoll_wait(loop->epfd,
+                      events,
+                      LR_EVENTLOOP_MAXEVENTS,
+                      LR_EVENTLOOP_TIMEOUT);
+
+    if (nfds == -1) {
+        if (errno == EINTR)
+            return CURLM_OK;
+        DPRINTF("%s: epoll_wait: %s\n", __func__, strerror(errno));
+        return CURLM_INTERNAL_ERROR;
+    }
+
+    if (nfds == 0)
+        /* No event for too long - let curl check its timeouts */
+        return curl_multi_socket_action(loop->cm_h,
+                                        CURL_SOCKET_TIMEOUT,
+                                        0,
+                                        &loop->still_running);
+
+    for (int x = 0; x < nfds && cm_rc == CURLM_OK; x++) {
+        if (events[x].data.fd == loop->tfd) {
+            /* Curl timeout expired */
+            uint64_t expirations;
+            if (read(loop->tfd, &expirations, sizeof(expirations)) < 0
+                && errno != EAGAIN)
+                DPRINTF("%s: read(timerfd): %s\n", __func__, strerror(errno));
+            cm_rc = curl_multi_socket_action(loop->cm_h,
+                                             CURL_SOCKET_TIMEOUT,
+                                             0,
+                                             &loop->still_running);
+        } else {
+            /* Activity on a socket */
+            int mask = 0;
+            if (events[x].events & EPOLLIN)
+                mask |= CURL_CSELECT_IN;
+            if (events[x].events & EPOLLOUT)
+                mask |= CURL_CSELECT_OUT;
+            if (events[x].events & (EPOLLERR|EPOLLHUP))
+                mask |= CURL_CSELECT_ERR;
+            cm_rc = curl_multi_socket_action(loop->cm_h,
+                                             events[x].data.fd,
+                                             mask,
+                                             &loop->still_running);
+        }
+    }
+
+    return cm_rc;
+}
+
+/** Run the loop until all transfers are finished */
+static CURLMcode
+lr_eventloop_run(lr_EventLoop loop)
+{
+    CURLMcode cm_rc = lr_eventloop_start(loop);
+
+    while (cm_rc == CURLM_OK && loop->still_running)
+        cm_rc = lr_eventloop_wait(loop);
+
+    return cm_rc;
+}
+
+/** Perform a transfer of one curl easy handle via the event loop.
+ * This is a replacement for curl_easy_perform().
+ */
+static CURLcode
+lr_curl_easy_perform(lr_Handle handle, CURL *c_h)
+{
+    CURLM *cm_h;
+    CURLMcode cm_rc;
+    CURLMsg *msg;
+    int msgs_left;
+    CURLcode c_rc = CURLE_FAILED_INIT;
+    struct _lr_EventLoop loop;
+
+    cm_h = curl_multi_init();
+    if (!cm_h)
+        return CURLE_FAILED_INIT;
+
+    if (lr_eventloop_init(&loop, cm_h) != LRE_OK) {
+        curl_multi_cleanup(cm_h);
+        return CURLE_FAILED_INIT;
+    }
+
+    cm_rc = curl_multi_add_handle(cm_h, c_h);
+    if (cm_rc == CURLM_OK) {
+        cm_rc = lr_eventloop_run(&loop);
+        while ((msg = curl_multi_info_read(cm_h, &msgs_left)))
+            if (msg->msg == CURLMSG_DONE && msg->easy_handle == c_h)
+                c_rc = msg->data.result;
+        curl_multi_remove_handle(cm_h, c_h);
+    }
+
+    if (cm_rc != CURLM_OK) {
+        DPRINTF("%s: curl multi error: %s\n", __func__, curl_multi_strerror(cm_rc));
+        handle->last_curlm_error = cm_rc;
+    }
+
+    lr_eventloop_cleanup(&loop);
+    curl_multi_cleanup(cm_h);
+    return c_rc;
+}
+
+/* End of event loop stuff */
+
+/** Duplicate the handle->curl_handle for a new transfer.
+ * Duplicated handle doesn't inherit the share handle, so it is set
+ * explicitly to reuse DNS cache, SSL sessions and connections.
+ * @param handle        Librepo handle.
+ * @return              New CURL easy handle or NULL.
+ */
+static CURL *
+lr_curl_duphandle(lr_Handle handle)
+{
+    CURL *c_h = curl_easy_duphandle(handle->curl_handle);
+
+    if (c_h && handle->curl_share_handle)
+        curl_easy_setopt(c_h, CURLOPT_SHARE, handle->curl_share_handle);
+    if (c_h && handle->nosignal)
+        curl_easy_setopt(c_h, CURLOPT_NOSIGNAL, 1);
+
+    return c_h;
+}
+
+/* Mirror statistics stuff */
+
+/** Note the result of a download from the mirror.
+ * @param mirror        Mirror or NULL if the url is not from the
+ *                      internal mirrorlist.
+ * @param rc            ::lr_Rc of the download.
+ * @param c_h           Finished curl handle to get the transfer
+ *                      speed from or NULL.
+ */
+static void
+lr_curl_mirror_note(lr_InternalMirror mirror, int rc, CURL *c_h)
+{
+    if (!mirror || rc == LRE_IO)
+        return;  /* Local error is not a fault of the mirror */
+
+    if (rc != LRE_OK) {
+        mirror->fails++;
+        mirror->last_failure = time(NULL);
+        return;
+    }
+
+    mirror->successes++;
+    if (c_h) {
+        double seconds = 0.0;
+#if LIBCURL_VERSION_NUM >= 0x073700
+        curl_off_t bytes = 0;
+        curl_easy_getinfo(c_h, CURLINFO_SIZE_DOWNLOAD_T, &bytes);
+#else
+        double bytes = 0.0;
+        curl_easy_getinfo(c_h, CURLINFO_SIZE_DOWNLOAD, &bytes);
+#endif
+        curl_easy_getinfo(c_h, CURLINFO_TOTAL_TIME, &seconds);
+        mirror->bytes += (long long) bytes;
+        mirror->seconds += seconds;
+    }
+}
+
+/** Store noted results of downloads into the LRO_MIRRORSTATS file */
+static void
+lr_curl_mirrorstats_save(lr_Handle handle)
+{
+    int rc;
+
+    if (!handle->mirrorstats || !handle->internal_mirrorlist)
+        return;
+
+    rc = lr_mirrorstats_save(handle->mirrorstats, handle->internal_mirrorlist);
+    if (rc != LRE_OK)
+        DPRINTF("%s: Cannot save mirror statistics (%d)\n", __func__, rc);
+}
 
 /* Callback stuff */
 
@@ -118,29 +458,443 @@ lr_single_progress_func(void* ptr,
     return cb_data->cb(cb_data->user_data, total_to_download, now_downloaded);
 }
 
+/** Data for the lr_write_func */
+struct _lr_WriteData {
+    int fd;                     /*!< Output file descriptor or -1 if
+                                     data are collected in the memory
+                                     (or only passed to the data_cb) */
+    char *mem;                  /*!< Memory buffer with collected data */
+    size_t mem_len;             /*!< Length of data in the memory buffer */
+    size_t mem_size;            /*!< Allocated size of the memory buffer */
+    char *buf;                  /*!< Page aligned buffer for coalescing
+                                     of small writes or NULL */
+    size_t buf_size;            /*!< Size of the buffer */
+    size_t buf_used;            /*!< Number of bytes in the buffer */
+    int error;                  /*!< errno of the failed write or 0 */
+    lr_ChecksumCtx checksum;    /*!< Checksum of the downloaded data or NULL */
+    lr_DataCb data_cb;          /*!< Consumer of the downloaded data or NULL */
+    void *data_cb_data;         /*!< User data for the data_cb */
+    long long size_left;        /*!< Number of bytes which could be still
+                                     received or -1 if unlimited */
+    long long size_expected;    /*!< Expected length of the response body
+                                     or -1 if not checked */
+    long status_code;           /*!< Status code of the current HTTP
+                                     response (from its headers) */
+    lr_CurlValidators validators; /*!< Validators of the downloaded file
+                                       are stored here or NULL */
+    int bad_size;               /*!< 1 if the size of the received data
+                                     contradicts the expected size */
+};
+typedef struct _lr_WriteData * lr_WriteData;
+
+/** Prepare write data for writing to the fd.
+ * @param fd                Output file descriptor or -1 to collect
+ *                          data in the memory buffer (data->mem).
+ *                          If data->data_cb is set, data with fd -1
+ *                          are only passed to the callback.
+ * @param buf_size          Size of the write buffer (LRO_WRITEBUFFERSIZE),
+ *                          0 means that every chunk of data received
+ *                          by curl is written directly.
+ */
+static void
+lr_writedata_init(lr_WriteData data, int fd, size_t buf_size)
+{
+    data->fd = fd;
+    data->mem_len = 0;
+    data->buf_used = 0;
+    data->error = 0;
+    data->size_left = -1;
+    data->size_expected = -1;
+    data->status_code = 0;
+    data->bad_size = 0;
+
+    if (data->data_cb)
+        /* Download (re)starts - data passed so far are not valid */
+        data->data_cb(data->data_cb_data, NULL, 0);
+
+    if (fd < 0)
+        buf_size = 0;  /* Memory buffer doesn't need write coalescing */
+
+    if (data->buf && data->buf_size == buf_size)
+        return;  /* Buffer is reused (e.g. for the next mirror) */
+
+    free(data->buf);
+    data->buf = NULL;
+    data->buf_size = 0;
+
+    if (buf_size > 0) {
+        long pagesize = sysconf(_SC_PAGESIZE);
+        if (posix_memalign((void **) &data->buf, pagesize, buf_size))
+            lr_out_of_memory();
+        data->buf_size = buf_size;
+    }
+}
+
+/** Prepare the write data (already initialized by lr_writedata_init)
+ * for a file of the known size. Space for the rest of the file is
+ * allocated in advance - on the disk or in the memory buffer.
+ * @param size              Expected size of the whole file or 0 if unknown.
+ * @param offset            Size of the data already present in the file.
+ * @param limit             If != 0 the transfer fails as soon as
+ *                          Content-Length of the response or more than
+ *                          the expected data contradict the size.
+ */
+static void
+lr_writedata_expect(lr_WriteData data,
+                    long long size,
+                    long long offset,
+                    int limit)
+{
+    if (size <= 0)
+        return;  /* Size is unknown */
+
+    if (limit) {
+        data->size_left = (size > offset) ? size - offset : 0;
+        data->size_expected = data->size_left;
+    }
+
+    if (size <= offset)
+        return;  /* Nothing left to allocate */
+
+    if (data->fd >= 0) {
+#ifdef FALLOC_FL_KEEP_SIZE
+        /* Size of the file is not changed - partially downloaded
+         * file must not look complete to the download resume.
+         * Failure is not important, it is just an optimization. */
+        if (fallocate(data->fd, FALLOC_FL_KEEP_SIZE,
+                      (off_t) offset, (off_t) (size - offset)) == -1)
+            DPRINTF("%s: fallocate: %s\n", __func__, strerror(errno));
+#endif
+    } else if (!data->data_cb && data->mem_size < (size_t) size + 1) {
+        data->mem = lr_realloc(data->mem, (size_t) size + 1);
+        data->mem_size = (size_t) size + 1;
+    }
+}
+
+/** Free the write buffer and the collected data. */
+static void
+lr_writedata_clear(lr_WriteData data)
+{
+    free(data->buf);
+    data->buf = NULL;
+    data->buf_size = 0;
+    data->buf_used = 0;
+    lr_free(data->mem);
+    data->mem = NULL;
+    data->mem_len = 0;
+    data->mem_size = 0;
+}
+
+/** Take the data collected in the memory. Returned buffer is always
+ * NUL terminated and the caller is responsible to free it. */
+static char *
+lr_writedata_steal_mem(lr_WriteData data, size_t *len)
+{
+    char *mem = data->mem;
+
+    *len = data->mem_len;
+    if (!mem)
+        mem = lr_malloc0(1);
+
+    data->mem = NULL;
+    data->mem_len = 0;
+    data->mem_size = 0;
+    return mem;
+}
+
+/** Append data to the memory buffer. */
+static void
+lr_writedata_append_mem(lr_WriteData data, const char *buf, size_t len)
+{
+    if (data->mem_len + len + 1 > data->mem_size) {
+        size_t size = data->mem_size ? data->mem_size * 2 : 4096;
+        while (size < data->mem_len + len + 1)
+            size *= 2;
+        data->mem = lr_realloc(data->mem, size);
+        data->mem_size = size;
+    }
+
+    memcpy(data->mem + data->mem_len, buf, len);
+    data->mem_len += len;
+    data->mem[data->mem_len] = '\0';
+}
+
+/** Write the whole buffer to the fd. Short writes are continued,
+ * on error the errno is stored to the data->error.
+ * @return                  0 on success, 1 on error.
+ */
+static int
+lr_writedata_write(lr_WriteData data, const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t written = write(data->fd, buf, len);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            data->error = errno;
+        } else if (written == 0) {
+            data->error = ENOSPC;
+        }
+
+        if (data->error) {
+            DPRINTF("%s: write: %s\n", __func__, strerror(data->error));
+            return 1;
+        }
+
+        buf += written;
+        len -= written;
+    }
+
+    return 0;
+}
+
+/** Write buffered data to the fd.
+ * @return                  0 on success, 1 on error.
+ */
+static int
+lr_writedata_flush(lr_WriteData data)
+{
+    int rc = 0;
+
+    if (data->error)
+        return 1;
+
+    if (data->buf_used)
+        rc = lr_writedata_write(data, data->buf, data->buf_used);
+    data->buf_used = 0;
+
+    return rc;
+}
+
+/** Write callback - writes downloaded data, passes them to the data
+ * callback and updates their checksum */
+static size_t
+lr_write_func(char *ptr, size_t size, size_t nmemb, void *userdata)
+{
+    size_t len = size * nmemb;
+    lr_WriteData data = userdata;
+
+    if (data->size_left >= 0) {
+        if ((long long) len > data->size_left) {
+            /* Server sends more than expected - a wrong file */
+            DPRINTF("%s: More data than expected received\n", __func__);
+            data->bad_size = 1;
+            return 0;
+        }
+        data->size_left -= len;
+    }
+
+    if (data->fd < 0) {
+        if (!data->data_cb)
+            lr_writedata_append_mem(data, ptr, len);
+    } else {
+        if (data->buf && data->buf_used + len > data->buf_size)
+            if (lr_writedata_flush(data))
+                return 0;
+
+        if (data->buf && len < data->buf_size) {
+            memcpy(data->buf + data->buf_used, ptr, len);
+            data->buf_used += len;
+        } else if (lr_writedata_write(data, ptr, len)) {
+            return 0;  /* Curl returns CURLE_WRITE_ERROR */
+        }
+    }
+
+    if (data->data_cb)
+        data->data_cb(data->data_cb_data, ptr, len);
+
+    if (data->checksum)
+        lr_checksumctx_update(data->checksum, ptr, len);
+
+    return len;
+}
+
+/** Replace the string by the value of the header line (without
+ * surrounding whitespaces and CRLF). Empty value is stored as NULL. */
+static void
+lr_header_value(char **dst, const char *value, size_t len)
+{
+    while (len && (*value == ' ' || *value == '\t')) {
+        value++;
+        len--;
+    }
+    while (len && strchr(" \t\r\n", value[len-1]))
+        len--;
+
+    lr_free(*dst);
+    *dst = NULL;
+    if (len) {
+        *dst = lr_malloc(len + 1);
+        memcpy(*dst, value, len);
+        (*dst)[len] = '\0';
+    }
+}
+
+/** Header callback - compares Content-Length of the successful HTTP
+ * response with the expected size, so a wrong file is refused before
+ * its body is downloaded, and collects validators (ETag, Last-Modified)
+ * of the file. */
+static size_t
+lr_header_func(char *ptr, size_t size, size_t nmemb, void *userdata)
+{
+    size_t len = size * nmemb;
+    lr_WriteData data = userdata;
+    lr_CurlValidators validators = data->validators;
+
+    /* Header lines end with CRLF, so strtol() never runs out of them */
+    if (len > 5 && !strncmp(ptr, "HTTP/", 5)) {
+        /* Status line - a new response begins (e.g. after a redirect) */
+        char *space = memchr(ptr, ' ', len);
+        data->status_code = (space) ? strtol(space + 1, NULL, 10) : 0;
+        if (validators && data->status_code == 200) {
+            /* Validators of the previous response are not valid */
+            lr_header_value(&validators->new_etag, "", 0);
+            lr_header_value(&validators->new_last_modified, "", 0);
+        }
+        return len;
+    }
+
+    if (data->status_code != 200 && data->status_code != 206)
+        return len;
+
+    if (data->size_expected >= 0
+        && len > 15 && !strncasecmp(ptr, "Content-Length:", 15)) {
+        long long length = strtoll(ptr + 15, NULL, 10);
+        if (length != data->size_expected) {
+            DPRINTF("%s: Content-Length %lld doesn't match expected %lld\n",
+                    __func__, length, data->size_expected);
+            data->bad_size = 1;
+            return 0;  /* Curl returns CURLE_WRITE_ERROR */
+        }
+    } else if (validators && data->status_code == 200) {
+        if (len > 5 && !strncasecmp(ptr, "ETag:", 5))
+            lr_header_value(&validators->new_etag, ptr + 5, len - 5);
+        else if (len > 14 && !strncasecmp(ptr, "Last-Modified:", 14))
+            lr_header_value(&validators->new_last_modified,
+                            ptr + 14, len - 14);
+    }
+
+    return len;
+}
+
 /* End of callback stuff */
 
-int
-lr_curl_single_download_resume(lr_Handle handle,
-                               const char *url,
-                               int fd,
-                               long long offset,
-                               int use_cb)
+/** Start checksum calculation for a download. If the download is resumed
+ * (offset is not 0), data which are already present in the file (fd)
+ * are passed to the checksum context. After that, the descriptor
+ * position is at the end of the file.
+ * @param checksum_type     Checksum type.
+ * @param fd                File descriptor.
+ * @param offset            Download offset.
+ * @param ctx               New checksum context or NULL if the checksum
+ *                          type is unknown.
+ * @return                  ::lr_Rc value.
+ */
+static int
+lr_curl_checksum_start(lr_ChecksumType checksum_type,
+                       int fd,
+                       long long offset,
+                       lr_ChecksumCtx *ctx)
+{
+    *ctx = lr_checksumctx_new(checksum_type);
+    if (!*ctx || !offset)
+        return LRE_OK;
+
+    lseek(fd, 0, SEEK_SET);
+    if (lr_checksumctx_update_fd(*ctx, fd)) {
+        DPRINTF("%s: Cannot read already downloaded data: %s\n",
+                __func__, strerror(errno));
+        lr_checksumctx_free(*ctx);
+        *ctx = NULL;
+        return LRE_IO;
+    }
+
+    return LRE_OK;
+}
+
+/** Finish checksum calculation and compare it with the expected checksum.
+ * If LRO_CHECKSUMCACHE is enabled, the valid checksum is stored to
+ * the checksum cache of the downloaded file.
+ * @param fd                Descriptor of the downloaded file. All data
+ *                          must be already written.
+ * @return                  LRE_OK if the checksum matches,
+ *                          LRE_BADCHECKSUM otherwise.
+ */
+static int
+lr_curl_checksum_check(lr_Handle handle,
+                       lr_ChecksumCtx ctx,
+                       lr_ChecksumType checksum_type,
+                       const char *expected,
+                       int fd)
+{
+    int ret = LRE_OK;
+    char *checksum = lr_checksumctx_final(ctx);
+
+    if (!checksum || strcmp(expected, checksum)) {
+        DPRINTF("%s: Bad checksum\n", __func__);
+        ret = LRE_BADCHECKSUM;
+    } else if (handle->checksumcache && fd >= 0) {
+        lr_checksum_cache_set(checksum_type, fd, checksum);
+    }
+
+    lr_free(checksum);
+    return ret;
+}
+
+/** Download the url to the fd or, if fd is < 0, to the memory.
+ * @param data              If fd < 0 and no data_cb is used, the
+ *                          downloaded data (malloced and NUL terminated)
+ *                          are returned here on success.
+ * @param data_len          Length of the returned data.
+ * @param expected_size     Expected size of the whole file or 0 if unknown.
+ * @param validators        Validators for a conditional download or NULL.
+ *                          LRE_NOTMODIFIED is returned if the server
+ *                          answers 304 Not Modified.
+ * @param data_cb           Callback which gets all downloaded data or NULL.
+ * @param data_cb_data      User data for the data_cb.
+ * @param mirror            Mirror of the url whose statistics (result and
+ *                          throughput) are updated or NULL.
+ */
+static int
+lr_curl_single_download_internal(lr_Handle handle,
+                                 const char *url,
+                                 int fd,
+                                 char **data,
+                                 size_t *data_len,
+                                 lr_ChecksumType checksum_type,
+                                 const char *checksum,
+                                 long long offset,
+                                 long long expected_size,
+                                 lr_CurlValidators validators,
+                                 int use_cb,
+                                 lr_DataCb data_cb,
+                                 void *data_cb_data,
+                                 lr_InternalMirror mirror)
 {
     CURLcode c_rc = CURLE_OK;
     CURL *c_h = NULL;
-    FILE *f = NULL;
     long status_code = 0;
     int ret = LRE_OK;
     int retries = 0;
     lr_SingleCallbackData cb_data = NULL;
+    struct curl_slist *headers = NULL;
+    struct _lr_WriteData wdata = { .fd = -1,
+                                   .validators = validators,
+                                   .data_cb = data_cb,
+                                   .data_cb_data = data_cb_data };
+
+    if (fd < 0)
+        offset = 0;  /* Nothing to resume in the memory */
+
+    if (!checksum)
+        checksum_type = LR_CHECKSUM_UNKNOWN;
 
     if (!url) {
         DPRINTF("%s: No url specified", __func__);
         return LRE_NOURL;
     }
 
-    c_h = curl_easy_duphandle(handle->curl_handle);
+    c_h = lr_curl_duphandle(handle);
     if (!c_h) {
         DPRINTF("%s: Cannot dup CURL handle\n", __func__);
         return LRE_CURLDUP;
@@ -154,18 +908,12 @@ lr_curl_single_download_resume(lr_Handle handle,
         return LRE_CURL;
     }
 
-    f = fdopen(dup(fd), "w");
-    if (!f) {
-        curl_easy_cleanup(c_h);
-        DPRINTF("%s: fdopen: %s\n", __func__, strerror(errno));
-        return LRE_IO;
-    }
-
-    c_rc = curl_easy_setopt(c_h, CURLOPT_WRITEDATA, f);
+    /* Data are written directly to the fd */
+    curl_easy_setopt(c_h, CURLOPT_WRITEFUNCTION, lr_write_func);
+    c_rc = curl_easy_setopt(c_h, CURLOPT_WRITEDATA, &wdata);
     if (c_rc != CURLE_OK) {
         curl_easy_cleanup(c_h);
         handle->last_curl_error = c_rc;
-        fclose(f);
         DPRINTF("%s: curl_easy_setopt: %s\n", __func__, curl_easy_strerror(c_rc));
         return LRE_CURL;
     }
@@ -175,8 +923,7 @@ lr_curl_single_download_resume(lr_Handle handle,
         DPRINTF("%s: download resume offset: %lld\n", __func__, offset);
         if (offset == -1) {
             /* determine offset */
-            fseek(f, 0L, SEEK_END);
-            offset = (long long) ftell(f);
+            offset = (long long) lseek(fd, 0, SEEK_END);
             DPRINTF("%s: determined offset for download resume: %lld\n",
                     __func__, offset);
         }
@@ -185,14 +932,29 @@ lr_curl_single_download_resume(lr_Handle handle,
         if (c_rc != CURLE_OK) {
             curl_easy_cleanup(c_h);
             handle->last_curl_error = c_rc;
-            fclose(f);
             DPRINTF("%s: curl_easy_setopt: %s\n", __func__, curl_easy_strerror(c_rc));
             return LRE_CURL;
         }
     }
 
     /* Header cb */
-//    curl_easy_setopt(c_h, CURLOPT_HEADERFUNCTION, header_cb);
+    curl_easy_setopt(c_h, CURLOPT_HEADERFUNCTION, lr_header_func);
+    curl_easy_setopt(c_h, CURLOPT_HEADERDATA, &wdata);
+
+    /* Conditional request */
+    if (validators && validators->etag) {
+        char *header = lr_strconcat("If-None-Match: ", validators->etag, NULL);
+        headers = curl_slist_append(headers, header);
+        lr_free(header);
+    }
+    if (validators && validators->last_modified) {
+        char *header = lr_strconcat("If-Modified-Since: ",
+                                    validators->last_modified, NULL);
+        headers = curl_slist_append(headers, header);
+        lr_free(header);
+    }
+    if (headers)
+        curl_easy_setopt(c_h, CURLOPT_HTTPHEADER, headers);
 
     /* Use callback if desired */
     if (use_cb && handle->user_cb) {
@@ -214,7 +976,35 @@ lr_curl_single_download_resume(lr_Handle handle,
         ret = LRE_OK;
         status_code = 0;
 
-        c_rc = curl_easy_perform(c_h);
+        /* (Re)start checksum calculation */
+        lr_checksumctx_free(wdata.checksum);
+        ret = lr_curl_checksum_start(checksum_type, fd, offset, &wdata.checksum);
+        if (ret != LRE_OK)
+            break;
+
+        lr_writedata_init(&wdata, fd, handle->writebuffersize);
+        /* Size is enforced only together with the checksum - a file
+         * of an unexpected size would not pass the check anyway */
+        lr_writedata_expect(&wdata, expected_size, offset,
+                            wdata.checksum != NULL);
+        c_rc = lr_curl_easy_perform(handle, c_h);
+
+        /* Write rest of the buffered data */
+        if (lr_writedata_flush(&wdata)) {
+            /* Local error (e.g. ENOSPC) - no retry */
+            DPRINTF("%s: Cannot write data: %s\n",
+                    __func__, strerror(wdata.error));
+            ret = LRE_IO;
+            goto retry;
+        }
+
+        if (wdata.bad_size) {
+            /* File cannot match the checksum - no retry,
+             * other mirror could have the right one */
+            c_rc = CURLE_FILESIZE_EXCEEDED;
+            ret = LRE_BADCHECKSUM;
+            goto retry;
+        }
 
         if (c_rc != CURLE_OK && c_rc != CURLE_HTTP_RETURNED_ERROR) {
             ret = LRE_CURL;
@@ -238,6 +1028,11 @@ lr_curl_single_download_resume(lr_Handle handle,
                 /* HTTP(S) */
                 if (status_code == 200)
                     break; /* No error */
+                if (validators && status_code == 304) {
+                    /* Local copy is up to date */
+                    ret = LRE_NOTMODIFIED;
+                    break;
+                }
                 if (offset && status_code == 206)
                     break; /* No error */
 
@@ -284,9 +1079,10 @@ retry:
 
         /* Discart all downloaded data which were downloaded now (truncate) */
         /* The downloaded data are problably only server error message! */
-        lseek(fd, (off_t) offset, SEEK_SET);
-        ftruncate(fd, (off_t) offset);
-        fseek(f, offset, SEEK_SET);
+        if (fd >= 0) {
+            lseek(fd, (off_t) offset, SEEK_SET);
+            ftruncate(fd, (off_t) offset);
+        }
 
         if (ret != LRE_TEMPORARYERR)
             /* No temporary error - end */
@@ -305,20 +1101,105 @@ retry:
         usleep(500000);
     }
 
-    fclose(f);
+    /* Check checksum */
+    if (ret == LRE_OK && wdata.checksum) {
+        DPRINTF("%s: Checking checksum\n", __func__);
+        ret = lr_curl_checksum_check(handle, wdata.checksum,
+                                     checksum_type, checksum, fd);
+    }
+
+    if (ret == LRE_OK && data)
+        *data = lr_writedata_steal_mem(&wdata, data_len);
+
+    /* Not modified file was not transferred, there is no throughput */
+    lr_curl_mirror_note(mirror, (ret == LRE_NOTMODIFIED) ? LRE_OK : ret,
+                        (ret == LRE_OK) ? c_h : NULL);
+
+    lr_writedata_clear(&wdata);
     curl_easy_cleanup(c_h);
+    curl_slist_free_all(headers);
+    lr_checksumctx_free(wdata.checksum);
     lr_free(cb_data);
     return ret;
 }
 
 int
-lr_curl_single_mirrored_download_resume(lr_Handle handle,
-                                        const char *path,
-                                        int fd,
-                                        lr_ChecksumType checksum_type,
-                                        const char *checksum,
-                                        long long offset,
-                                        int use_cb)
+lr_curl_single_download_checksum(lr_Handle handle,
+                                 const char *url,
+                                 int fd,
+                                 lr_ChecksumType checksum_type,
+                                 const char *checksum,
+                                 long long offset,
+                                 int use_cb)
+{
+    if (fd < 0) {
+        DPRINTF("%s: Bad file descriptor\n", __func__);
+        return LRE_BADFUNCARG;
+    }
+
+    return lr_curl_single_download_internal(handle, url, fd, NULL, NULL,
+                                            checksum_type, checksum,
+                                            offset, 0, NULL, use_cb,
+                                            NULL, NULL, NULL);
+}
+
+int
+lr_curl_single_download_cb(lr_Handle handle,
+                           const char *url,
+                           int fd,
+                           lr_DataCb data_cb,
+                           void *data_cb_data)
+{
+    assert(data_cb);
+    return lr_curl_single_download_internal(handle, url, fd, NULL, NULL,
+                                            LR_CHECKSUM_UNKNOWN, NULL,
+                                            0, 0, NULL, 0,
+                                            data_cb, data_cb_data, NULL);
+}
+
+int
+lr_curl_single_download_mem(lr_Handle handle,
+                            const char *url,
+                            char **data,
+                            size_t *data_len)
+{
+    int ret;
+    size_t len = 0;
+
+    if (!data)
+        return LRE_BADFUNCARG;
+
+    *data = NULL;
+    if (data_len)
+        *data_len = 0;
+
+    ret = lr_curl_single_download_internal(handle, url, -1, data, &len,
+                                           LR_CHECKSUM_UNKNOWN, NULL, 0, 0,
+                                           NULL, 0, NULL, NULL, NULL);
+    if (ret == LRE_OK && data_len)
+        *data_len = len;
+
+    return ret;
+}
+
+/** Download the path from the first working mirror.
+ * @param expected_size     Expected size of the whole file or 0 if unknown.
+ * @param validators        Validators for a conditional download or NULL.
+ * @param data_cb           Callback which gets all downloaded data or NULL.
+ * @param data_cb_data      User data for the data_cb.
+ */
+static int
+lr_curl_single_mirrored_download_internal(lr_Handle handle,
+                                          const char *path,
+                                          int fd,
+                                          lr_ChecksumType checksum_type,
+                                          const char *checksum,
+                                          long long offset,
+                                          long long expected_size,
+                                          lr_CurlValidators validators,
+                                          int use_cb,
+                                          lr_DataCb data_cb,
+                                          void *data_cb_data)
 {
     int rc;
     int mirrors;
@@ -333,47 +1214,56 @@ lr_curl_single_mirrored_download_resume(lr_Handle handle,
 
     DPRINTF("%s: Downloading %s\n", __func__, path);
 
+    if (!(handle->checks & LR_CHECK_CHECKSUM))
+        checksum = NULL;  /* Checksum check is disabled */
+
     for (int x=0; x < mirrors; x++) {
         char *full_url;
         char *url = lr_internalmirrorlist_get_url(iml, x);
         DPRINTF("%s: Trying mirror: %s\n", __func__, url);
 
-        lseek(fd, 0, SEEK_SET);
-        if (offset == 0)
-            ftruncate(fd, 0);
+        if (fd >= 0) {
+            lseek(fd, 0, SEEK_SET);
+            if (offset == 0)
+                ftruncate(fd, 0);
+        }
 
+        /* Checksum is calculated during the download */
         full_url = lr_pathconcat(url, path, NULL);
-        rc = lr_curl_single_download_resume(handle, full_url, fd, offset, use_cb);
+        rc = lr_curl_single_download_internal(handle, full_url, fd,
+                                              NULL, NULL,
+                                              checksum_type, checksum,
+                                              offset, expected_size,
+                                              validators, use_cb,
+                                              data_cb, data_cb_data,
+                                              lr_internalmirrorlist_get(iml, x));
         lr_free(full_url);
 
         DPRINTF("%s: Download rc: %d (%s)\n", __func__, rc, lr_strerror(rc));
 
+        if (rc == LRE_IO)
+            break;  /* Local error - other mirrors do not help */
+
+        if (rc == LRE_NOTMODIFIED) {
+            DPRINTF("%s: %s was not modified\n", __func__, path);
+            break;
+        }
+
+        if (rc == LRE_BADCHECKSUM && offset) {
+            /* If download was successfull but checksum doesn't match
+             * In next run, do not try to resume download and download
+             * whole file instead*/
+            offset = 0;
+            /* Try againt this mirror, but this time download
+             * whole file (no resume) */
+            x--;
+            continue;
+        }
+
         if (rc == LRE_OK) {
             /* Download successful */
             DPRINTF("%s: Download successful\n", __func__);
 
-            /* Check checksum */
-            if (checksum && handle->checks & LR_CHECK_CHECKSUM
-                &&  checksum_type != LR_CHECKSUM_UNKNOWN)
-            {
-                DPRINTF("%s: Checking checksum\n", __func__);
-                lseek(fd, 0, SEEK_SET);
-                if (lr_checksum_fd_cmp(checksum_type, fd, checksum)) {
-                    DPRINTF("%s: Bad checksum\n", __func__);
-                    rc = LRE_BADCHECKSUM;
-                    if (offset) {
-                        /* If download was successfull but checksum doesn't match
-                         * In next run, do not try to resume download and download
-                         * whole file instead*/
-                        offset = 0;
-                        /* Try againt this mirror, but this time download
-                         * whole file (no resume) */
-                        x--;
-                    }
-                    continue; /* Try next mirror */
-                }
-            }
-
             /* Store used mirror into the handler */
             if (handle->used_mirror)
                 lr_free(handle->used_mirror);
@@ -382,35 +1272,494 @@ lr_curl_single_mirrored_download_resume(lr_Handle handle,
         }
     }
 
+    lr_curl_mirrorstats_save(handle);
+
     return rc;
 }
 
 int
-lr_curl_multi_download(lr_Handle handle, lr_CurlTargetList targets)
+lr_curl_single_mirrored_download_resume(lr_Handle handle,
+                                        const char *path,
+                                        int fd,
+                                        lr_ChecksumType checksum_type,
+                                        const char *checksum,
+                                        long long offset,
+                                        int use_cb)
 {
-    int not = lr_curltargetlist_len(targets);  /* Number Of Targets */
-    int nom;            /* Number Of Mirrors */
-    int ret = LRE_OK, last_ret = LRE_OK;
-    long last_code = 0; // last error HTTP of FTP return code
-    int failed_downloads = 0;
-    CURL *curl_easy_interfaces[not];
-    FILE *open_files[not];
-    CURLMcode cm_rc;
-    CURLM *cm_h = NULL; /* Curl Multi Handle */
-    lr_InternalMirrorlist iml;
-
-    struct _lr_SharedCallbackData shared_cb_data;
-    struct _lr_CallbackData cb_data[not];
+    return lr_curl_single_mirrored_download_internal(handle, path, fd,
+                                                     checksum_type, checksum,
+                                                     offset, 0, NULL, use_cb,
+                                                     NULL, NULL);
+}
+
+int
+lr_curl_single_mirrored_download_cb(lr_Handle handle,
+                                    const char *path,
+                                    int fd,
+                                    lr_ChecksumType checksum_type,
+                                    const char *checksum,
+                                    long long expected_size,
+                                    lr_CurlValidators validators,
+                                    lr_DataCb data_cb,
+                                    void *data_cb_data)
+{
+    assert(data_cb);
+    return lr_curl_single_mirrored_download_internal(handle, path, fd,
+                                                     checksum_type, checksum,
+                                                     0, expected_size,
+                                                     validators, 0,
+                                                     data_cb, data_cb_data);
+}
+
+lr_CurlValidators
+lr_curlvalidators_new()
+{
+    return lr_malloc0(sizeof(struct _lr_CurlValidators));
+}
+
+void
+lr_curlvalidators_free(lr_CurlValidators validators)
+{
+    if (!validators)
+        return;
+    lr_free(validators->etag);
+    lr_free(validators->last_modified);
+    lr_free(validators->new_etag);
+    lr_free(validators->new_last_modified);
+    lr_free(validators);
+}
+
+/* Multi download stuff */
+
+/** State of a target during lr_curl_multi_download */
+struct _lr_CurlTransfer {
+    lr_CurlTarget target;   /*!< downloaded target */
+    int mirror;             /*!< index of the currently used mirror */
+    int mirror_end;         /*!< index behind the last usable mirror */
+    int queued;             /*!< waiting for a free download slot */
+    int resume;             /*!< try to resume the download */
+    int fd_opened;          /*!< target->fd was opened by the transfer */
+    long long offset;       /*!< offset the running transfer started from */
+    CURL *curl_handle;      /*!< curl easy handle of the running transfer */
+    struct _lr_WriteData wdata; /*!< output stream and checksum context
+                                     of the running transfer */
+    struct _lr_CallbackData cb_data; /*!< progress callback data */
+};
+typedef struct _lr_CurlTransfer * lr_CurlTransfer;
+
+/** State of the lr_curl_multi_download */
+struct _lr_CurlMulti {
+    lr_Handle handle;           /*!< librepo handle */
+    CURLM *cm_h;                /*!< curl multi handle */
+    lr_CurlTransfer transfers;  /*!< transfers - one per target */
+    int not;                    /*!< number of transfers */
+    char **mirrors;             /*!< mirrors from the internal mirrorlist
+                                     followed by base urls of targets */
+    int nom;                    /*!< number of mirrors */
+    int *mirror_running;        /*!< number of running transfers per mirror */
+    int running;                /*!< number of running transfers */
+    int failed_downloads;       /*!< number of targets which failed */
+    int last_ret;               /*!< last error of a failed target */
+    long last_code;             /*!< last bad HTTP or FTP status code */
+};
+typedef struct _lr_CurlMulti * lr_CurlMulti;
+
+/** Free the write buffer and the curl handle of the transfer */
+static void
+lr_curl_transfer_close(CURLM *cm_h, lr_CurlTransfer transfer)
+{
+    lr_writedata_clear(&transfer->wdata);
+    lr_checksumctx_free(transfer->wdata.checksum);
+    transfer->wdata.checksum = NULL;
+    if (transfer->curl_handle) {
+        curl_multi_remove_handle(cm_h, transfer->curl_handle);
+        curl_easy_cleanup(transfer->curl_handle);
+        transfer->curl_handle = NULL;
+    }
+    if (transfer->fd_opened) {
+        close(transfer->target->fd);
+        transfer->target->fd = -1;
+        transfer->fd_opened = 0;
+    }
+}
+
+/** Open the target file if the target is specified by its filename.
+ * The file is opened only for the time of the download.
+ */
+static int
+lr_curl_transfer_open(lr_CurlTransfer transfer)
+{
+    int flags = O_CREAT|O_RDWR;
+    lr_CurlTarget t = transfer->target;
+
+    if (!t->fn || t->in_memory)
+        return LRE_OK;
+
+    if (!transfer->resume)
+        flags |= O_TRUNC;
+
+    t->fd = open(t->fn, flags, 0660);
+    if (t->fd < 0) {
+        DPRINTF("%s: open(\"%s\"): %s\n", __func__, t->fn, strerror(errno));
+        return LRE_IO;
+    }
+    transfer->fd_opened = 1;
+
+    return LRE_OK;
+}
+
+/** Start download of the transfer from the mirror */
+static int
+lr_curl_transfer_start(lr_Handle handle,
+                       CURLM *cm_h,
+                       lr_CurlTransfer transfer,
+                       const char *mirror)
+{
+    char *url;
+    CURL *c_h;
+    CURLcode c_rc;
+    CURLMcode cm_rc;
+    lr_CurlTarget t = transfer->target;
+
+    c_h = lr_curl_duphandle(handle);
+    if (!c_h) {
+        DPRINTF("%s: Cannot dup CURL handle\n", __func__);
+        return LRE_CURLDUP;
+    }
+    transfer->curl_handle = c_h;
+
+    transfer->offset = 0;
+    if (t->in_memory) {
+        /* Data are collected in the memory, nothing to resume */
+        lr_free(t->data);
+        t->data = NULL;
+        t->data_len = 0;
+    } else if (transfer->resume) {
+        /* Continue after the already downloaded data */
+        off_t end = lseek(t->fd, 0, SEEK_END);
+        if (end > 0)
+            transfer->offset = (long long) end;
+    } else {
+        lseek(t->fd, 0, SEEK_SET);
+        ftruncate(t->fd, 0);
+    }
+
+    /* Checksum is calculated during the download */
+    if (handle->checks & LR_CHECK_CHECKSUM && t->checksum) {
+        int rc = lr_curl_checksum_start(t->checksum_type, t->fd,
+                                        transfer->offset,
+                                        &transfer->wdata.checksum);
+        if (rc != LRE_OK)
+            return rc;
+    }
+
+    lr_writedata_init(&transfer->wdata, (t->in_memory) ? -1 : t->fd,
+                      handle->writebuffersize);
+    lr_writedata_expect(&transfer->wdata, t->expected_size, transfer->offset,
+                        transfer->wdata.checksum != NULL);
+
+    url = lr_pathconcat(mirror, t->path, NULL);
+    DPRINTF("%s: %s\n", __func__, url);
+
+    c_rc = curl_easy_setopt(c_h, CURLOPT_URL, url);
+    lr_free(url);
+    if (c_rc != CURLE_OK) {
+        handle->last_curl_error = c_rc;
+        DPRINTF("%s: Cannot set CURLOPT_URL\n", __func__);
+        return LRE_CURLDUP;
+    }
+
+    curl_easy_setopt(c_h, CURLOPT_WRITEFUNCTION, lr_write_func);
+    c_rc = curl_easy_setopt(c_h, CURLOPT_WRITEDATA, &transfer->wdata);
+    if (c_rc != CURLE_OK) {
+        handle->last_curl_error = c_rc;
+        DPRINTF("%s: Cannot set CURLOPT_WRITEDATA\n", __func__);
+        return LRE_CURLDUP;
+    }
+    curl_easy_setopt(c_h, CURLOPT_HEADERFUNCTION, lr_header_func);
+    curl_easy_setopt(c_h, CURLOPT_HEADERDATA, &transfer->wdata);
+
+    if (transfer->offset) {
+        DPRINTF("%s: download resume offset: %lld\n", __func__, transfer->offset);
+        c_rc = curl_easy_setopt(c_h, CURLOPT_RESUME_FROM_LARGE,
+                                (curl_off_t) transfer->offset);
+        if (c_rc != CURLE_OK) {
+            handle->last_curl_error = c_rc;
+            DPRINTF("%s: Cannot set CURLOPT_RESUME_FROM_LARGE\n", __func__);
+            return LRE_CURL;
+        }
+    }
+
+    /* Used to find the transfer when curl reports its end */
+    curl_easy_setopt(c_h, CURLOPT_PRIVATE, transfer);
+
+    /* Prepare callback and its data */
+    if (handle->user_cb) {
+        lr_CallbackData data = &transfer->cb_data;
+        data->downloaded = 0.0;
+        curl_easy_setopt(c_h, CURLOPT_PROGRESSFUNCTION, lr_progress_func);
+        curl_easy_setopt(c_h, CURLOPT_NOPROGRESS, 0);
+        curl_easy_setopt(c_h, CURLOPT_PROGRESSDATA, data);
+    }
+
+    cm_rc = curl_multi_add_handle(cm_h, c_h);
+    if (cm_rc != CURLM_OK) {
+        handle->last_curlm_error = cm_rc;
+        DPRINTF("%s: Cannot add curl_easy hadle to multi handle\n", __func__);
+        return LRE_CURLM;
+    }
+
+    return LRE_OK;
+}
+
+/** Check result of the finished transfer.
+ * @return          LRE_OK if the target was successfully downloaded,
+ *                  other ::lr_Rc otherwise.
+ */
+static int
+lr_curl_transfer_check(lr_Handle handle,
+                       lr_CurlTransfer transfer,
+                       CURLcode result,
+                       long *code)
+{
+    lr_CurlTarget t = transfer->target;
+
+    *code = 0;
+
+    DPRINTF("%s: Download status: %d (%s)\n", __func__, result, t->path);
+
+    /* Write rest of the buffered data */
+    if (lr_writedata_flush(&transfer->wdata)) {
+        DPRINTF("%s: Cannot write data: %s\n",
+                __func__, strerror(transfer->wdata.error));
+        return LRE_IO;
+    }
+
+    if (transfer->wdata.bad_size) {
+        /* The file cannot match the checksum */
+        DPRINTF("%s: %s has unexpected size\n", __func__, t->path);
+        if (!t->optional)
+            handle->last_curl_error = CURLE_FILESIZE_EXCEEDED;
+        return LRE_BADCHECKSUM;
+    }
+
+    if (result != CURLE_OK) {
+        if (!t->optional)
+            handle->last_curl_error = result;
+        return LRE_CURL;
+    }
+
+    curl_easy_getinfo(transfer->curl_handle, CURLINFO_RESPONSE_CODE, code);
+    if (*code && (*code != 200 && *code != 226)
+        && !(transfer->offset && *code == 206))
+    {
+        DPRINTF("%s: Bad HTTP/FTP code: %ld\n", __func__, *code);
+        return LRE_BADSTATUS;
+    }
+    *code = 0;
+
+    /* Check checksum calculated during the download */
+    if (transfer->wdata.checksum) {
+        int rc;
+
+        DPRINTF("%s: Checking checksum\n", __func__);
+        rc = lr_curl_checksum_check(handle,
+                                    transfer->wdata.checksum,
+                                    t->checksum_type,
+                                    t->checksum,
+                                    (t->in_memory) ? -1 : t->fd);
+        if (rc != LRE_OK)
+            return rc;
+    }
+
+    /* Consumer of the data (e.g. a decompressor) may reject them too */
+    if (t->data_end_cb) {
+        int rc = t->data_end_cb(t->data_cb_data);
+        if (rc != LRE_OK) {
+            DPRINTF("%s: Data of %s were rejected: %s\n",
+                    __func__, t->path, lr_strerror(rc));
+            return rc;
+        }
+    }
+
+    return LRE_OK;
+}
+
+/** Mark the transfer as finally failed. Failure of an optional
+ * target is recorded only in the target. */
+static void
+lr_curl_multi_target_failed(lr_CurlMulti m,
+                            lr_CurlTransfer transfer,
+                            int rc,
+                            long code)
+{
+    DPRINTF("%s: Cannot download %s (%d: %s)\n", __func__,
+            transfer->target->path, rc, lr_strerror(rc));
+    transfer->target->rc = rc;
+    transfer->queued = 0;
+    if (transfer->target->optional)
+        return;
+    m->failed_downloads++;
+    m->last_ret = rc;
+    if (code)
+        m->last_code = code;
+}
+
+/** Start queued transfers while there are free download slots.
+ * A transfer is started only if the total number of running transfers
+ * and the number of transfers running from its mirror are both under
+ * the limits set by LRO_MAXPARALLELDOWNLOADS and
+ * LRO_MAXDOWNLOADSPERMIRROR. Transfers which cannot be started stay
+ * queued until some other transfer finishes.
+ */
+static int
+lr_curl_multi_start_queued(lr_CurlMulti m)
+{
+    lr_Handle handle = m->handle;
+
+    for (int x = 0; x < m->not; x++) {
+        int rc;
+        lr_CurlTransfer transfer = &m->transfers[x];
+
+        if (m->running >= handle->maxparalleldownloads)
+            break;  /* No free slot */
+
+        if (!transfer->queued)
+            continue;
+
+        if (transfer->mirror >= transfer->mirror_end) {
+            /* No mirror to download the target from */
+            lr_curl_multi_target_failed(m, transfer, LRE_NOURL, 0);
+            continue;
+        }
+
+        if (m->mirror_running[transfer->mirror] >= handle->maxdownloadspermirror)
+            continue;  /* Mirror is busy, wait for a free slot */
+
+        DPRINTF("%s: Starting %s from mirror %s\n", __func__,
+                transfer->target->path, m->mirrors[transfer->mirror]);
+        transfer->queued = 0;
+        rc = lr_curl_transfer_open(transfer);
+        if (rc != LRE_OK) {
+            /* Target file cannot be opened, other targets could continue */
+            lr_curl_multi_target_failed(m, transfer, rc, 0);
+            continue;
+        }
+        rc = lr_curl_transfer_start(handle, m->cm_h, transfer,
+                                    m->mirrors[transfer->mirror]);
+        if (rc != LRE_OK)
+            return rc;
+        m->mirror_running[transfer->mirror]++;
+        m->running++;
+    }
+
+    return LRE_OK;
+}
+
+/** Process the finished transfer. Failed transfer is queued
+ * again to be downloaded from the next mirror (if any).
+ */
+static void
+lr_curl_multi_transfer_done(lr_CurlMulti m,
+                            lr_CurlTransfer transfer,
+                            CURLcode result)
+{
+    int rc;
+    long code;
+
+    lr_CurlTarget t = transfer->target;
+
+    rc = lr_curl_transfer_check(m->handle, transfer, result, &code);
+    if (rc == LRE_OK || !t->optional)
+        lr_curl_mirror_note(lr_internalmirrorlist_get(m->handle->internal_mirrorlist,
+                                                      transfer->mirror),
+                            rc, transfer->curl_handle);
+    if (t->in_memory) {
+        /* Hand over the collected data, failed data are discarded
+         * by lr_curl_transfer_close */
+        if (rc == LRE_OK)
+            t->data = lr_writedata_steal_mem(&transfer->wdata, &t->data_len);
+    } else if (rc != LRE_OK) {
+        /* Discard the downloaded data */
+        lseek(t->fd, 0, SEEK_SET);
+        ftruncate(t->fd, 0);
+    }
+    lr_curl_transfer_close(m->cm_h, transfer);
+    m->mirror_running[transfer->mirror]--;
+    m->running--;
+
+    if (rc == LRE_OK) {
+        /* Succeeded */
+        transfer->target->downloaded = 1;
+        transfer->target->rc = LRE_OK;
+        return;
+    }
+
+    /* Failed - try the next mirror only for this target,
+     * the other transfers still continue */
+    /* Update total_to_download in callback data */
+    transfer->cb_data.scb_data->counted[transfer->cb_data.id] = 0;
+
+    if (rc == LRE_IO) {
+        /* Local error (e.g. ENOSPC) - other mirrors do not help */
+        lr_curl_multi_target_failed(m, transfer, rc, code);
+        return;
+    }
+
+    /* Already downloaded data were discarded, no resume anymore */
+    transfer->resume = 0;
+    if (transfer->offset) {
+        /* Resume could be the culprit - try the same mirror again,
+         * but this time download the whole file */
+        DPRINTF("%s: Resume of %s failed - downloading the whole file\n",
+                __func__, transfer->target->path);
+        transfer->offset = 0;
+    } else {
+        transfer->mirror++;
+    }
+
+    if (transfer->mirror >= transfer->mirror_end) {
+        /* No more mirrors to try */
+        lr_curl_multi_target_failed(m, transfer, rc, code);
+        return;
+    }
+
+    /* Queue the target again, it will be started
+     * from the next mirror as soon as there is a free slot */
+    transfer->queued = 1;
+}
+
+/** Return index of the url in the list of mirrors. If the url is not
+ * in the list, it is appended. */
+static int
+lr_curl_multi_mirror_index(lr_CurlMulti m, char *url)
+{
+    for (int x = 0; x < m->nom; x++)
+        if (!strcmp(m->mirrors[x], url))
+            return x;
+    m->mirrors[m->nom] = url;
+    return m->nom++;
+}
+
+int
+lr_curl_multi_download(lr_Handle handle, lr_CurlTargetList targets)
+{
+    int not = lr_curltargetlist_len(targets);  /* Number Of Targets */
+    int nom = 0;        /* Number Of Mirrors in the internal mirrorlist */
+    int ret = LRE_OK;
+    CURLMcode cm_rc;
+    struct _lr_CurlMulti multi;
+    lr_CurlMulti m = &multi;
+    struct _lr_EventLoop loop = { NULL, -1, -1, 0 };
+    lr_InternalMirrorlist iml;
+
+    struct _lr_SharedCallbackData shared_cb_data;
 
     assert(handle);
 
     iml = handle->internal_mirrorlist;
-    if (!iml)
-        return LRE_NOURL;
-
-    nom = lr_internalmirrorlist_len(iml);
-    if (nom < 1)
-        return LRE_NOURL;
+    if (iml)
+        nom = lr_internalmirrorlist_len(iml);
 
     if (not == 0) {
         /* Maybe user callback shoud be called here */
@@ -426,267 +1775,768 @@ lr_curl_multi_download(lr_Handle handle, lr_CurlTargetList targets)
     shared_cb_data.cb = handle->user_cb;
     shared_cb_data.user_data = handle->user_data;
 
+    /* Initialize state of the download */
+    memset(m, 0, sizeof(struct _lr_CurlMulti));
+    m->handle = handle;
+    m->not = not;
+    m->last_ret = LRE_OK;
+    m->mirrors = lr_malloc0(sizeof(char *) * (nom + not));
+    for (int x = 0; x < nom; x++)
+        m->mirrors[x] = lr_internalmirrorlist_get_url(iml, x);
+    m->nom = nom;
+
+    /* Initialize transfers - queue every target (file) which
+     * haven't been already downloaded */
+    m->transfers = lr_malloc0(sizeof(struct _lr_CurlTransfer) * not);
+    for (int x = 0; x < not; x++) {
+        lr_CurlTransfer transfer = &m->transfers[x];
+        transfer->target = lr_curltargetlist_get(targets, x);
+        if (transfer->target->base_url) {
+            /* Target has its own url - mirrors are not used */
+            transfer->mirror = lr_curl_multi_mirror_index(m,
+                                                transfer->target->base_url);
+            transfer->mirror_end = transfer->mirror + 1;
+        } else {
+            transfer->mirror = 0;
+            transfer->mirror_end = nom;
+        }
+        transfer->queued = !transfer->target->downloaded;
+        transfer->resume = transfer->target->resume;
+        transfer->target->rc = LRE_OK;
+        transfer->wdata.data_cb = transfer->target->data_cb;
+        transfer->wdata.data_cb_data = transfer->target->data_cb_data;
+        transfer->cb_data.id = x;
+        transfer->cb_data.scb_data = &shared_cb_data;
+    }
+    m->mirror_running = lr_malloc0(sizeof(int) * (nom + not));
+
     /* --- Since here it shoud be safe to use "goto cleanup" --- */
 
-    for (int i = 0; i < nom; i++) {
-        int used = 0;
-        char *mirror = lr_internalmirrorlist_get_url(iml, i);
-        int still_running;  /* Number of still running downloads */
+    m->cm_h = curl_multi_init();
+    if (!m->cm_h) {
+        ret = LRE_CURLDUP;
+        goto cleanup;
+    }
+
+    ret = lr_eventloop_init(&loop, m->cm_h);
+    if (ret != LRE_OK)
+        goto cleanup;
+
+    /* Start as many transfers as the limits allow */
+    DPRINTF("%s: CURL multi handle targets:\n", __func__);
+    ret = lr_curl_multi_start_queued(m);
+    if (ret != LRE_OK)
+        goto cleanup;
+
+    if (m->running == 0) {
+        DPRINTF("%s: Nothing to download\n", __func__);
+        goto cleanup;  /* Nothing to download */
+    }
+
+    /* Perform */
+    DPRINTF("%s: Running event loop\n", __func__);
+    cm_rc = lr_eventloop_start(&loop);
+
+    while (cm_rc == CURLM_OK) {
         CURLMsg *msg;  /* for picking up messages with the transfer status */
         int msgs_left; /* how many messages are left */
 
-        DPRINTF("%s: Using mirror %s\n", __func__, mirror);
+        /* Check statuses of finished transfers */
+        while ((msg = curl_multi_info_read(m->cm_h, &msgs_left))) {
+            lr_CurlTransfer transfer = NULL;
+
+            if (msg->msg != CURLMSG_DONE)
+                continue;
+
+            /* Find out which transfer this message is about */
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **) &transfer);
+            assert(transfer);
+            /* msg is invalid after handle removal */
+            lr_curl_multi_transfer_done(m, transfer, msg->data.result);
+        }
+
+        /* Freed slots could be used by queued transfers */
+        ret = lr_curl_multi_start_queued(m);
+        if (ret != LRE_OK)
+            goto cleanup;
 
-        failed_downloads = 0;
+        if (m->running == 0)
+            break;  /* All transfers are finished */
+
+        cm_rc = lr_eventloop_wait(&loop);
+    }
+
+    if (cm_rc != CURLM_OK) {
+        DPRINTF("%s: Event loop error: %d\n", __func__, cm_rc);
+        handle->last_curlm_error = cm_rc;
+        ret = LRE_CURLM;
+    }
+
+cleanup:
+    DPRINTF("%s: Cleanup\n", __func__);
+
+    if (ret == LRE_OK && m->failed_downloads != 0) {
+        /* At least one file cannot be downloaded from any mirror */
+        if (m->last_ret != LRE_OK)
+            ret = m->last_ret;
+        if (m->last_code != 0)
+            handle->status_code = m->last_code;
+    }
+
+    for (int x = 0; x < not; x++)
+        lr_curl_transfer_close(m->cm_h, &m->transfers[x]);
+    lr_eventloop_cleanup(&loop);
+    lr_curl_mirrorstats_save(handle);
+    if (m->cm_h)
+        curl_multi_cleanup(m->cm_h);
+    lr_free(m->transfers);
+    lr_free(m->mirrors);
+    lr_free(m->mirror_running);
+    lr_free(shared_cb_data.counted);
+
+    return ret;
+}
+
+/* Mirror probe stuff */
+
+#define LR_MIRRORPROBE_SIZE     65536   /* Max bytes received from a mirror */
+#define LR_MIRRORPROBE_REFSIZE  1048576 /* Size of the file used for
+                                           the download time estimation */
+
+/** Probe of a single mirror */
+struct _lr_MirrorProbe {
+    CURL *curl_handle;          /*!< curl handle of the probe or NULL */
+    lr_InternalMirror mirror;   /*!< Probed mirror */
+    size_t received;            /*!< Number of received bytes */
+};
+typedef struct _lr_MirrorProbe * lr_MirrorProbe;
+
+/** CURLOPT_WRITEFUNCTION of the probe - data are only counted */
+static size_t
+lr_mirrorprobe_write_func(void *ptr, size_t size, size_t nmemb, void *userdata)
+{
+    lr_MirrorProbe probe = userdata;
 
-        cm_h = curl_multi_init();
-        if (!cm_h) {
+    LR_UNUSED(ptr);
+
+    probe->received += size * nmemb;
+    if (probe->received > LR_MIRRORPROBE_SIZE)
+        return 0;  /* Server ignored the range - we have enough data */
+    return size * nmemb;
+}
+
+/** Calculate probe_time of the mirror from the finished probe */
+static void
+lr_mirrorprobe_evaluate(lr_MirrorProbe probe, CURLcode c_rc)
+{
+    double connect = 0.0, ttfb = 0.0, total = 0.0;
+    double estimate;
+
+    if (c_rc != CURLE_OK
+        && !(c_rc == CURLE_WRITE_ERROR
+             && probe->received > LR_MIRRORPROBE_SIZE))
+    {
+        DPRINTF("%s: %s: %s\n", __func__, probe->mirror->url,
+                curl_easy_strerror(c_rc));
+        return;
+    }
+
+    curl_easy_getinfo(probe->curl_handle, CURLINFO_CONNECT_TIME, &connect);
+    curl_easy_getinfo(probe->curl_handle, CURLINFO_STARTTRANSFER_TIME, &ttfb);
+    curl_easy_getinfo(probe->curl_handle, CURLINFO_TOTAL_TIME, &total);
+
+    /* Estimate how long it takes to download a reference file:
+     * time to the first byte + time of the data transfer itself
+     * at the measured throughput */
+    estimate = ttfb;
+    if (probe->received > 0 && total > ttfb)
+        estimate += (total - ttfb) * LR_MIRRORPROBE_REFSIZE / probe->received;
+
+    probe->mirror->probe_time = estimate;
+    DPRINTF("%s: %s: connect %.3fs, ttfb %.3fs, %zu bytes in %.3fs "
+            "(estimate %.3fs)\n", __func__, probe->mirror->url, connect,
+            ttfb, probe->received, total, estimate);
+}
+
+int
+lr_curl_probe_mirrors(lr_Handle handle,
+                      const char *path,
+                      int count,
+                      long timeout_ms)
+{
+    int ret = LRE_OK;
+    int nop;
+    int msgs_left;
+    char range[32];
+    CURLM *cm_h;
+    CURLMcode cm_rc;
+    CURLMsg *msg;
+    lr_MirrorProbe probes;
+    struct _lr_EventLoop loop;
+    lr_InternalMirrorlist iml;
+
+    assert(handle);
+
+    iml = handle->internal_mirrorlist;
+    if (!iml || count < 1 || timeout_ms < 1)
+        return LRE_BADFUNCARG;
+
+    nop = lr_internalmirrorlist_len(iml);
+    if (nop > count)
+        nop = count;
+    if (nop < 1)
+        return LRE_OK;
+
+    cm_h = curl_multi_init();
+    if (!cm_h)
+        return LRE_CURLM;
+
+    if (lr_eventloop_init(&loop, cm_h) != LRE_OK) {
+        curl_multi_cleanup(cm_h);
+        return LRE_CURLM;
+    }
+
+    snprintf(range, sizeof(range), "0-%d", LR_MIRRORPROBE_SIZE - 1);
+    probes = lr_malloc0(nop * sizeof(struct _lr_MirrorProbe));
+
+    /* All mirrors are probed in parallel. The time budget is enforced
+     * by curl itself - every probe is aborted when it expires. */
+    for (int x = 0; x < nop; x++) {
+        char *url;
+        CURL *c_h;
+        lr_MirrorProbe probe = &probes[x];
+
+        probe->mirror = lr_internalmirrorlist_get(iml, x);
+        probe->mirror->probe_time = -1.0;
+
+        c_h = lr_curl_duphandle(handle);
+        if (!c_h) {
+            DPRINTF("%s: curl_easy_duphandle() call failed\n", __func__);
             ret = LRE_CURLDUP;
             goto cleanup;
         }
+        probe->curl_handle = c_h;
+
+        url = lr_pathconcat(probe->mirror->url, path, NULL);
+        DPRINTF("%s: Probing %s\n", __func__, url);
+        curl_easy_setopt(c_h, CURLOPT_URL, url);
+        lr_free(url);
+        curl_easy_setopt(c_h, CURLOPT_RANGE, range);
+        curl_easy_setopt(c_h, CURLOPT_FAILONERROR, 1);
+        curl_easy_setopt(c_h, CURLOPT_NOPROGRESS, 1);
+        curl_easy_setopt(c_h, CURLOPT_TIMEOUT_MS, timeout_ms);
+        curl_easy_setopt(c_h, CURLOPT_WRITEFUNCTION, lr_mirrorprobe_write_func);
+        curl_easy_setopt(c_h, CURLOPT_WRITEDATA, probe);
+        curl_easy_setopt(c_h, CURLOPT_PRIVATE, probe);
+
+        cm_rc = curl_multi_add_handle(cm_h, c_h);
+        if (cm_rc != CURLM_OK) {
+            DPRINTF("%s: curl_multi_add_handle: %s\n", __func__,
+                    curl_multi_strerror(cm_rc));
+            handle->last_curlm_error = cm_rc;
+            ret = LRE_CURLM;
+            goto cleanup;
+        }
+    }
 
-        DPRINTF("%s: CURL multi handle targets:\n", __func__);
-        for (int x = 0; x < not; x++) {
-            /*  Prepare curl_easy_handlers for every target (file) which
-             *  haven't been already downloaded */
-            FILE *f;
-            char *url;
-            CURL *c_h;
-            CURLcode c_rc;
-            lr_CurlTarget t = lr_curltargetlist_get(targets, x);
+    cm_rc = lr_eventloop_run(&loop);
+    if (cm_rc != CURLM_OK) {
+        DPRINTF("%s: Event loop error: %d\n", __func__, cm_rc);
+        handle->last_curlm_error = cm_rc;
+        ret = LRE_CURLM;
+        goto cleanup;
+    }
 
-            curl_easy_interfaces[x] = NULL;
-            open_files[x] = NULL;
+    while ((msg = curl_multi_info_read(cm_h, &msgs_left))) {
+        lr_MirrorProbe probe = NULL;
 
-            if (t->downloaded)
-                /* Already downloaded */
-                continue;
+        if (msg->msg != CURLMSG_DONE)
+            continue;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **) &probe);
+        lr_mirrorprobe_evaluate(probe, msg->data.result);
+    }
 
-            c_h = curl_easy_duphandle(handle->curl_handle);
-            if (!c_h) {
-                ret = LRE_CURLDUP;
-                DPRINTF("%s: Cannot dup CURL handle\n", __func__);
-                goto cleanup;
-            }
-            curl_easy_interfaces[x] = c_h;
-
-            lseek(t->fd, 0, SEEK_SET);
-            ftruncate(t->fd, 0);
-            f = fdopen(dup(t->fd), "w");
-            if (!f) {
-                ret = LRE_IO;
-                DPRINTF("%s: Cannot dup fd %d\n", __func__, t->fd);
-                goto cleanup;
-            }
-            open_files[x] = f;
+    lr_internalmirrorlist_sort_by_probe(iml);
 
-            url = lr_pathconcat(mirror, t->path, NULL);
-            DPRINTF("%s:  %s\n", __func__, url);
+cleanup:
+    for (int x = 0; x < nop; x++) {
+        if (!probes[x].curl_handle)
+            continue;
+        curl_multi_remove_handle(cm_h, probes[x].curl_handle);
+        curl_easy_cleanup(probes[x].curl_handle);
+    }
+    lr_free(probes);
+    lr_eventloop_cleanup(&loop);
+    curl_multi_cleanup(cm_h);
 
-            c_rc = curl_easy_setopt(c_h, CURLOPT_URL, url);
-            lr_free(url);
-            if (c_rc != CURLE_OK) {
-                handle->last_curl_error = c_rc;
-                ret = LRE_CURLDUP;
-                DPRINTF("%s: Cannot set CURLOPT_URL\n", __func__);
-                goto cleanup;
-            }
+    return ret;
+}
 
-            c_rc = curl_easy_setopt(c_h, CURLOPT_WRITEDATA, f);
-            if (c_rc != CURLE_OK) {
-                handle->last_curl_error = c_rc;
-                ret = LRE_CURLDUP;
-                DPRINTF("%s: Cannot set CURLOPT_WRITEDATA\n", __func__);
-                goto cleanup;
-            }
+/* Segmented download stuff */
+
+/** A byte range of the file downloaded by lr_curl_segmented_download */
+struct _lr_CurlSegment {
+    long long start;        /*!< first byte of the segment */
+    long long end;          /*!< byte behind the segment */
+    long long pos;          /*!< offset of the next received data */
+    int fd;                 /*!< descriptor of the whole file */
+    int mirror;             /*!< index of the currently used mirror */
+    int tries;              /*!< number of already tried mirrors */
+    int checked;            /*!< response of the transfer was checked */
+    int norange;            /*!< server ignored the range request */
+    int badrange;           /*!< Content-Range doesn't match the request */
+    int range_ok;           /*!< valid Content-Range was received */
+    long long size;         /*!< expected size of the whole file */
+    int error;              /*!< errno of the failed write or 0 */
+    CURL *curl_handle;      /*!< curl handle of the running transfer */
+    struct _lr_CallbackData cb_data; /*!< progress callback data */
+};
+typedef struct _lr_CurlSegment * lr_CurlSegment;
 
-            /* Prepare callback and its data */
-            if (handle->user_cb) {
-                lr_CallbackData data = &cb_data[x];
-                data->id = x;
-                data->downloaded = 0.0;
-                data->scb_data = &shared_cb_data;
-                c_rc = curl_easy_setopt(c_h, CURLOPT_PROGRESSFUNCTION, lr_progress_func);
-                c_rc = curl_easy_setopt(c_h, CURLOPT_NOPROGRESS, 0);
-                c_rc = curl_easy_setopt(c_h, CURLOPT_PROGRESSDATA, data);
-            }
+/** CURLOPT_HEADERFUNCTION of a segment - the Content-Range of the response
+ * must exactly match the requested range and the total size of the file.
+ * A mirror with a different version of the file is rejected by this. */
+static size_t
+lr_segment_header_func(void *ptr, size_t size, size_t nmemb, void *userdata)
+{
+    size_t len = size * nmemb;
+    lr_CurlSegment seg = userdata;
+    char header[256];
+    long long start, end, total;
+
+    if (len >= sizeof(header))
+        return len;
+    memcpy(header, ptr, len);
+    header[len] = '\0';
+
+    if (!strncmp(header, "HTTP/", 5)) {
+        /* Status line of a new response (e.g. after a redirect) */
+        seg->range_ok = 0;
+        seg->badrange = 0;
+        return len;
+    }
 
-            cm_rc = curl_multi_add_handle(cm_h, c_h);
-            if (cm_rc != CURLM_OK) {
-                handle->last_curlm_error = cm_rc;
-                ret = LRE_CURLM;
-                DPRINTF("%s: Cannot add curl_easy hadle to multi handle\n", __func__);
-                goto cleanup;
-            }
-            used++;
+    if (strncasecmp(header, "Content-Range:", 14))
+        return len;
+
+    if (sscanf(header + 14, " bytes %lld-%lld/%lld", &start, &end, &total) != 3
+        || start != seg->pos || end != seg->end - 1 || total != seg->size) {
+        DPRINTF("%s: Unexpected %.*s (requested %lld-%lld/%lld)\n", __func__,
+                (int) strcspn(header, "\r\n"), header,
+                seg->pos, seg->end - 1, seg->size);
+        seg->badrange = 1;
+        return len;
+    }
+
+    seg->range_ok = 1;
+    return len;
+}
+
+/** CURLOPT_WRITEFUNCTION of a segment - data are written by pwrite()
+ * to the segment's part of the file */
+static size_t
+lr_segment_write_func(void *ptr, size_t size, size_t nmemb, void *userdata)
+{
+    size_t len = size * nmemb;
+    size_t written = 0;
+    lr_CurlSegment seg = userdata;
+
+    if (!seg->checked) {
+        long code = 0;
+        curl_easy_getinfo(seg->curl_handle, CURLINFO_RESPONSE_CODE, &code);
+        if (code == 200) {
+            /* HTTP server sends the whole file instead of the range */
+            seg->norange = 1;
+            return 0;
+        }
+        if (seg->badrange || (code == 206 && !seg->range_ok)) {
+            /* HTTP server sends other range or other file */
+            seg->badrange = 1;
+            return 0;
         }
+        seg->checked = 1;
+    }
+
+    if (seg->pos + (long long) len > seg->end) {
+        DPRINTF("%s: Server sent more data than requested\n", __func__);
+        seg->norange = 1;
+        return 0;
+    }
 
-        if (used == 0) {
-            DPRINTF("%s: All files were downloaded\n", __func__);
-            break;  /* Nothing to download */
+    while (written < len) {
+        ssize_t ret = pwrite(seg->fd, (char *) ptr + written, len - written,
+                             seg->pos + written);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            seg->error = errno;
+            return 0;
         }
+        written += ret;
+    }
 
-        /* Perform */
-        DPRINTF("%s: curl_multi_perform\n", __func__);
-        curl_multi_perform(cm_h, &still_running);
+    seg->pos += len;
+    return len;
+}
 
-        do {
-            int rc;
-            int maxfd = -1;
-            long curl_timeo = -1;
-            fd_set fdread;
-            fd_set fdwrite;
-            fd_set fdexcep;
-            struct timeval timeout;
-
-            FD_ZERO(&fdread);
-            FD_ZERO(&fdwrite);
-            FD_ZERO(&fdexcep);
-
-            /* Set timeout */
-            timeout.tv_sec = 1;
-            timeout.tv_usec = 0;
-
-            curl_multi_timeout(cm_h, &curl_timeo);
-            if (curl_timeo >= 0) {
-                timeout.tv_sec = curl_timeo / 1000;
-                if (timeout.tv_sec > 1)
-                    timeout.tv_sec = 1;
-                else
-                    timeout.tv_usec = (curl_timeo % 1000) * 1000;
-            }
+/** Get size of the remote file by a HEAD request.
+ * @return              Size of the file or -1 if it is not known.
+ */
+static long long
+lr_curl_remote_size(lr_Handle handle, const char *url)
+{
+    CURL *c_h;
+    CURLcode c_rc;
+    long long size = -1;
+
+    c_h = lr_curl_duphandle(handle);
+    if (!c_h)
+        return -1;
+
+    curl_easy_setopt(c_h, CURLOPT_URL, url);
+    curl_easy_setopt(c_h, CURLOPT_NOBODY, 1);
+    curl_easy_setopt(c_h, CURLOPT_FAILONERROR, 1);
+
+    c_rc = lr_curl_easy_perform(handle, c_h);
+    if (c_rc == CURLE_OK) {
+#if LIBCURL_VERSION_NUM >= 0x073700
+        curl_off_t length = -1;
+        curl_easy_getinfo(c_h, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+#else
+        double length = -1.0;
+        curl_easy_getinfo(c_h, CURLINFO_CONTENT_LENGTH_DOWNLOAD, &length);
+#endif
+        size = (long long) length;
+    } else {
+        DPRINTF("%s: %s: %s\n", __func__, url, curl_easy_strerror(c_rc));
+    }
 
-            /* Get filedescriptors from the transfers */
-            cm_rc = curl_multi_fdset(cm_h, &fdread, &fdwrite, &fdexcep, &maxfd);
-            if (cm_rc != CURLM_OK) {
-                DPRINTF("%s: curl_multi_fdset() error: %d\n", __func__, cm_rc);
-                handle->last_curlm_error = cm_rc;
-                ret = LRE_CURLM;
-                goto cleanup;
-            }
+    curl_easy_cleanup(c_h);
+    return size;
+}
 
-            rc = select(maxfd+1, &fdread, &fdwrite, &fdexcep, &timeout);
+/** Start download of the rest of the segment from its current mirror */
+static int
+lr_curl_segment_start(lr_Handle handle,
+                      CURLM *cm_h,
+                      lr_CurlSegment seg,
+                      const char *path)
+{
+    char *url;
+    char range[64];
+    CURL *c_h;
+    CURLMcode cm_rc;
 
-            switch (rc) {
-            case -1:
-                break; /* select() error */
+    c_h = lr_curl_duphandle(handle);
+    if (!c_h) {
+        DPRINTF("%s: curl_easy_duphandle() call failed\n", __func__);
+        return LRE_CURLDUP;
+    }
 
-            case 0:
-            default:
-                /* Timeout or readable/writeable sockets */
-                curl_multi_perform(cm_h, &still_running);
-                break;
-            }
-        } while (still_running);
-
-        /* Close opened files */
-        /* Closing must be here! In the next code, if download failed
-         * we truncate the download file descriptor. Truncation doesn't take
-         * the effect if we truncate the file descriptor first and after that
-         * we close the FILE* stream (opened from that file descriptor).
-         * In short: FILE* stream must be closed first. */
-        for (int x = 0; x < not; x++) {
-            if (open_files[x]) {
-                fclose(open_files[x]);
-                open_files[x] = NULL;
-            }
-        }
+    url = lr_pathconcat(lr_internalmirrorlist_get_url(
+                                handle->internal_mirrorlist, seg->mirror),
+                        path, NULL);
+    snprintf(range, sizeof(range), "%lld-%lld", seg->pos, seg->end - 1);
+    DPRINTF("%s: %s (%s)\n", __func__, url, range);
+
+    curl_easy_setopt(c_h, CURLOPT_URL, url);
+    lr_free(url);
+    curl_easy_setopt(c_h, CURLOPT_RANGE, range);
+    curl_easy_setopt(c_h, CURLOPT_FAILONERROR, 1);
+    curl_easy_setopt(c_h, CURLOPT_WRITEFUNCTION, lr_segment_write_func);
+    curl_easy_setopt(c_h, CURLOPT_WRITEDATA, seg);
+    curl_easy_setopt(c_h, CURLOPT_HEADERFUNCTION, lr_segment_header_func);
+    curl_easy_setopt(c_h, CURLOPT_HEADERDATA, seg);
+    curl_easy_setopt(c_h, CURLOPT_PRIVATE, seg);
+    if (handle->user_cb) {
+        seg->cb_data.downloaded = 0;
+        curl_easy_setopt(c_h, CURLOPT_PROGRESSFUNCTION, lr_progress_func);
+        curl_easy_setopt(c_h, CURLOPT_NOPROGRESS, 0);
+        curl_easy_setopt(c_h, CURLOPT_PROGRESSDATA, &seg->cb_data);
+    }
 
-        /* Check download statuses */
-        while ((msg = curl_multi_info_read(cm_h, &msgs_left))) {
-            if (msg->msg == CURLMSG_DONE) {
-                int failed = 0;
-                int idx, found = 0;
-                lr_CurlTarget t = NULL;
+    seg->checked = 0;
+    seg->norange = 0;
+    seg->badrange = 0;
+    seg->range_ok = 0;
+    seg->curl_handle = c_h;
+
+    cm_rc = curl_multi_add_handle(cm_h, c_h);
+    if (cm_rc != CURLM_OK) {
+        DPRINTF("%s: curl_multi_add_handle: %s\n", __func__,
+                curl_multi_strerror(cm_rc));
+        handle->last_curlm_error = cm_rc;
+        return LRE_CURLM;
+    }
 
-                /* Find out which handle this message is about */
-                for (idx=0; idx < not; idx++) {
-                    found = (msg->easy_handle == curl_easy_interfaces[idx]);
-                    t = lr_curltargetlist_get(targets, idx);
-                    if(found)
-                        break;
-                }
+    return LRE_OK;
+}
 
-                DPRINTF("%s: Download status: %d (%s)\n", __func__, msg->data.result, t->path);
-
-                if (msg->data.result == CURLE_OK) {
-                    long code = 0; // HTTP or FTP code
-                    curl_easy_getinfo (msg->easy_handle, CURLINFO_RESPONSE_CODE, &code);
-                    //if (code == 200 && msg->data.result != CURLE_ABORTED_BY_CALLBACK) {
-                    if (code && (code != 200 && code != 226)) {
-                        DPRINTF("%s: Bad HTTP/FTP code: %ld\n", __func__, code);
-                        failed = 1;
-                        last_ret = LRE_BADSTATUS;
-                        last_code = code;
-                    }
-                } else {
-                    failed = 1;
-                    last_ret = LRE_CURL;
-                }
+/** Remove the segment's transfer from the multi handle */
+static void
+lr_curl_segment_close(CURLM *cm_h, lr_CurlSegment seg)
+{
+    if (!seg->curl_handle)
+        return;
+    curl_multi_remove_handle(cm_h, seg->curl_handle);
+    curl_easy_cleanup(seg->curl_handle);
+    seg->curl_handle = NULL;
+}
 
-                /* Check checksum */
-                if (!failed && handle->checks & LR_CHECK_CHECKSUM
-                    && t->checksum && t->checksum_type != LR_CHECKSUM_UNKNOWN)
-                {
-                    DPRINTF("%s: Checking checksum\n", __func__);
-                    lseek(t->fd, 0, SEEK_SET);
-                    if (lr_checksum_fd_cmp(t->checksum_type, t->fd, t->checksum)) {
-                        DPRINTF("%s: Bad checksum\n", __func__);
-                        last_ret = LRE_BADCHECKSUM;
-                        failed = 1;
-                    }
-                }
+/** Check the finished transfer of the segment.
+ * @return              ::lr_Rc value of the transfer.
+ */
+static int
+lr_curl_segment_check(lr_Handle handle, lr_CurlSegment seg, CURLcode result)
+{
+    long code = 0;
 
-                if (failed) {
-                    failed_downloads++;
-                    /* Update total_to_download in  callback data */
-                    shared_cb_data.counted[idx] = 0;
-                    /* Seek and truncate the file */
-                    lseek(t->fd, 0, SEEK_SET);
-                    ftruncate(t->fd, 0);
-                } else {
-                    /* Succeeded */
-                    t->downloaded = 1;
-                }
-            }
+    if (seg->error) {
+        DPRINTF("%s: Cannot write data: %s\n", __func__, strerror(seg->error));
+        return LRE_IO;
+    }
+
+    if (seg->badrange) {
+        /* The mirror has a different file or doesn't respect the range */
+        DPRINTF("%s: Server sent other than the requested range\n", __func__);
+        handle->last_curl_error = CURLE_RANGE_ERROR;
+        return LRE_CURL;
+    }
+
+    if (result != CURLE_OK) {
+        handle->last_curl_error = result;
+        if (result == CURLE_HTTP_RETURNED_ERROR) {
+            curl_easy_getinfo(seg->curl_handle, CURLINFO_RESPONSE_CODE, &code);
+            handle->status_code = code;
+            return LRE_BADSTATUS;
         }
+        return LRE_CURL;
+    }
+
+    if (seg->pos != seg->end) {
+        /* The file on the mirror is shorter than expected */
+        DPRINTF("%s: Incomplete segment (%lld of %lld bytes)\n", __func__,
+                seg->pos - seg->start, seg->end - seg->start);
+        handle->last_curl_error = CURLE_PARTIAL_FILE;
+        return LRE_CURL;
+    }
+
+    return LRE_OK;
+}
+
+int
+lr_curl_segmented_download(lr_Handle handle,
+                           const char *path,
+                           int fd,
+                           lr_ChecksumType checksum_type,
+                           const char *checksum,
+                           long long size,
+                           int *fallback)
+{
+    int ret = LRE_OK;
+    int nom;            /* Number of mirrors */
+    int nos;            /* Number of segments */
+    int running = 0;
+    int *norange;       /* Mirrors which ignore range requests */
+    char *url;
+    CURLM *cm_h;
+    CURLMcode cm_rc = CURLM_OK;
+    lr_CurlSegment segs;
+    struct _lr_EventLoop loop;
+    struct _lr_SharedCallbackData shared_cb_data;
+    lr_ChecksumCtx ctx;
+    lr_InternalMirrorlist iml = handle->internal_mirrorlist;
+
+    assert(handle);
+    assert(fallback);
+
+    *fallback = 1;
+
+    if (!iml || (nom = lr_internalmirrorlist_len(iml)) < 1)
+        return LRE_NOURL;
+
+    if (handle->segments < 2)
+        return LRE_OK;
+
+    if (!(handle->checks & LR_CHECK_CHECKSUM) || !checksum) {
+        /* Only the checksum proves that the segments fit together */
+        DPRINTF("%s: Segmented download of %s is not used (no checksum)\n",
+                __func__, path);
+        return LRE_OK;
+    }
+
+    /* Size of the file is needed to split it */
+    if (size <= 0)
+        size = -1;
+    for (int x = 0; x < nom && size < 0; x++) {
+        url = lr_pathconcat(lr_internalmirrorlist_get_url(iml, x), path, NULL);
+        size = lr_curl_remote_size(handle, url);
+        lr_free(url);
+    }
+
+    nos = handle->segments;
+    if (size > 0 && size / handle->segmentsize < nos)
+        nos = size / handle->segmentsize;
+    if (nos > nom * handle->maxdownloadspermirror)
+        nos = nom * handle->maxdownloadspermirror;
+    if (size <= 0 || nos < 2) {
+        DPRINTF("%s: Segmented download of %s is not used (size %lld)\n",
+                __func__, path, size);
+        return LRE_OK;
+    }
+
+    DPRINTF("%s: Downloading %s (%lld bytes) in %d segments\n",
+            __func__, path, size, nos);
+
+    /* Segments are written to their place in the file */
+    if (ftruncate(fd, size) == -1) {
+        DPRINTF("%s: ftruncate: %s\n", __func__, strerror(errno));
+        *fallback = 0;
+        return LRE_IO;
+    }
+#ifdef FALLOC_FL_KEEP_SIZE
+    /* Avoid a sparse file fragmented by the parallel writes */
+    if (fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, (off_t) size) == -1)
+        DPRINTF("%s: fallocate: %s\n", __func__, strerror(errno));
+#endif
+
+    cm_h = curl_multi_init();
+    if (!cm_h)
+        return LRE_CURLM;
 
-        /* Cleanup */
+    if (lr_eventloop_init(&loop, cm_h) != LRE_OK) {
         curl_multi_cleanup(cm_h);
-        cm_h = NULL;
-        for (int x = 0; x < not; x++) {
-            if (curl_easy_interfaces[x]) {
-                curl_easy_cleanup(curl_easy_interfaces[x]);
-                curl_easy_interfaces[x] = NULL;
+        return LRE_CURLM;
+    }
+
+    *fallback = 0;
+    norange = lr_malloc0(nom * sizeof(int));
+    segs = lr_malloc0(nos * sizeof(struct _lr_CurlSegment));
+
+    shared_cb_data.counted = lr_malloc0(sizeof(short) * nos);
+    shared_cb_data.count = nos;
+    shared_cb_data.advertise = 0;
+    shared_cb_data.downloaded = 0;
+    shared_cb_data.total_size = 0;
+    shared_cb_data.cb = handle->user_cb;
+    shared_cb_data.user_data = handle->user_data;
+
+    /* Spread the segments over the mirrors */
+    for (int x = 0; x < nos; x++) {
+        lr_CurlSegment seg = &segs[x];
+        seg->start = x * (size / nos);
+        seg->end = (x == nos - 1) ? size : (x + 1) * (size / nos);
+        seg->pos = seg->start;
+        seg->fd = fd;
+        seg->size = size;
+        seg->mirror = x % nom;
+        seg->cb_data.id = x;
+        seg->cb_data.scb_data = &shared_cb_data;
+
+        ret = lr_curl_segment_start(handle, cm_h, seg, path);
+        if (ret != LRE_OK)
+            goto cleanup;
+        running++;
+    }
+
+    cm_rc = lr_eventloop_start(&loop);
+
+    while (cm_rc == CURLM_OK && running) {
+        CURLMsg *msg;
+        int msgs_left;
+
+        cm_rc = lr_eventloop_wait(&loop);
+
+        while (cm_rc == CURLM_OK && (msg = curl_multi_info_read(cm_h, &msgs_left))) {
+            int rc;
+            lr_CurlSegment seg = NULL;
+
+            if (msg->msg != CURLMSG_DONE)
+                continue;
+
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **) &seg);
+            assert(seg);
+            rc = lr_curl_segment_check(handle, seg, msg->data.result);
+            if (seg->norange) {
+                DPRINTF("%s: Mirror %s ignores range requests\n", __func__,
+                        lr_internalmirrorlist_get_url(iml, seg->mirror));
+                norange[seg->mirror] = 1;
+            } else {
+                lr_curl_mirror_note(lr_internalmirrorlist_get(iml, seg->mirror),
+                                    rc, seg->curl_handle);
             }
-       }
+            lr_curl_segment_close(cm_h, seg);
+            running--;
 
-        if (failed_downloads == 0)
-            break;
+            if (rc == LRE_OK)
+                continue;
 
-    } /* End of iteration over mirrors */
+            if (rc == LRE_IO) {
+                /* Local error - other mirrors do not help */
+                ret = rc;
+                goto cleanup;
+            }
 
-cleanup:
-    DPRINTF("%s: Cleanup\n", __func__);
+            /* Continue with the rest of the segment from other mirror */
+            do {
+                seg->tries++;
+                seg->mirror = (seg->mirror + 1) % nom;
+            } while (seg->tries < nom && norange[seg->mirror]);
+
+            if (seg->tries >= nom) {
+                /* No usable mirror left */
+                int all_norange = 1;
+                for (int x = 0; x < nom; x++)
+                    if (!norange[x])
+                        all_norange = 0;
+                if (all_norange)
+                    DPRINTF("%s: No mirror supports range requests\n", __func__);
+                ret = rc;
+                goto cleanup;
+            }
 
-    if (failed_downloads != 0) {
-        /* At least one file cannot be downloaded from any mirror */
-        if (last_ret != LRE_OK)
-            ret = last_ret;
-        if (last_code != 0)
-            handle->status_code = last_code;
+            shared_cb_data.counted[seg->cb_data.id] = 0;
+            ret = lr_curl_segment_start(handle, cm_h, seg, path);
+            if (ret != LRE_OK)
+                goto cleanup;
+            running++;
+        }
     }
 
-    if (cm_h)
-        curl_multi_cleanup(cm_h);
-    for (int x = 0; x < not; x++) {
-        if (curl_easy_interfaces[x])
-            curl_easy_cleanup(curl_easy_interfaces[x]);
-        if (open_files[x])
-            fclose(open_files[x]);
+    if (cm_rc != CURLM_OK) {
+        DPRINTF("%s: Event loop error: %d\n", __func__, cm_rc);
+        handle->last_curlm_error = cm_rc;
+        ret = LRE_CURLM;
+        goto cleanup;
+    }
+
+    /* The checksum covers the whole file
+     * (non zero offset means that the whole file is read) */
+    ret = lr_curl_checksum_start(checksum_type, fd, size, &ctx);
+    if (ret == LRE_OK && ctx) {
+        ret = lr_curl_checksum_check(handle, ctx, checksum_type,
+                                     checksum, fd);
+        lr_checksumctx_free(ctx);
     }
+
+cleanup:
+    if (ret != LRE_OK && ret != LRE_IO) {
+        /* The whole file downloaded from a single mirror could still
+         * succeed (segments from different mirrors may not fit together,
+         * the mirrors may not support range requests, ...) */
+        DPRINTF("%s: Segmented download failed (%d: %s) - fallback\n",
+                __func__, ret, lr_strerror(ret));
+        *fallback = 1;
+    }
+
+    for (int x = 0; x < nos; x++)
+        lr_curl_segment_close(cm_h, &segs[x]);
+    lr_eventloop_cleanup(&loop);
+    curl_multi_cleanup(cm_h);
+    lr_curl_mirrorstats_save(handle);
     lr_free(shared_cb_data.counted);
+    lr_free(segs);
+    lr_free(norange);
 
     return ret;
 }
-
@@ -34,6 +34,30 @@ extern "C" {
 /** \defgroup   curl    Set of function for downloading via curl
  */
 
+/** \ingroup curl
+ * HTTP validators of a file used for a conditional download.
+ */
+struct _lr_CurlValidators {
+    char *etag;             /*!< ETag of the local copy or NULL */
+    char *last_modified;    /*!< Last-Modified of the local copy or NULL */
+    char *new_etag;         /*!< ETag of the downloaded file or NULL */
+    char *new_last_modified;/*!< Last-Modified of the downloaded file
+                                 or NULL */
+};
+typedef struct _lr_CurlValidators * lr_CurlValidators;
+
+/** \ingroup curl
+ * Create new empty ::lr_CurlValidators.
+ * @return              New allocated object.
+ */
+lr_CurlValidators lr_curlvalidators_new();
+
+/** \ingroup curl
+ * Free ::lr_CurlValidators and all its strings.
+ * @param validators    Validators or NULL.
+ */
+void lr_curlvalidators_free(lr_CurlValidators validators);
+
 /** \ingroup curl
  * Simplified version lr_curl_single_download_resume. Whole file is
  * downloaded without try to resume and user callback in handle is not used.
@@ -47,13 +71,35 @@ extern "C" {
             lr_curl_single_download_resume((handle), (url), (fd), 0, 0)
 
 /** \ingroup curl
- * Download one single file.
+ * Download one single file without checksum check.
+ * For more information look at lr_curl_single_download_checksum.
+ * @param handle        Librepo handle
+ * @param url           Full URL
+ * @param fd            Opened file descriptor.
+ * @param offset        Offset (same as ::lr_curl_single_download_checksum).
+ * @param use_cb        Use user callback from librepo handle? 0 == No
+ * @return              ::lr_Rc value.
+ */
+#define lr_curl_single_download_resume(handle, url, fd, offset, use_cb) \
+            lr_curl_single_download_checksum((handle), (url), (fd), \
+                                             LR_CHECKSUM_UNKNOWN, NULL, \
+                                             (offset), (use_cb))
+
+/** \ingroup curl
+ * Download one single file. Checksum is calculated from the data
+ * as they are downloaded (no extra reading of the file is needed).
  * @param handle        Librepo handle
  * @param url           Full URL
  * @param fd            Opened file descriptor where downloaded data
  *                      will be written. Data writing starts on current
  *                      descriptor position, no seek or truncation
  *                      is performed (except situation when offset is -1).
+ *                      If offset is not 0 and checksum is specified,
+ *                      the descriptor must be readable, because the
+ *                      already present data are part of the checksum.
+ * @param checksum_type Checksum type.
+ * @param checksum      Expected checksum of file or NULL. If NULL, checksum
+ *                      will not be checked.
  * @param offset        Offset where to start downloading. If 0, do not
  *                      resume and download whole file. If offset > 0, try
  *                      start download from this offset (no seek performed!).
@@ -64,11 +110,48 @@ extern "C" {
  * @param use_cb        Use user callback from librepo handle? 0 == No
  * @return              ::lr_Rc value.
  */
-int lr_curl_single_download_resume(lr_Handle handle,
-                                   const char *url,
-                                   int fd,
-                                   long long offset,
-                                   int use_cb);
+int lr_curl_single_download_checksum(lr_Handle handle,
+                                     const char *url,
+                                     int fd,
+                                     lr_ChecksumType checksum_type,
+                                     const char *checksum,
+                                     long long offset,
+                                     int use_cb);
+
+/** \ingroup curl
+ * Download one single (typically small) file into the memory.
+ * No temporary file is used. User callback in handle is not used.
+ * @param handle        Librepo handle
+ * @param url           Full URL
+ * @param data          Downloaded data are returned here. The buffer is
+ *                      malloced, NUL terminated and the caller is
+ *                      responsible to free it. On error it is set to NULL.
+ * @param data_len      Length of the downloaded data (without the
+ *                      terminating NUL) or NULL.
+ * @return              ::lr_Rc value.
+ */
+int lr_curl_single_download_mem(lr_Handle handle,
+                                const char *url,
+                                char **data,
+                                size_t *data_len);
+
+/** \ingroup curl
+ * Download one single file and pass its data to the data_cb as they
+ * arrive. User callback in handle is not used.
+ * @param handle        Librepo handle
+ * @param url           Full URL
+ * @param fd            Opened file descriptor where the data will be
+ *                      written or -1 if the data are only passed to
+ *                      the data_cb.
+ * @param data_cb       Callback which gets the downloaded data.
+ * @param data_cb_data  User data for the data_cb.
+ * @return              ::lr_Rc value.
+ */
+int lr_curl_single_download_cb(lr_Handle handle,
+                               const char *url,
+                               int fd,
+                               lr_DataCb data_cb,
+                               void *data_cb_data);
 
 /** \ingroup curl
  * Simplified version of lr_curl_single_mirrored_download_resume.
@@ -113,6 +196,40 @@ int lr_curl_single_mirrored_download_resume(lr_Handle handle,
                                             long long offset,
                                             int use_cb);
 
+/** \ingroup curl
+ * Same as lr_curl_single_mirrored_download, but the downloaded data
+ * are also passed to the data_cb as they arrive. So the file could be
+ * processed (e.g. parsed) without reading it again after the download.
+ * @param handle        Librepo handle
+ * @param path          Relative part of URL. Mirror URL will be prepended
+ *                      to this path.
+ * @param fd            Opened file descriptor or -1 if the data are only
+ *                      passed to the data_cb.
+ * @param checksum_type Checksum type.
+ * @param checksum      Expected checksum value or NULL.
+ * @param expected_size Expected size of the file or 0 if unknown.
+ *                      Disk space is preallocated and, if the checksum
+ *                      is checked, the download from a mirror fails as
+ *                      soon as it exceeds the size.
+ * @param validators    If not NULL, the download is conditional.
+ *                      If the server answers 304 Not Modified,
+ *                      LRE_NOTMODIFIED is returned and no other mirror
+ *                      is tried. Validators of the downloaded file
+ *                      are stored into the new_* members.
+ * @param data_cb       Callback which gets the downloaded data.
+ * @param data_cb_data  User data for the data_cb.
+ * @return              ::lr_Rc value.
+ */
+int lr_curl_single_mirrored_download_cb(lr_Handle handle,
+                                        const char *path,
+                                        int fd,
+                                        lr_ChecksumType checksum_type,
+                                        const char *checksum,
+                                        long long expected_size,
+                                        lr_CurlValidators validators,
+                                        lr_DataCb data_cb,
+                                        void *data_cb_data);
+
 /** \ingroup curl
  * Download several files at once.
  * @param handle        Librepo handle.
@@ -121,6 +238,58 @@ int lr_curl_single_mirrored_download_resume(lr_Handle handle,
  */
 int lr_curl_multi_download(lr_Handle handle, lr_CurlTargetList targets);
 
+/** \ingroup curl
+ * Download a file in several segments (byte ranges) at once. Segments
+ * are spread over the mirrors of the internal mirrorlist and written
+ * by pwrite() to their place in the fd. Size of the file is taken from
+ * the size argument or, if it is not known, get by a HEAD request.
+ * Every range response must have a Content-Range matching the requested
+ * range and the size, otherwise the mirror is skipped. A segment which
+ * fails continues from another mirror. Checksum is checked over the whole
+ * file, that's why the segmented download is used only if the checksum
+ * is known and LR_CHECK_CHECKSUM is set.
+ * @param handle        Librepo handle with prepared internal mirrorlist.
+ * @param path          Relative path of the file on the mirrors.
+ * @param fd            Opened file descriptor for the downloaded data.
+ * @param checksum_type Type of the checksum.
+ * @param checksum      Expected checksum or NULL.
+ * @param size          Expected size of the file (e.g. from metalink)
+ *                      or 0 if it is not known.
+ * @param fallback      Set to 1 if the segmented download cannot be used
+ *                      (LRO_SEGMENTS is not set, no checksum is checked,
+ *                      the file is too small or its size is unknown)
+ *                      or if it failed for other
+ *                      than a local (LRE_IO) reason, e.g. no mirror
+ *                      supports range requests or the checksum of the
+ *                      segments doesn't match. The file must be
+ *                      downloaded by other way then.
+ * @return              ::lr_Rc value.
+ */
+int lr_curl_segmented_download(lr_Handle handle,
+                               const char *path,
+                               int fd,
+                               lr_ChecksumType checksum_type,
+                               const char *checksum,
+                               long long size,
+                               int *fallback);
+
+/** \ingroup curl
+ * Measure the speed of the first count mirrors of the internal
+ * mirrorlist and reorder the mirrorlist by the results. All mirrors
+ * are probed in parallel by a small range request of the path.
+ * Mirrors which do not respond within the timeout are moved behind
+ * the successfully probed ones.
+ * @param handle        Librepo handle with prepared internal mirrorlist.
+ * @param path          Path of a file on the mirrors used for the probe.
+ * @param count         Number of probed mirrors.
+ * @param timeout_ms    Time budget of the whole probe in milliseconds.
+ * @return              ::lr_Rc value.
+ */
+int lr_curl_probe_mirrors(lr_Handle handle,
+                          const char *path,
+                          int count,
+                          long timeout_ms);
+
 #ifdef __cplusplus
 }
 #endif
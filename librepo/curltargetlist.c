@@ -18,7 +18,10 @@ lr_curltarget_free(lr_CurlTarget target)
 {
     if (!target) return;
     lr_free(target->path);
+    lr_free(target->fn);
     lr_free(target->checksum);
+    lr_free(target->base_url);
+    lr_free(target->data);
     lr_free(target);
 }
 
@@ -24,8 +24,30 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
+
 #include "checksum.h"
 
+/**
+ * Callback which gets every piece of downloaded data as it arrives
+ * (e.g. to feed an incremental parser).
+ * When a download (re)starts (retry, next mirror) the callback is
+ * called with NULL data and all data passed so far must be discarded.
+ * @param userdata      User data.
+ * @param data          Downloaded data or NULL.
+ * @param len           Length of the data.
+ */
+typedef void (*lr_DataCb)(void *userdata, const char *data, size_t len);
+
+/**
+ * Callback called when all data of the download were passed
+ * to the ::lr_DataCb and the download itself succeeded.
+ * @param userdata      User data.
+ * @return              LRE_OK if the data are fine, other ::lr_Rc value
+ *                      makes the download fail (the next mirror is tried).
+ */
+typedef int (*lr_DataEndCb)(void *userdata);
+
 /**
  * Target for download via ::lr_curl_multi_download
  */
@@ -33,9 +55,40 @@ struct _lr_CurlTarget {
     char *path;      /*!< Relative path for URL
                         (URL: "http://foo.bar/stuff", path: "somestuff.xml") */
     int fd;          /*!< Opened file descriptor where data will be written */
+    char *fn;        /*!< If not NULL, the file is opened when its download
+                        starts and closed when it ends (fd is ignored).
+                        Usefull for lot of targets to not exceed the limit
+                        of opened file descriptors. */
     lr_ChecksumType checksum_type;  /*!< Checksum type */
     char *checksum;  /*!< Expected checksum value or NULL */
+    long long expected_size; /*!< Expected size of the file or 0 if
+                        unknown. Disk space is preallocated and, if the
+                        checksum is checked, the download fails as soon
+                        as it exceeds this size. */
+    char *base_url;  /*!< If not NULL, mirrors are ignored and the target is
+                        downloaded from this base URL */
+    int resume;      /*!< If != 0 try to resume download of already
+                        existing data in the file */
+    int in_memory;   /*!< If != 0 the data are not written to a file
+                        (fd and fn are ignored) but they are collected
+                        in the data buffer (unless data_cb is set) */
+    lr_DataCb data_cb; /*!< If not NULL, it gets all downloaded data
+                        of the target */
+    lr_DataEndCb data_end_cb; /*!< If not NULL, it is called with the
+                        data_cb_data after a successful download and it
+                        can still reject the data */
+    void *data_cb_data; /*!< User data for the data_cb */
+    int optional;    /*!< If != 0, failed download of the target is not
+                        an error of the download nor of the mirror
+                        (e.g. a signature which may not exist). It is
+                        not recorded in the mirror statistics and it
+                        doesn't change the last status code or error
+                        of the handle. */
+    char *data;      /*!< Downloaded data of in_memory target (malloced,
+                        NUL terminated) or NULL */
+    size_t data_len; /*!< Length of the downloaded data */
     int downloaded;  /*!< 1 target was downloaded successfully, 0 otherwise */
+    int rc;          /*!< Librepo return code of the target download */
 };
 
 typedef struct _lr_CurlTarget * lr_CurlTarget;
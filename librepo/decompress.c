@@ -0,0 +1,445 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2012  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#define _GNU_SOURCE     /* fallocate() */
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <zlib.h>
+#include <bzlib.h>
+#include <lzma.h>
+
+#include "setup.h"
+#include "util.h"
+#include "rcodes.h"
+#include "decompress.h"
+
+#define LR_DECOMPRESS_BUFSIZE   65536
+
+struct _lr_Decompressor {
+    lr_CompressionType type;    /*!< Compression of the input data */
+    int fd;                     /*!< Output file */
+    int initialized;            /*!< 1 if the stream below is initialized */
+    int ended;                  /*!< 1 if the end of the compressed stream
+                                     was reached */
+    int rc;                     /*!< First error or LRE_OK */
+    z_stream gz;                /*!< gzip stream */
+    bz_stream bz;               /*!< bzip2 stream */
+    lzma_stream xz;             /*!< xz stream */
+    lr_ChecksumType checksum_type; /*!< Type of the expected checksum */
+    char *checksum;             /*!< Expected checksum or NULL */
+    lr_ChecksumCtx checksum_ctx;/*!< Checksum of the decompressed data */
+    long long size;             /*!< Expected size or 0 */
+    long long written;          /*!< Size of the decompressed data */
+    char *buf;                  /*!< Output buffer */
+};
+
+static const struct {
+    const char *suffix;
+    lr_CompressionType type;
+} lr_compression_suffixes[] = {
+    { ".gz",    LR_COMPRESSION_GZ },
+    { ".bz2",   LR_COMPRESSION_BZ2 },
+    { ".xz",    LR_COMPRESSION_XZ },
+    { NULL,     LR_COMPRESSION_NONE },
+};
+
+lr_CompressionType
+lr_compression_type(const char *path)
+{
+    if (!path)
+        return LR_COMPRESSION_NONE;
+
+    for (int x = 0; lr_compression_suffixes[x].suffix; x++)
+        if (lr_ends_with(path, lr_compression_suffixes[x].suffix))
+            return lr_compression_suffixes[x].type;
+
+    return LR_COMPRESSION_NONE;
+}
+
+char *
+lr_decompressed_path(const char *path)
+{
+    if (!path)
+        return NULL;
+
+    for (int x = 0; lr_compression_suffixes[x].suffix; x++) {
+        size_t len = strlen(path);
+        size_t suffix_len = strlen(lr_compression_suffixes[x].suffix);
+        char *decompressed;
+
+        if (len <= suffix_len
+            || !lr_ends_with(path, lr_compression_suffixes[x].suffix))
+            continue;
+
+        decompressed = lr_strdup(path);
+        decompressed[len - suffix_len] = '\0';
+        return decompressed;
+    }
+
+    return NULL;
+}
+
+/** Initialize the decompression stream and the checksum calculation */
+static void
+lr_decompressor_start(lr_Decompressor d)
+{
+    int ok = 0;
+
+    switch (d->type) {
+    case LR_COMPRESSION_GZ:
+        memset(&d->gz, 0, sizeof(d->gz));
+        /* +32 - detect gzip or zlib header automatically */
+        ok = (inflateInit2(&d->gz, 15 + 32) == Z_OK);
+        break;
+    case LR_COMPRESSION_BZ2:
+        memset(&d->bz, 0, sizeof(d->bz));
+        ok = (BZ2_bzDecompressInit(&d->bz, 0, 0) == BZ_OK);
+        break;
+    case LR_COMPRESSION_XZ: {
+        lzma_stream init = LZMA_STREAM_INIT;
+        d->xz = init;
+        ok = (lzma_stream_decoder(&d->xz, UINT64_MAX,
+                                  LZMA_CONCATENATED) == LZMA_OK);
+        break;
+    }
+    case LR_COMPRESSION_NONE:
+        break;
+    }
+
+    if (!ok) {
+        DPRINTF("%s: Cannot initialize the decompression\n", __func__);
+        d->rc = LRE_DECOMPRESSION;
+        return;
+    }
+    d->initialized = 1;
+
+    if (d->checksum) {
+        d->checksum_ctx = lr_checksumctx_new(d->checksum_type);
+        if (!d->checksum_ctx) {
+            DPRINTF("%s: Unknown checksum type\n", __func__);
+            d->rc = LRE_UNKNOWNCHECKSUM;
+        }
+    }
+}
+
+/** Release the decompression stream */
+static void
+lr_decompressor_end(lr_Decompressor d)
+{
+    if (d->initialized) {
+        switch (d->type) {
+        case LR_COMPRESSION_GZ:  inflateEnd(&d->gz);            break;
+        case LR_COMPRESSION_BZ2: BZ2_bzDecompressEnd(&d->bz);   break;
+        case LR_COMPRESSION_XZ:  lzma_end(&d->xz);              break;
+        case LR_COMPRESSION_NONE:                               break;
+        }
+        d->initialized = 0;
+    }
+
+    lr_checksumctx_free(d->checksum_ctx);
+    d->checksum_ctx = NULL;
+}
+
+/** Write the decompressed data to the file and to the checksum */
+static void
+lr_decompressor_output(lr_Decompressor d, const char *buf, size_t len)
+{
+    d->written += len;
+
+    if (d->checksum_ctx)
+        lr_checksumctx_update(d->checksum_ctx, buf, len);
+
+    while (len > 0) {
+        ssize_t written = write(d->fd, buf, len);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0) {
+            DPRINTF("%s: write: %s\n", __func__,
+                    (written < 0) ? strerror(errno) : "No space left");
+            d->rc = LRE_IO;
+            return;
+        }
+        buf += written;
+        len -= written;
+    }
+}
+
+/** Decompress the next chunk of the compressed data.
+ * @param finish            1 if there are no more input data.
+ */
+static void
+lr_decompressor_run(lr_Decompressor d,
+                    const char *data,
+                    size_t len,
+                    int finish)
+{
+    switch (d->type) {
+    case LR_COMPRESSION_GZ:
+        d->gz.next_in = (Bytef *) data;
+        d->gz.avail_in = len;
+        break;
+    case LR_COMPRESSION_BZ2:
+        d->bz.next_in = (char *) data;
+        d->bz.avail_in = len;
+        break;
+    case LR_COMPRESSION_XZ:
+        d->xz.next_in = (const uint8_t *) data;
+        d->xz.avail_in = len;
+        break;
+    case LR_COMPRESSION_NONE:
+        return;
+    }
+
+    while (d->rc == LRE_OK) {
+        int ret, end = 0, error = 0;
+        size_t avail_in = 0, avail_out = 0;
+
+        switch (d->type) {
+        case LR_COMPRESSION_GZ:
+            if (d->ended) {
+                /* Next member of a multi-member gzip file */
+                inflateReset(&d->gz);
+                d->ended = 0;
+            }
+            d->gz.next_out = (Bytef *) d->buf;
+            d->gz.avail_out = LR_DECOMPRESS_BUFSIZE;
+            ret = inflate(&d->gz, Z_NO_FLUSH);
+            end = (ret == Z_STREAM_END);
+            error = (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR);
+            avail_in = d->gz.avail_in;
+            avail_out = d->gz.avail_out;
+            break;
+        case LR_COMPRESSION_BZ2:
+            if (d->ended) {
+                /* Next stream of a concatenated bzip2 file */
+                char *next_in = d->bz.next_in;
+                unsigned int rest = d->bz.avail_in;
+
+                BZ2_bzDecompressEnd(&d->bz);
+                memset(&d->bz, 0, sizeof(d->bz));
+                if (BZ2_bzDecompressInit(&d->bz, 0, 0) != BZ_OK) {
+                    d->initialized = 0;
+                    error = 1;
+                    break;
+                }
+                d->bz.next_in = next_in;
+                d->bz.avail_in = rest;
+                d->ended = 0;
+            }
+            d->bz.next_out = d->buf;
+            d->bz.avail_out = LR_DECOMPRESS_BUFSIZE;
+            ret = BZ2_bzDecompress(&d->bz);
+            end = (ret == BZ_STREAM_END);
+            error = (ret != BZ_OK && ret != BZ_STREAM_END);
+            avail_in = d->bz.avail_in;
+            avail_out = d->bz.avail_out;
+            break;
+        case LR_COMPRESSION_XZ:
+            d->xz.next_out = (uint8_t *) d->buf;
+            d->xz.avail_out = LR_DECOMPRESS_BUFSIZE;
+            ret = lzma_code(&d->xz, finish ? LZMA_FINISH : LZMA_RUN);
+            end = (ret == LZMA_STREAM_END);
+            error = (ret != LZMA_OK && ret != LZMA_STREAM_END);
+            avail_in = d->xz.avail_in;
+            avail_out = d->xz.avail_out;
+            break;
+        case LR_COMPRESSION_NONE:
+            return;
+        }
+
+        if (error) {
+            DPRINTF("%s: Broken compressed data\n", __func__);
+            d->rc = LRE_DECOMPRESSION;
+            return;
+        }
+
+        lr_decompressor_output(d, d->buf, LR_DECOMPRESS_BUFSIZE - avail_out);
+
+        if (end) {
+            d->ended = 1;
+            if (!avail_in)
+                return;
+            continue;
+        }
+
+        if (avail_out)
+            return;  /* All available input was consumed */
+    }
+}
+
+lr_Decompressor
+lr_decompressor_new(lr_CompressionType type,
+                    const char *path,
+                    lr_ChecksumType checksum_type,
+                    const char *checksum,
+                    long long size)
+{
+    int fd;
+    lr_Decompressor d;
+
+    fd = open(path, O_CREAT|O_TRUNC|O_RDWR, 0660);
+    if (fd < 0) {
+        DPRINTF("%s: open(%s): %s\n", __func__, path, strerror(errno));
+        return NULL;
+    }
+
+#ifdef FALLOC_FL_KEEP_SIZE
+    if (size > 0 && fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, (off_t) size) == -1)
+        DPRINTF("%s: fallocate: %s\n", __func__, strerror(errno));
+#endif
+
+    d = lr_malloc0(sizeof(struct _lr_Decompressor));
+    d->type = type;
+    d->fd = fd;
+    d->rc = LRE_OK;
+    d->checksum_type = checksum_type;
+    d->checksum = lr_strdup(checksum);
+    d->size = size;
+    d->buf = lr_malloc(LR_DECOMPRESS_BUFSIZE);
+    return d;
+}
+
+void
+lr_decompressor_cb(void *decompressor, const char *data, size_t len)
+{
+    lr_Decompressor d = decompressor;
+
+    if (!data) {
+        /* Download (re)starts - discard everything */
+        lr_decompressor_end(d);
+        lseek(d->fd, 0, SEEK_SET);
+        ftruncate(d->fd, 0);
+        d->rc = LRE_OK;
+        d->ended = 0;
+        d->written = 0;
+        return;
+    }
+
+    if (d->rc != LRE_OK)
+        return;
+
+    if (!d->initialized) {
+        lr_decompressor_start(d);
+        if (d->rc != LRE_OK)
+            return;
+    }
+
+    lr_decompressor_run(d, data, len, 0);
+}
+
+int
+lr_decompressor_finish(lr_Decompressor d)
+{
+    if (d->rc == LRE_OK && !d->initialized)
+        lr_decompressor_start(d);  /* No data at all */
+
+    if (d->rc == LRE_OK && d->type == LR_COMPRESSION_XZ)
+        lr_decompressor_run(d, NULL, 0, 1);
+
+    if (d->rc == LRE_OK && !d->ended) {
+        DPRINTF("%s: Compressed data are truncated\n", __func__);
+        d->rc = LRE_DECOMPRESSION;
+    }
+
+    if (d->rc == LRE_OK && d->checksum) {
+        char *checksum;
+
+        if (d->size > 0 && d->written != d->size) {
+            DPRINTF("%s: Bad size of decompressed data (%lld != %lld)\n",
+                    __func__, d->written, d->size);
+            d->rc = LRE_BADCHECKSUM;
+            return d->rc;
+        }
+
+        checksum = lr_checksumctx_final(d->checksum_ctx);
+        if (!checksum || strcmp(checksum, d->checksum)) {
+            DPRINTF("%s: Bad checksum of decompressed data\n", __func__);
+            d->rc = LRE_BADCHECKSUM;
+        }
+        lr_free(checksum);
+    }
+
+    return d->rc;
+}
+
+int
+lr_decompressor_finish_cb(void *decompressor)
+{
+    return lr_decompressor_finish(decompressor);
+}
+
+void
+lr_decompressor_free(lr_Decompressor d)
+{
+    if (!d)
+        return;
+
+    lr_decompressor_end(d);
+    close(d->fd);
+    lr_free(d->checksum);
+    lr_free(d->buf);
+    lr_free(d);
+}
+
+int
+lr_decompress_file(lr_CompressionType type,
+                   const char *src,
+                   const char *dst,
+                   lr_ChecksumType checksum_type,
+                   const char *checksum,
+                   long long size)
+{
+    int fd, rc;
+    ssize_t len;
+    char buf[LR_DECOMPRESS_BUFSIZE];
+    lr_Decompressor d;
+
+    fd = open(src, O_RDONLY);
+    if (fd < 0) {
+        DPRINTF("%s: open(%s): %s\n", __func__, src, strerror(errno));
+        return LRE_IO;
+    }
+
+    unlink(dst);
+    d = lr_decompressor_new(type, dst, checksum_type, checksum, size);
+    if (!d) {
+        close(fd);
+        return LRE_IO;
+    }
+
+    while ((len = read(fd, buf, sizeof(buf))) > 0)
+        lr_decompressor_cb(d, buf, (size_t) len);
+
+    if (len < 0) {
+        DPRINTF("%s: read(%s): %s\n", __func__, src, strerror(errno));
+        rc = LRE_IO;
+    } else {
+        rc = lr_decompressor_finish(d);
+    }
+
+    close(fd);
+    lr_decompressor_free(d);
+    if (rc != LRE_OK)
+        unlink(dst);
+    return rc;
+}
@@ -0,0 +1,125 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2012  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#ifndef LR_DECOMPRESS_H
+#define LR_DECOMPRESS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#include "checksum.h"
+
+/** Compression of a metadata file */
+typedef enum {
+    LR_COMPRESSION_NONE,    /*!< Not compressed (or unknown compression) */
+    LR_COMPRESSION_GZ,      /*!< gzip (.gz) */
+    LR_COMPRESSION_BZ2,     /*!< bzip2 (.bz2) */
+    LR_COMPRESSION_XZ,      /*!< xz (.xz) */
+} lr_CompressionType;
+
+/** Decompressor of a stream of data to a file */
+typedef struct _lr_Decompressor * lr_Decompressor;
+
+/** Detect compression of the file from the suffix of its name.
+ * @param path              Path or URL of the file.
+ * @return                  ::lr_CompressionType
+ */
+lr_CompressionType lr_compression_type(const char *path);
+
+/** Path of the decompressed file - the path without
+ * the compression suffix.
+ * @param path              Path of the compressed file.
+ * @return                  Malloced path or NULL if the file is
+ *                          not compressed.
+ */
+char *lr_decompressed_path(const char *path);
+
+/** Create a decompressor which writes the decompressed data to the file.
+ * The file is created (truncated) immediately.
+ * @param type              Compression of the input data.
+ * @param path              Path of the decompressed file.
+ * @param checksum_type     Type of the checksum of the decompressed data.
+ * @param checksum          Expected checksum of the decompressed data or
+ *                          NULL if it shouldn't be checked.
+ * @param size              Expected size of the decompressed data or 0 if
+ *                          unknown. Space for the file is preallocated.
+ * @return                  New decompressor or NULL if the file
+ *                          cannot be created (errno is set).
+ */
+lr_Decompressor lr_decompressor_new(lr_CompressionType type,
+                                    const char *path,
+                                    lr_ChecksumType checksum_type,
+                                    const char *checksum,
+                                    long long size);
+
+/** Decompress the next chunk of the data. This is a ::lr_DataCb,
+ * NULL data restart the decompression from the beginning.
+ * Errors are reported by ::lr_decompressor_finish.
+ * @param decompressor      Decompressor (::lr_Decompressor).
+ * @param data              Compressed data or NULL.
+ * @param len               Length of the data.
+ */
+void lr_decompressor_cb(void *decompressor, const char *data, size_t len);
+
+/** Finish the decompression and verify the decompressed data.
+ * @param decompressor      Decompressor.
+ * @return                  LRE_OK, LRE_DECOMPRESSION if the compressed
+ *                          data are broken or truncated, LRE_BADCHECKSUM
+ *                          if the checksum or the size of decompressed data
+ *                          doesn't match, LRE_IO or LRE_UNKNOWNCHECKSUM.
+ */
+int lr_decompressor_finish(lr_Decompressor decompressor);
+
+/** Finish the decompression. This is a ::lr_DataEndCb, see
+ * ::lr_decompressor_finish.
+ * @param decompressor      Decompressor (::lr_Decompressor).
+ * @return                  Librepo return code ::lr_Rc.
+ */
+int lr_decompressor_finish_cb(void *decompressor);
+
+/** Free the decompressor and close its file.
+ * @param decompressor      Decompressor or NULL.
+ */
+void lr_decompressor_free(lr_Decompressor decompressor);
+
+/** Decompress the local file.
+ * @param type              Compression of the source file.
+ * @param src               Path of the compressed file.
+ * @param dst               Path of the decompressed file.
+ * @param checksum_type     Type of the checksum of the decompressed data.
+ * @param checksum          Expected checksum or NULL.
+ * @param size              Expected size of the decompressed data or 0.
+ * @return                  Librepo return code ::lr_Rc
+ *                          (see ::lr_decompressor_finish).
+ */
+int lr_decompress_file(lr_CompressionType type,
+                       const char *src,
+                       const char *dst,
+                       lr_ChecksumType checksum_type,
+                       const char *checksum,
+                       long long size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
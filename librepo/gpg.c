@@ -24,12 +24,27 @@
 #include <string.h>
 #include <gpgme.h>
 #include <unistd.h>
+#include <pthread.h>
 
 #include "rcodes.h"
 #include "setup.h"
 #include "util.h"
 #include "gpg.h"
 
+static pthread_once_t lr_gpg_once = PTHREAD_ONCE_INIT;
+
+static void
+lr_gpg_init_once(void)
+{
+    gpgme_check_version(NULL);
+}
+
+void
+lr_gpg_init(void)
+{
+    pthread_once(&lr_gpg_once, lr_gpg_init_once);
+}
+
 int
 lr_gpg_check_signature_fd(int signature_fd,
                           int data_fd,
@@ -43,7 +58,7 @@ lr_gpg_check_signature_fd(int signature_fd,
     gpgme_signature_t sig;
 
     // Initialization
-    gpgme_check_version(NULL);
+    lr_gpg_init();
     err = gpgme_engine_check_version(GPGME_PROTOCOL_OpenPGP);
     if (err != GPG_ERR_NO_ERROR) {
         DPRINTF("%s: gpgme_engine_check_version: %s\n",
@@ -173,7 +188,7 @@ lr_gpg_import_key(const char *key_fn, const char *home_dir)
     gpgme_data_t key_data;
 
     // Initialization
-    gpgme_check_version(NULL);
+    lr_gpg_init();
     err = gpgme_engine_check_version(GPGME_PROTOCOL_OpenPGP);
     if (err != GPG_ERR_NO_ERROR) {
         DPRINTF("%s: gpgme_engine_check_version: %s\n",
@@ -29,6 +29,12 @@ extern "C" {
  *  @{
  */
 
+/** Initialize the GPGME library. It is called by the functions below,
+ * but in a multithreaded program it has to be called before other
+ * threads are started.
+ */
+void lr_gpg_init(void);
+
 /** Check detached signature of data.
  * @param signature_fd      File descriptor of signature file.
  * @param data_fd           File descriptor of data to verify.
@@ -25,6 +25,7 @@
 #include <string.h>
 #include <assert.h>
 #include <stdarg.h>
+#include <pthread.h>
 #include <curl/curl.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -40,6 +41,8 @@
 #include "version.h"
 #include "curl.h"
 #include "yum_internal.h"
+#include "mirrorstats.h"
+#include "gpg.h"
 
 void
 lr_handle_free_list(char ***list)
@@ -58,6 +61,35 @@ lr_handle_free_list(char ***list)
     *list = NULL;
 }
 
+/** Max number of threads used by lr_handle_perform_many */
+#define LR_PERFORM_MANY_MAXTHREADS  8
+
+/** Create a share handle for the lr_Handle.
+ * @param connections   Share also the connection cache. The connection
+ *                      cache must not be shared among threads.
+ * @return              CURL share handle or NULL if it cannot be created.
+ */
+static CURLSH *
+lr_handle_share_init(int connections)
+{
+    CURLSH *share = curl_share_init();
+
+    if (!share)
+        return NULL;
+
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+    /* Connection cache could be shared since libcurl 7.57.0 */
+    if (connections)
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#else
+    LR_UNUSED(connections);
+#endif
+
+    return share;
+}
+
 lr_Handle
 lr_handle_init()
 {
@@ -70,6 +102,12 @@ lr_handle_init()
     handle = lr_malloc0(sizeof(struct _lr_Handle));
     handle->curl_handle = curl;
     handle->retries = 1;
+    handle->maxparalleldownloads = LRO_MAXPARALLELDOWNLOADS_DEFAULT;
+    handle->maxdownloadspermirror = LRO_MAXDOWNLOADSPERMIRROR_DEFAULT;
+    handle->writebuffersize = LRO_WRITEBUFFERSIZE_DEFAULT;
+    handle->mirrorprobetimeout = LRO_MIRRORPROBETIMEOUT_DEFAULT;
+    handle->segmentsize = LRO_SEGMENTSIZE_DEFAULT;
+    handle->checksumthreads = LRO_CHECKSUMTHREADS_DEFAULT;
     handle->last_curl_error = CURLE_OK;
     handle->last_curlm_error = CURLM_OK;
     handle->checks |= LR_CHECK_CHECKSUM;
@@ -78,6 +116,10 @@ lr_handle_init()
     curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
     curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 6);
 
+    /* Share DNS cache, SSL sessions and connections among all transfers
+     * made with the handle. */
+    handle->curl_share_handle = lr_handle_share_init(1);
+
     return handle;
 }
 
@@ -88,10 +130,20 @@ lr_handle_free(lr_Handle handle)
         return;
     if (handle->curl_handle)
         curl_easy_cleanup(handle->curl_handle);
+    /* Share handle could be cleaned up only when no easy handle uses it */
+    if (handle->curl_share_handle) {
+        CURLSHcode sh_rc = curl_share_cleanup(handle->curl_share_handle);
+        if (sh_rc != CURLSHE_OK)
+            DPRINTF("%s: curl_share_cleanup: %s\n", __func__,
+                    curl_share_strerror(sh_rc));
+    }
     lr_free(handle->baseurl);
     lr_free(handle->mirrorlist);
     lr_free(handle->used_mirror);
     lr_free(handle->destdir);
+    lr_free(handle->mirrorstats);
+    lr_free(handle->olddestdir);
+    lr_free(handle->cachedir);
     lr_internalmirrorlist_free(handle->internal_mirrorlist);
     lr_metalink_free(handle->metalink);
     lr_handle_free_list(&handle->yumdlist);
@@ -226,6 +278,83 @@ lr_handle_setopt(lr_Handle handle, lr_HandleOption option, ...)
         handle->ignoremissing = va_arg(arg, long) ? 1 : 0;
         break;
 
+    case LRO_MAXPARALLELDOWNLOADS:
+        handle->maxparalleldownloads = va_arg(arg, long);
+        if (handle->maxparalleldownloads < 1) {
+            ret = LRE_BADOPTARG;
+            handle->maxparalleldownloads = LRO_MAXPARALLELDOWNLOADS_DEFAULT;
+        }
+        break;
+
+    case LRO_MAXDOWNLOADSPERMIRROR:
+        handle->maxdownloadspermirror = va_arg(arg, long);
+        if (handle->maxdownloadspermirror < 1) {
+            ret = LRE_BADOPTARG;
+            handle->maxdownloadspermirror = LRO_MAXDOWNLOADSPERMIRROR_DEFAULT;
+        }
+        break;
+
+    case LRO_MIRRORPROBE:
+        handle->mirrorprobe = va_arg(arg, long);
+        if (handle->mirrorprobe < 0) {
+            ret = LRE_BADOPTARG;
+            handle->mirrorprobe = 0;
+        }
+        break;
+
+    case LRO_MIRRORPROBETIMEOUT:
+        handle->mirrorprobetimeout = va_arg(arg, long);
+        if (handle->mirrorprobetimeout < 1) {
+            ret = LRE_BADOPTARG;
+            handle->mirrorprobetimeout = LRO_MIRRORPROBETIMEOUT_DEFAULT;
+        }
+        break;
+
+    case LRO_MIRRORSTATS:
+        lr_free(handle->mirrorstats);
+        handle->mirrorstats = lr_strdup(va_arg(arg, char *));
+        break;
+
+    case LRO_SEGMENTS:
+        handle->segments = va_arg(arg, long);
+        if (handle->segments < 0) {
+            ret = LRE_BADOPTARG;
+            handle->segments = 0;
+        }
+        break;
+
+    case LRO_SEGMENTSIZE:
+        handle->segmentsize = va_arg(arg, long);
+        if (handle->segmentsize < 1) {
+            ret = LRE_BADOPTARG;
+            handle->segmentsize = LRO_SEGMENTSIZE_DEFAULT;
+        }
+        break;
+
+    case LRO_IFMODIFIED:
+        handle->ifmodified = va_arg(arg, long) ? 1 : 0;
+        break;
+
+    case LRO_OLDDESTDIR:
+        lr_free(handle->olddestdir);
+        handle->olddestdir = lr_strdup(va_arg(arg, char *));
+        break;
+
+    case LRO_CACHEDIR:
+        lr_free(handle->cachedir);
+        handle->cachedir = lr_strdup(va_arg(arg, char *));
+        break;
+
+    case LRO_DECOMPRESS:
+        handle->decompress = va_arg(arg, lr_Decompress);
+        if (handle->decompress != LR_DECOMPRESS_NONE
+            && handle->decompress != LR_DECOMPRESS_KEEP
+            && handle->decompress != LR_DECOMPRESS_ONLY) {
+            ret = LRE_BADOPTARG;
+            handle->decompress = LR_DECOMPRESS_NONE;
+        }
+        break;
+
     case LRO_GPGCHECK:
         if (va_arg(arg, long))
             handle->checks |= LR_CHECK_GPG;
@@ -240,6 +369,28 @@ lr_handle_setopt(lr_Handle handle, lr_HandleOption option, ...)
             handle->checks &= ~LR_CHECK_CHECKSUM;
         break;
 
+    case LRO_WRITEBUFFERSIZE: {
+        long size = va_arg(arg, long);
+        if (size < 0) {
+            ret = LRE_BADOPTARG;
+            size = LRO_WRITEBUFFERSIZE_DEFAULT;
+        }
+        handle->writebuffersize = (size_t) size;
+        break;
+    }
+
+    case LRO_CHECKSUMCACHE:
+        handle->checksumcache = va_arg(arg, long) ? 1 : 0;
+        break;
+
+    case LRO_CHECKSUMTHREADS:
+        handle->checksumthreads = va_arg(arg, long);
+        if (handle->checksumthreads < 0) {
+            ret = LRE_BADOPTARG;
+            handle->checksumthreads = LRO_CHECKSUMTHREADS_DEFAULT;
+        }
+        break;
+
     case LRO_YUMDLIST:
     case LRO_YUMBLIST: {
         int size = 0;
@@ -321,6 +472,18 @@ lr_handle_last_curlm_strerror(lr_Handle handle)
     return curl_multi_strerror(handle->last_curlm_error);
 }
 
+/** lr_DataCb which feeds the metalink parser */
+static void
+lr_handle_metalink_data_cb(void *data, const char *buf, size_t len)
+{
+    lr_MetalinkParser parser = data;
+
+    if (!buf)
+        lr_metalink_parser_reset(parser);
+    else
+        lr_metalink_parser_feed(parser, buf, len);
+}
+
 int
 lr_handle_prepare_internal_mirrorlist(lr_Handle handle,
                                       const char *metalink_suffix)
@@ -378,28 +541,28 @@ lr_handle_prepare_internal_mirrorlist(lr_Handle handle,
     if (handle->mirrorlist) {
         /* Download and parse metalink or mirrorlist to internal mirrorlist */
         lr_Mirrorlist mirrorlist = NULL;
-        int mirrors_fd = lr_gettmpfile();
-
-        rc = lr_curl_single_download(handle, handle->mirrorlist, mirrors_fd);
-        if (rc != LRE_OK)
-            goto mirrorlist_error;
-
-        if (lseek(mirrors_fd, 0, SEEK_SET) != 0) {
-            rc = LRE_IO;
-            goto mirrorlist_error;
-        }
+        char *mirrors_data = NULL;
+        size_t mirrors_len = 0;
 
         if (strstr(handle->mirrorlist, "metalink")) {
             /* Metalink */
-            DPRINTF("%s: Got metalink\n", __func__);
+            lr_MetalinkParser parser;
 
-            /* Parse metalink */
+            /* Metalink is parsed while it is downloaded */
             metalink = lr_metalink_init();
-            rc = lr_metalink_parse_file(metalink, mirrors_fd, "repomd.xml");
-            if (rc != LRE_OK) {
-                DPRINTF("%s: Cannot parse metalink (%d)\n", __func__, rc);
-                goto mirrorlist_error;
+            parser = lr_metalink_parser_new(metalink, "repomd.xml");
+            rc = lr_curl_single_download_cb(handle, handle->mirrorlist, -1,
+                                            lr_handle_metalink_data_cb,
+                                            parser);
+            if (rc == LRE_OK) {
+                DPRINTF("%s: Got metalink\n", __func__);
+                rc = lr_metalink_parser_finish(parser);
+                if (rc != LRE_OK)
+                    DPRINTF("%s: Cannot parse metalink (%d)\n", __func__, rc);
             }
+            lr_metalink_parser_free(parser);
+            if (rc != LRE_OK)
+                goto mirrorlist_error;
 
             if (strcmp("repomd.xml", metalink->filename)) {
                 DPRINTF("%s: No repomd.xml file in metalink\n", __func__);
@@ -413,11 +576,17 @@ lr_handle_prepare_internal_mirrorlist(lr_Handle handle,
                 goto mirrorlist_error;
             }
         } else {
-            /* Mirrorlist */
+            /* Mirrorlist - it is small, no temporary file is needed */
+            rc = lr_curl_single_download_mem(handle, handle->mirrorlist,
+                                             &mirrors_data, &mirrors_len);
+            if (rc != LRE_OK)
+                goto mirrorlist_error;
+
             DPRINTF("%s: Got mirrorlist\n", __func__);
 
             mirrorlist = lr_mirrorlist_init();
-            rc = lr_mirrorlist_parse_file(mirrorlist, mirrors_fd);
+            rc = lr_mirrorlist_parse_buf(mirrorlist, mirrors_data,
+                                         mirrors_len);
             if (rc != LRE_OK) {
                 DPRINTF("%s: Cannot parse mirrorlist (%d)\n", __func__, rc);
                 goto mirrorlist_error;
@@ -444,16 +613,43 @@ lr_handle_prepare_internal_mirrorlist(lr_Handle handle,
 
 mirrorlist_error:
         lr_mirrorlist_free(mirrorlist);
-        close(mirrors_fd);
+        lr_free(mirrors_data);
         if (rc != LRE_OK) {
             lr_metalink_free(metalink);
             return rc;
         }
     }
 
+    if (handle->mirrorstats) {
+        /* Prefer mirrors which worked well the last time */
+        lr_MirrorStats stats = lr_mirrorstats_load(handle->mirrorstats);
+        lr_mirrorstats_rank(stats, handle->internal_mirrorlist);
+        lr_mirrorstats_free(stats);
+    }
+
     return rc;
 }
 
+void
+lr_handle_probe_internal_mirrorlist(lr_Handle handle, const char *path)
+{
+    int rc;
+    lr_InternalMirrorlist iml = handle->internal_mirrorlist;
+
+    if (!handle->mirrorprobe || !path || !iml || iml->probed
+        || lr_internalmirrorlist_len(iml) < 2)
+        return;
+
+    /* Try the fastest mirrors first */
+    iml->probed = 1;
+    rc = lr_curl_probe_mirrors(handle,
+                               path,
+                               handle->mirrorprobe,
+                               handle->mirrorprobetimeout);
+    if (rc != LRE_OK)
+        DPRINTF("%s: Mirror probe failed (%d)\n", __func__, rc);
+}
+
 
 int
 lr_handle_perform(lr_Handle handle, lr_Result result)
@@ -498,6 +694,170 @@ lr_handle_perform(lr_Handle handle, lr_Result result)
     return rc;
 }
 
+/** Shared state of lr_handle_perform_many workers */
+struct _lr_PerformJobs {
+    lr_Handle *handles;
+    lr_Result *results;
+    int *rcs;               /*!< Return code of each handle */
+    int count;              /*!< Number of handles */
+    int next;               /*!< Index of the next handle to perform */
+    pthread_mutex_t lock;   /*!< Lock for the next */
+    pthread_mutex_t share_locks[CURL_LOCK_DATA_LAST]; /*!< Locks for
+                                     the data of the shared CURLSH */
+};
+
+static void
+lr_handle_share_lock(CURL *c_h,
+                     curl_lock_data data,
+                     curl_lock_access access,
+                     void *userptr)
+{
+    struct _lr_PerformJobs *jobs = userptr;
+
+    LR_UNUSED(c_h);
+    LR_UNUSED(access);
+    pthread_mutex_lock(&jobs->share_locks[data]);
+}
+
+static void
+lr_handle_share_unlock(CURL *c_h, curl_lock_data data, void *userptr)
+{
+    struct _lr_PerformJobs *jobs = userptr;
+
+    LR_UNUSED(c_h);
+    pthread_mutex_unlock(&jobs->share_locks[data]);
+}
+
+static void *
+lr_handle_perform_worker(void *data)
+{
+    struct _lr_PerformJobs *jobs = data;
+
+    for (;;) {
+        int x;
+
+        pthread_mutex_lock(&jobs->lock);
+        x = jobs->next++;
+        pthread_mutex_unlock(&jobs->lock);
+
+        if (x >= jobs->count)
+            break;
+
+        jobs->rcs[x] = lr_handle_perform(jobs->handles[x], jobs->results[x]);
+        DPRINTF("%s: Repository %d rc: %d (%s)\n",
+                __func__, x, jobs->rcs[x], lr_strerror(jobs->rcs[x]));
+    }
+
+    return NULL;
+}
+
+int
+lr_handle_perform_many(lr_Handle *handles,
+                       lr_Result *results,
+                       int count,
+                       int *rcs)
+{
+    int ret = LRE_OK;
+    int started = 0;
+    int nthreads;
+    pthread_t *tids;
+    CURLSH *share;
+    CURLSH **orig_shares;
+    struct _lr_PerformJobs jobs;
+
+    if (count < 0 || (count > 0 && (!handles || !results)))
+        return LRE_BADFUNCARG;
+
+    for (int x = 0; x < count; x++) {
+        if (!handles[x] || !results[x])
+            return LRE_BADFUNCARG;
+        for (int y = 0; y < x; y++)
+            if (handles[y] == handles[x] || results[y] == results[x]) {
+                DPRINTF("%s: Handle or result %d is used more than once\n",
+                        __func__, x);
+                return LRE_BADFUNCARG;
+            }
+    }
+
+    jobs.handles = handles;
+    jobs.results = results;
+    jobs.rcs = rcs ? rcs : lr_malloc0(sizeof(int) * (count + 1));
+    jobs.count = count;
+    jobs.next = 0;
+    pthread_mutex_init(&jobs.lock, NULL);
+    for (int x = 0; x < CURL_LOCK_DATA_LAST; x++)
+        pthread_mutex_init(&jobs.share_locks[x], NULL);
+
+    /* All repositories share one DNS cache and SSL sessions. The share
+     * handle is used from several threads - it needs locks. Connections
+     * are not shared, libcurl doesn't support a connection cache shared
+     * among threads. Own share handles of the handles are restored
+     * at the end. */
+    share = lr_handle_share_init(0);
+    if (share) {
+        curl_share_setopt(share, CURLSHOPT_LOCKFUNC, lr_handle_share_lock);
+        curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, lr_handle_share_unlock);
+        curl_share_setopt(share, CURLSHOPT_USERDATA, &jobs);
+    }
+
+    orig_shares = lr_malloc0(sizeof(CURLSH *) * (count + 1));
+    for (int x = 0; x < count; x++) {
+        orig_shares[x] = handles[x]->curl_share_handle;
+        if (share)
+            handles[x]->curl_share_handle = share;
+        /* Signals cannot be used for timeouts in a multithreaded program,
+         * the option is set only on the duplicated curl handles */
+        handles[x]->nosignal = 1;
+    }
+
+    DPRINTF("%s: Performing %d repositories in parallel\n", __func__, count);
+
+    /* GPGME must be initialized before other threads are started */
+    lr_gpg_init();
+
+    /* The calling thread is one of the workers */
+    nthreads = count < LR_PERFORM_MANY_MAXTHREADS ? count
+                                                  : LR_PERFORM_MANY_MAXTHREADS;
+    tids = lr_malloc0(sizeof(pthread_t) * (nthreads + 1));
+    for (int x = 0; x < nthreads - 1; x++) {
+        if (pthread_create(&tids[started], NULL,
+                           lr_handle_perform_worker, &jobs)) {
+            DPRINTF("%s: Cannot create thread\n", __func__);
+            break;
+        }
+        started++;
+    }
+
+    lr_handle_perform_worker(&jobs);
+
+    for (int x = 0; x < started; x++)
+        pthread_join(tids[x], NULL);
+
+    for (int x = 0; x < count; x++) {
+        handles[x]->curl_share_handle = orig_shares[x];
+        handles[x]->nosignal = 0;
+    }
+    if (share)
+        curl_share_cleanup(share);
+
+    for (int x = 0; x < CURL_LOCK_DATA_LAST; x++)
+        pthread_mutex_destroy(&jobs.share_locks[x]);
+    pthread_mutex_destroy(&jobs.lock);
+    lr_free(orig_shares);
+    lr_free(tids);
+
+    for (int x = 0; x < count; x++)
+        if (jobs.rcs[x] != LRE_OK) {
+            ret = jobs.rcs[x];
+            break;
+        }
+
+    if (!rcs)
+        lr_free(jobs.rcs);
+
+    return ret;
+}
+
 int
 lr_handle_getinfo(lr_Handle handle, lr_HandleOption option, ...)
 {
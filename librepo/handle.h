@@ -87,6 +87,87 @@ typedef enum {
     LRO_YUMBLIST,    /*!< (char **) Do not download this specified records
                           from repomd (blacklist).
                           Note: Last element of the list must be NULL! */
+
+    /* Options added after the ones above must be appended here to keep
+       the values of the existing options stable */
+    LRO_MAXPARALLELDOWNLOADS, /*!< (long) Maximum number of files downloaded
+                                   in parallel. Default is 3. */
+    LRO_MAXDOWNLOADSPERMIRROR,/*!< (long) Maximum number of files downloaded
+                                   in parallel from a single mirror.
+                                   Default is 3. */
+    LRO_CHECKSUMTHREADS, /*!< (long) Number of threads used to check
+                              checksums of a local repository (LRO_LOCAL).
+                              0 means number of online CPUs. Default is 1. */
+    LRO_CHECKSUMCACHE, /*!< (long 1 or 0) Store calculated checksums into
+                            extended attributes of the files and reuse
+                            them while the files are not changed.
+                            Default is 0. */
+    LRO_WRITEBUFFERSIZE, /*!< (long) Size of buffer (in bytes) used to
+                              coalesce small writes of downloaded data.
+                              0 means that data are written directly as
+                              they come. Default is 0. */
+    LRO_MIRRORPROBE, /*!< (long) Number of mirrors (from the beginning of
+                          the mirrorlist) whose speed is measured before
+                          the download. Mirrors are then reordered from
+                          the fastest one. 0 disables the probe.
+                          Default is 0. */
+    LRO_MIRRORPROBETIMEOUT, /*!< (long) Time budget of the mirror probe
+                                 in milliseconds. Mirrors which do not
+                                 respond in time are tried last.
+                                 Default is 2000. */
+    LRO_MIRRORSTATS, /*!< (char *) Path to a file with statistics of
+                          mirrors (success ratio, throughput, time of
+                          the last failure). Statistics are updated after
+                          downloads and used to rank mirrors on the next
+                          run. The file could be shared by several
+                          processes. NULL disables it. Default is NULL. */
+    LRO_SEGMENTS,    /*!< (long) Max number of segments (byte ranges) in
+                          which a single package (lr_download_package)
+                          is downloaded from the mirrors in parallel.
+                          0 or 1 disables segmented download.
+                          Default is 0. */
+    LRO_SEGMENTSIZE, /*!< (long) Min size of a segment in bytes. Smaller
+                          files are downloaded as a whole.
+                          Default is 4194304 (4 MiB). */
+    LRO_IFMODIFIED,  /*!< (long 1 or 0) Download repomd.xml into an existing
+                          destdir only if it was modified since the last
+                          download (HTTP ETag and Last-Modified of the last
+                          download are kept in the destdir). With a metalink,
+                          no mirror is contacted if the local repomd.xml
+                          matches the checksum from the metalink. If it was
+                          not modified, the local repository is untouched,
+                          the result describes it and LRE_NOTMODIFIED is
+                          returned. Default is 0. */
+    LRO_OLDDESTDIR,  /*!< (char *) Destdir of a previous download of the
+                          repository. Metadata files whose checksum didn't
+                          change are hardlinked, reflinked or copied from
+                          there instead of downloaded. NULL disables it.
+                          Default is NULL. */
+    LRO_CACHEDIR,    /*!< (char *) Directory of a content addressed cache
+                          shared by handles and processes. Metadata files
+                          and packages with a known checksum are taken
+                          from it (hardlinked, reflinked or copied) before
+                          any network access and the verified downloads
+                          are stored there. Cached files are always
+                          verified before use. They are read-only copies
+                          of the downloaded files, the files hardlinked
+                          from the cache are read-only too. It is populated only if
+                          LRO_CHECKSUM is enabled. NULL disables it.
+                          Default is NULL. */
+    LRO_DECOMPRESS,  /*!< (::lr_Decompress) Decompress gz, bz2 and xz
+                          metadata files while they are downloaded. The
+                          decompressed file is stored without the suffix
+                          (primary.xml.gz -> primary.xml) and, if
+                          LRO_CHECKSUM is enabled, it is verified against
+                          the open-checksum from repomd.xml. With
+                          LR_DECOMPRESS_ONLY the compressed file is never
+                          stored and the result points to the decompressed
+                          one. Broken compressed data or a mismatch of the
+                          open-checksum fail the download from the mirror
+                          and the next mirror is tried. The decompressed
+                          files are reused from LRO_OLDDESTDIR and stored
+                          to LRO_CACHEDIR under their open-checksum.
+                          Default is LR_DECOMPRESS_NONE. */
     LRO_SENTINEL,    /*!<  */
 } lr_HandleOption; /*!< Handle config options */
 
@@ -149,6 +230,27 @@ int lr_handle_getinfo(lr_Handle handle, lr_HandleOption option, ...);
  */
 int lr_handle_perform(lr_Handle handle, lr_Result result);
 
+/** Perform repodata download or location of several repositories
+ * concurrently. Every repository is performed as by lr_handle_perform
+ * in one of up to 8 threads and all of them share one DNS cache and
+ * SSL sessions. Progress callbacks (LRO_PROGRESSCB) of the handles are
+ * called from different threads.
+ * Every handle and result must be used only once in the lists,
+ * otherwise LRE_BADFUNCARG is returned.
+ * @param handles       Librepo handles.
+ * @param results       Librepo results, one per handle.
+ * @param count         Number of handles.
+ * @param rcs           If not NULL, return code of each handle
+ *                      is stored here (array of count items).
+ * @return              LRE_OK if all repositories were performed
+ *                      successfully, otherwise the first error
+ *                      (from ::lr_Rc enum) in the handles order.
+ */
+int lr_handle_perform_many(lr_Handle *handles,
+                           lr_Result *results,
+                           int count,
+                           int *rcs);
+
 /** Return last encountered cURL error code from cURL.
  * @param handle        Librepo handle.
  * @return              cURL (CURLcode) return code.
@@ -30,8 +30,26 @@ extern "C" {
 #include "handle.h"
 #include "internal_mirrorlist.h"
 
+/** Default value of LRO_MAXPARALLELDOWNLOADS */
+#define LRO_MAXPARALLELDOWNLOADS_DEFAULT    3
+/** Default value of LRO_MAXDOWNLOADSPERMIRROR */
+#define LRO_MAXDOWNLOADSPERMIRROR_DEFAULT   3
+/** Default value of LRO_WRITEBUFFERSIZE */
+#define LRO_WRITEBUFFERSIZE_DEFAULT         0
+/** Default value of LRO_MIRRORPROBETIMEOUT */
+#define LRO_MIRRORPROBETIMEOUT_DEFAULT      2000
+/** Default value of LRO_SEGMENTSIZE */
+#define LRO_SEGMENTSIZE_DEFAULT             4194304
+/** Default value of LRO_CHECKSUMTHREADS */
+#define LRO_CHECKSUMTHREADS_DEFAULT         1
+
 struct _lr_Handle {
     CURL            *curl_handle;   /*!< CURL handle */
+    CURLSH          *curl_share_handle; /*!< CURL share handle - DNS cache,
+                                         SSL sessions and connections
+                                         reused by all transfers */
+    int             nosignal;       /*!< Transfers must not use signals
+                                         (lr_handle_perform_many) */
     int             update;         /*!< Just update existing repo */
     char            *baseurl;       /*!< Base URL of repo */
     char            *mirrorlist;    /*!< Mirrorlist or metalink URL */
@@ -43,12 +61,28 @@ struct _lr_Handle {
     char            *destdir;       /*!< Destination directory */
     lr_Repotype     repotype;       /*!< Type of repository */
     lr_Checks       checks;         /*!< Which check sould be applied */
+    int             checksumthreads; /*!< Number of threads for checksum
+                                          check of local repo (0 - CPUs) */
+    int             checksumcache;  /*!< Use checksum cache (xattr) */
     long            status_code;    /*!< Last HTTP or FTP status code */
     CURLcode        last_curl_error;/*!< Last curl error code */
     CURLMcode       last_curlm_error;/*!< Last curl multi handle error code */
     lr_ProgressCb   user_cb;        /*!< User progress callback */
     void            *user_data;     /*!< User data for callback */
     int             ignoremissing;  /*!< Ignore missing metadata files */
+    int             maxparalleldownloads; /*!< Max parallel downloads */
+    int             maxdownloadspermirror; /*!< Max parallel downloads
+                                                from a single mirror */
+    size_t          writebuffersize; /*!< Size of write buffer */
+    int             mirrorprobe;    /*!< Number of mirrors to probe */
+    long            mirrorprobetimeout; /*!< Time budget of the probe (ms) */
+    char            *mirrorstats;   /*!< Path to the mirror statistics file */
+    int             segments;       /*!< Max segments of a download */
+    long long       segmentsize;    /*!< Min size of a segment */
+    int             ifmodified;     /*!< Conditional download of repomd */
+    char            *olddestdir;    /*!< Previous copy of the repository */
+    char            *cachedir;      /*!< Content addressed cache */
+    lr_Decompress   decompress;     /*!< Decompression of metadata */
     char            **yumdlist;     /*!< Repomd data typenames to download
                                         NULL - Download all
                                         yumdlist[0] = NULL - Only repomd.xml */
@@ -63,11 +97,24 @@ struct _lr_Handle {
  * @param handle            Librepo handle.
  * @param metalink_suffix   Suffix of metalink mirror urls that will be removed
  *                          (e.g. "repodata/repomd.xml").
+ *                          Mirrors are ranked by LRO_MIRRORSTATS (if set).
  *  @return                 Librepo return code.
  */
 int lr_handle_prepare_internal_mirrorlist(lr_Handle handle,
                                           const char *metalink_suffix);
 
+/**
+ * If LRO_MIRRORPROBE is set, probe the speed of the mirrors in the
+ * internal mirrorlist and reorder it from the fastest one. The probe
+ * is done only once per internal mirrorlist. Failed probe is not fatal,
+ * the mirrors are just used in the original order.
+ * @param handle            Librepo handle.
+ * @param path              Path of the file (relative to the mirror
+ *                          urls) which is used to probe the mirrors
+ *                          (e.g. "repodata/repomd.xml").
+ */
+void lr_handle_probe_internal_mirrorlist(lr_Handle handle, const char *path);
+
 
 #ifdef __cplusplus
 }
@@ -33,10 +33,11 @@ lr_internalmirrorlist_append_url(lr_InternalMirrorlist iml, const char *url)
     if (!iml || !url)
         return;
 
-    im = lr_malloc(sizeof(struct _lr_InternalMirror));
+    im = lr_malloc0(sizeof(struct _lr_InternalMirror));
     im->url = lr_strdup(url);
     im->preference = 100;
     im->fails = 0;
+    im->probe_time = -1.0;
 
     iml->nom++;
     iml->mirrors = lr_realloc(iml->mirrors, sizeof(lr_InternalMirror *) * iml->nom);
@@ -66,10 +67,11 @@ lr_internalmirrorlist_append_mirrorlist(lr_InternalMirrorlist iml, lr_Mirrorlist
             continue;  // No url present
         }
 
-        im = lr_malloc(sizeof(struct _lr_InternalMirror));
+        im = lr_malloc0(sizeof(struct _lr_InternalMirror));
         im->url = lr_strdup(ml->urls[x]);
         im->preference = 100;
         im->fails = 0;
+        im->probe_time = -1.0;
         iml->mirrors[current_id] = im;
         current_id++;
     }
@@ -104,7 +106,7 @@ lr_internalmirrorlist_append_metalink(lr_InternalMirrorlist iml,
             continue;  // No url present
         }
 
-        im = lr_malloc(sizeof(struct _lr_InternalMirror));
+        im = lr_malloc0(sizeof(struct _lr_InternalMirror));
         im->url = lr_strdup(url);
         if (suffix_len) {
             /* Remove suffix if necessary */
@@ -114,11 +116,35 @@ lr_internalmirrorlist_append_metalink(lr_InternalMirrorlist iml,
         }
         im->preference = ml->urls[x]->preference;
         im->fails = 0;
+        im->probe_time = -1.0;
         iml->mirrors[current_id] = im;
         current_id++;
     }
 }
 
+void
+lr_internalmirrorlist_sort_by_probe(lr_InternalMirrorlist iml)
+{
+    if (!iml)
+        return;
+
+    /* Insertion sort - it is stable and the list is short */
+    for (int x = 1; x < iml->nom; x++) {
+        lr_InternalMirror im = iml->mirrors[x];
+        int y = x;
+
+        if (im->probe_time < 0)
+            continue;  /* Only probed mirrors are moved forward */
+
+        while (y > 0 && (iml->mirrors[y-1]->probe_time < 0
+                         || iml->mirrors[y-1]->probe_time > im->probe_time)) {
+            iml->mirrors[y] = iml->mirrors[y-1];
+            y--;
+        }
+        iml->mirrors[y] = im;
+    }
+}
+
 lr_InternalMirror
 lr_internalmirrorlist_get(lr_InternalMirrorlist iml, int i)
 {
@@ -24,14 +24,25 @@
 extern "C" {
 #endif
 
+#include <time.h>
+
 #include "mirrorlist.h"
 #include "metalink.h"
 
-/** A mirror of internal mirrorlist */
+/** A mirror of internal mirrorlist.
+ * Download results (fails, successes, bytes, seconds, last_failure) are
+ * reset when they are saved to the LRO_MIRRORSTATS file. */
 struct _lr_InternalMirror {
     char *url;      /*!< URL of the mirror */
     int preference; /*!< Integer number 1-100 - higher is better */
     int fails;      /*!< Number of failed downloads from this mirror */
+    int successes;  /*!< Number of successful downloads from this mirror */
+    long long bytes;/*!< Bytes downloaded from this mirror */
+    double seconds; /*!< Time spent by downloading the bytes */
+    time_t last_failure; /*!< Time of the last failed download or 0 */
+    double probe_time; /*!< Estimated download time (in seconds) measured
+                            by the mirror probe. Negative value means that
+                            the mirror was not probed or the probe failed */
 };
 
 /** Pointer to ::_lr_InternalMirror */
@@ -41,6 +52,8 @@ typedef struct _lr_InternalMirror * lr_InternalMirror;
 struct _lr_InternalMirrorlist {
     struct _lr_InternalMirror **mirrors;    /*!< Mirrorlist */
     int nom;                                /*!< Number of mirrors */
+    int probed;                             /*!< 1 if the mirror probe
+                                                 was already done */
 };
 
 /** Pointer to _lr_InternalMirrorlist */
@@ -84,6 +97,14 @@ void lr_internalmirrorlist_append_metalink(lr_InternalMirrorlist iml,
                                            lr_Metalink metalink,
                                            const char *suffix);
 
+/**
+ * Reorder mirrors by the results of the mirror probe. Successfully
+ * probed mirrors are moved to the beginning of the list (the fastest
+ * one first). Other mirrors keep their relative order.
+ * @param iml           Internal mirrorlist.
+ */
+void lr_internalmirrorlist_sort_by_probe(lr_InternalMirrorlist iml);
+
 /**
  * Get mirror on the selected position.
  * @param iml           Internal mirrorlist.
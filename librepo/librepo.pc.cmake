@@ -5,7 +5,7 @@ includedir=@CMAKE_INSTALL_PREFIX@/include
 Name: librepo
 Description: Repodata downloading library.
 Version: @VERSION@
-Requires.private: libcurl openssl
+Requires.private: libcurl openssl zlib liblzma
 Libs: -L${libdir} -lrepo
-Libs.private: -lexpat -gpgme -gpg-error
+Libs.private: -lexpat -gpgme -gpg-error -lbz2
 Cflags: -I${includedir} -D_FILE_OFFSET_BITS=64
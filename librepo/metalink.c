@@ -94,7 +94,7 @@ lr_metalink_init()
 }
 
 void
-lr_metalink_free(lr_Metalink metalink)
+lr_metalink_clear(lr_Metalink metalink)
 {
     if (!metalink)
         return;
@@ -105,6 +105,15 @@ lr_metalink_free(lr_Metalink metalink)
     for (int x = 0; x < metalink->nou; x++)
         lr_free_metalinkurl(metalink->urls[x]);
     lr_free(metalink->urls);
+    memset(metalink, 0, sizeof(struct _lr_Metalink));
+}
+
+void
+lr_metalink_free(lr_Metalink metalink)
+{
+    if (!metalink)
+        return;
+    lr_metalink_clear(metalink);
     lr_free(metalink);
 }
 
@@ -379,50 +388,122 @@ lr_metalink_end_handler(void *pdata, const char *name)
     return;
 }
 
-int
-lr_metalink_parse_file(lr_Metalink metalink, int fd, const char *filename)
+/** Incremental (push) parser of metalink */
+struct _lr_MetalinkParser {
+    XML_Parser parser;      /*!< expat parser */
+    ParserData pd;          /*!< parser state */
+    lr_Metalink metalink;   /*!< filled metalink object */
+    char *filename;         /*!< file to look for in metalink */
+    int ret;                /*!< status of parsing (first error) */
+};
+
+/** Create expat parser and initialize parser data */
+static void
+lr_metalink_parser_setup(lr_MetalinkParser p)
 {
-    int ret = LRE_OK;
-    XML_Parser parser;
-    ParserData pd;
     lr_StatesSwitch *sw;
-
-    assert(metalink);
-    DEBUGASSERT(fd >= 0);
+    ParserData *pd = &p->pd;
 
     /* Parser configuration */
-    parser = XML_ParserCreate(NULL);
-    XML_SetUserData(parser, (void *) &pd);
-    XML_SetElementHandler(parser, lr_metalink_start_handler, lr_metalink_end_handler);
-    XML_SetCharacterDataHandler(parser, lr_metalink_char_handler);
+    p->parser = XML_ParserCreate(NULL);
+    XML_SetUserData(p->parser, (void *) pd);
+    XML_SetElementHandler(p->parser, lr_metalink_start_handler, lr_metalink_end_handler);
+    XML_SetCharacterDataHandler(p->parser, lr_metalink_char_handler);
 
     /* Initialization of parser data */
-    memset(&pd, 0, sizeof(pd));
-    pd.ret = LRE_OK;
-    pd.depth = 0;
-    pd.state = STATE_START;
-    pd.statedepth = 0;
-    pd.docontent = 0;
-    pd.content = lr_malloc(CONTENT_REALLOC_STEP);
-    pd.lcontent = 0;
-    pd.acontent = CONTENT_REALLOC_STEP;
-    pd.parser = &parser;
-    pd.metalink = metalink;
-    pd.filename = (char *) filename;
-    pd.ignore = 1;
-    pd.found = 0;
+    memset(pd, 0, sizeof(*pd));
+    pd->ret = LRE_OK;
+    pd->depth = 0;
+    pd->state = STATE_START;
+    pd->statedepth = 0;
+    pd->docontent = 0;
+    pd->content = lr_malloc(CONTENT_REALLOC_STEP);
+    pd->lcontent = 0;
+    pd->acontent = CONTENT_REALLOC_STEP;
+    pd->parser = &p->parser;
+    pd->metalink = p->metalink;
+    pd->filename = p->filename;
+    pd->ignore = 1;
+    pd->found = 0;
     for (sw = stateswitches; sw->from != NUMSTATES; sw++) {
-        if (!pd.swtab[sw->from])
-            pd.swtab[sw->from] = sw;
-        pd.sbtab[sw->to] = sw->from;
+        if (!pd->swtab[sw->from])
+            pd->swtab[sw->from] = sw;
+        pd->sbtab[sw->to] = sw->from;
     }
 
-    /* Parse */
-    for (;;) {
-        char *buf;
-        int len;
+    p->ret = LRE_OK;
+}
+
+/** Free expat parser and parser data */
+static void
+lr_metalink_parser_cleanup(lr_MetalinkParser p)
+{
+    lr_free(p->pd.content);
+    p->pd.content = NULL;
+    XML_ParserFree(p->parser);
+    p->parser = NULL;
+}
+
+/** Check result of the last XML_Parse or XML_ParseBuffer call */
+static int
+lr_metalink_parser_check(lr_MetalinkParser p, int rc)
+{
+    if (!rc) {
+        DPRINTF("%s: parsing error: %s\n", __func__,
+                XML_ErrorString(XML_GetErrorCode(p->parser)));
+        p->ret = LRE_MLXML;
+    } else if (p->pd.ret != LRE_OK) {
+        p->ret = p->pd.ret;
+    }
+
+    return p->ret;
+}
+
+lr_MetalinkParser
+lr_metalink_parser_new(lr_Metalink metalink, const char *filename)
+{
+    lr_MetalinkParser p;
+
+    assert(metalink);
+
+    p = lr_malloc0(sizeof(struct _lr_MetalinkParser));
+    p->metalink = metalink;
+    p->filename = lr_strdup(filename);
+    lr_metalink_parser_setup(p);
+    return p;
+}
+
+void
+lr_metalink_parser_reset(lr_MetalinkParser p)
+{
+    assert(p);
+    lr_metalink_parser_cleanup(p);
+    lr_metalink_clear(p->metalink);
+    lr_metalink_parser_setup(p);
+}
+
+int
+lr_metalink_parser_feed(lr_MetalinkParser p, const char *buf, size_t len)
+{
+    assert(p);
+
+    while (len > 0 && p->ret == LRE_OK) {
+        int chunk = (len > CHUNK_SIZE) ? CHUNK_SIZE : (int) len;
+        lr_metalink_parser_check(p, XML_Parse(p->parser, buf, chunk, 0));
+        buf += chunk;
+        len -= chunk;
+    }
+
+    return p->ret;
+}
 
-        buf = XML_GetBuffer(parser, CHUNK_SIZE);
+/** Read the whole file and feed it to the parser */
+static int
+lr_metalink_parser_feed_fd(lr_MetalinkParser p, int fd)
+{
+    while (p->ret == LRE_OK) {
+        int len;
+        char *buf = XML_GetBuffer(p->parser, CHUNK_SIZE);
         if (!buf)
             lr_out_of_memory();
 
@@ -430,32 +511,72 @@ lr_metalink_parse_file(lr_Metalink metalink, int fd, const char *filename)
         if (len < 0) {
             DPRINTF("%s: Cannot read for parsing : %s\n",
                     __func__, strerror(errno));
-            ret = LRE_IO;
-            break;
-        }
-
-        if (!XML_ParseBuffer(parser, len, len == 0)) {
-            DPRINTF("%s: parsing error: %s\n",
-                    __func__, XML_ErrorString(XML_GetErrorCode(parser)));
-            ret = LRE_MLXML;
+            p->ret = LRE_IO;
             break;
         }
 
         if (len == 0)
             break;
 
-        if (pd.ret != LRE_OK) {
-            ret = pd.ret;
-            break;
-        }
+        lr_metalink_parser_check(p, XML_ParseBuffer(p->parser, len, 0));
     }
 
-    /* Parser data cleanup */
-    lr_free(pd.content);
-    XML_ParserFree(parser);
+    return p->ret;
+}
 
-    if (!pd.found)
+int
+lr_metalink_parser_finish(lr_MetalinkParser p)
+{
+    assert(p);
+
+    if (p->ret == LRE_OK)
+        lr_metalink_parser_check(p, XML_Parse(p->parser, NULL, 0, 1));
+
+    if (!p->pd.found)
         return LRE_MLBAD; /* The wanted file was not found in metalink */
 
+    return p->ret;
+}
+
+void
+lr_metalink_parser_free(lr_MetalinkParser p)
+{
+    if (!p)
+        return;
+    lr_metalink_parser_cleanup(p);
+    lr_free(p->filename);
+    lr_free(p);
+}
+
+int
+lr_metalink_parse_file(lr_Metalink metalink, int fd, const char *filename)
+{
+    lr_MetalinkParser p;
+    int ret;
+
+    DEBUGASSERT(fd >= 0);
+
+    p = lr_metalink_parser_new(metalink, filename);
+    lr_metalink_parser_feed_fd(p, fd);
+    ret = lr_metalink_parser_finish(p);
+    lr_metalink_parser_free(p);
+    return ret;
+}
+
+int
+lr_metalink_parse_buf(lr_Metalink metalink,
+                      const char *buf,
+                      size_t len,
+                      const char *filename)
+{
+    lr_MetalinkParser p;
+    int ret;
+
+    assert(buf || len == 0);
+
+    p = lr_metalink_parser_new(metalink, filename);
+    lr_metalink_parser_feed(p, buf, len);
+    ret = lr_metalink_parser_finish(p);
+    lr_metalink_parser_free(p);
     return ret;
 }
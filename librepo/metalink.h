@@ -24,6 +24,8 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
+
 /** Single checksum for the metalink target file. */
 struct _lr_MetalinkHash {
     char *type;     /*!< Type of checksum (e.g. "md5", "sha1", "sha256", ... */
@@ -77,12 +79,78 @@ lr_Metalink lr_metalink_init();
  */
 int lr_metalink_parse_file(lr_Metalink metalink, int fd, const char *filename);
 
+/**
+ * Parse metalink from the memory buffer.
+ * @param metalink      Metalink object.
+ * @param buf           Metalink content.
+ * @param len           Length of the content.
+ * @param filename      File to look for in metalink file.
+ * @return              Librepo return code ::lr_Rc.
+ */
+int lr_metalink_parse_buf(lr_Metalink metalink,
+                          const char *buf,
+                          size_t len,
+                          const char *filename);
+
+/**
+ * Free all metalink content (the object itself remains empty).
+ * @param metalink      Metalink object.
+ */
+void lr_metalink_clear(lr_Metalink metalink);
+
 /**
  * Free metalink object and all its content.
  * @param metalink      Metalink object.
  */
 void lr_metalink_free(lr_Metalink metalink);
 
+/** Incremental (push) metalink parser. The data could be fed to the
+ * parser in arbitrary pieces as they arrive (e.g. from the network).
+ */
+typedef struct _lr_MetalinkParser * lr_MetalinkParser;
+
+/**
+ * Create new incremental metalink parser.
+ * @param metalink      Empty metalink object which will be filled.
+ * @param filename      File to look for in metalink file.
+ * @return              New parser.
+ */
+lr_MetalinkParser lr_metalink_parser_new(lr_Metalink metalink,
+                                         const char *filename);
+
+/**
+ * Parse next piece of metalink.
+ * @param parser        Metalink parser.
+ * @param buf           Data.
+ * @param len           Length of the data.
+ * @return              Librepo return code ::lr_Rc. After the first
+ *                      error the rest of the data is ignored and the
+ *                      same error is returned.
+ */
+int lr_metalink_parser_feed(lr_MetalinkParser parser,
+                            const char *buf,
+                            size_t len);
+
+/**
+ * Throw away everything parsed so far (content of the metalink object
+ * is cleared) and start again from the beginning of the document.
+ * @param parser        Metalink parser.
+ */
+void lr_metalink_parser_reset(lr_MetalinkParser parser);
+
+/**
+ * Finish parsing - the whole document was fed to the parser.
+ * @param parser        Metalink parser.
+ * @return              Librepo return code ::lr_Rc.
+ */
+int lr_metalink_parser_finish(lr_MetalinkParser parser);
+
+/**
+ * Free the parser (metalink object is not freed).
+ * @param parser        Metalink parser.
+ */
+void lr_metalink_parser_free(lr_MetalinkParser parser);
+
 #ifdef __cplusplus
 }
 #endif
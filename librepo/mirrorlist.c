@@ -62,6 +62,33 @@ lr_mirrorlist_append_url(lr_Mirrorlist m, char *url)
     return;
 }
 
+/** Parse a single line of mirrorlist. The line is modified. */
+static void
+lr_mirrorlist_parse_line(lr_Mirrorlist mirrorlist, char *p)
+{
+    int l;
+
+    /* Skip leading white characters */
+    while (*p == ' ' || *p == '\t')
+        p++;
+
+    if (!*p || *p == '#')
+        return;  /* End of string or comment */
+
+    l = strlen(p);
+    /* Remove trailing white characters */
+    while (l > 0 && (p[l-1] == ' ' || p[l-1] == '\n' || p[l-1] == '\t'))
+        l--;
+    p[l] = '\0';
+
+    if (!l)
+        return;
+
+    /* Append URL */
+    if (p[0] != '\0' && (strstr(p, "://") || p[0] == '/'))
+        lr_mirrorlist_append_url(mirrorlist, lr_strdup(p));
+}
+
 int
 lr_mirrorlist_parse_file(lr_Mirrorlist mirrorlist, int fd)
 {
@@ -77,31 +104,34 @@ lr_mirrorlist_parse_file(lr_Mirrorlist mirrorlist, int fd)
         return LRE_IO;
     }
 
-    while ((p = fgets(buf, BUF_LEN, f))) {
-        int l;
+    while ((p = fgets(buf, BUF_LEN, f)))
+        lr_mirrorlist_parse_line(mirrorlist, p);
 
-        /* Skip leading white characters */
-        while (*p == ' ' || *p == '\t')
-            p++;
-
-        if (!*p || *p == '#')
-            continue;  /* End of string or comment */
+    fclose(f);
 
-        l = strlen(p);
-        /* Remove trailing white characters */
-        while (l > 0 && (p[l-1] == ' ' || p[l-1] == '\n' || p[l-1] == '\t'))
-            l--;
-        p[l] = '\0';
+    return LRE_OK;
+}
 
-        if (!l)
-            continue;
+int
+lr_mirrorlist_parse_buf(lr_Mirrorlist mirrorlist, const char *buf, size_t len)
+{
+    char line[BUF_LEN];
+    const char *end = buf + len;
 
-        /* Append URL */
-        if (p[0] != '\0' && (strstr(p, "://") || p[0] == '/'))
-            lr_mirrorlist_append_url(mirrorlist, lr_strdup(p));
+    assert(mirrorlist);
+    assert(buf || len == 0);
+
+    while (buf < end) {
+        /* Same line splitting as fgets() does in lr_mirrorlist_parse_file */
+        size_t l = 0;
+        while (buf < end && l < BUF_LEN - 1) {
+            line[l++] = *buf;
+            if (*buf++ == '\n')
+                break;
+        }
+        line[l] = '\0';
+        lr_mirrorlist_parse_line(mirrorlist, line);
     }
 
-    fclose(f);
-
     return LRE_OK;
 }
@@ -24,6 +24,8 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
+
 /** Mirrorlist */
 struct _lr_Mirrorlist {
     char **urls;    /*!< List of URLs, could be NULL */
@@ -48,6 +50,17 @@ lr_Mirrorlist lr_mirrorlist_init();
  */
 int lr_mirrorlist_parse_file(lr_Mirrorlist mirrorlist, int fd);
 
+/**
+ * Parse mirrorlist from the memory buffer.
+ * @param mirrorlist    Mirrorlist object.
+ * @param buf           Content of mirrorlist.
+ * @param len           Length of the content.
+ * @return              Librepo return code ::lr_Rc.
+ */
+int lr_mirrorlist_parse_buf(lr_Mirrorlist mirrorlist,
+                            const char *buf,
+                            size_t len);
+
 /**
  * Free mirrorlist and all its content.
  * @param mirrorlist    Mirrorlist object.
@@ -0,0 +1,330 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2012  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "setup.h"
+#include "rcodes.h"
+#include "util.h"
+#include "mirrorstats.h"
+
+#define LR_MIRRORSTATS_MAGIC        0x534d524c  /* "LRMS" */
+#define LR_MIRRORSTATS_VERSION      1
+#define LR_MIRRORSTATS_MAXRECORDS   4096    /* Max number of mirrors */
+#define LR_MIRRORSTATS_MAXCOUNT     1000    /* When a mirror has more
+                                               downloads, its counters are
+                                               halved to prefer recent
+                                               results */
+#define LR_MIRRORSTATS_BACKOFF      86400   /* For how long (sec) a mirror
+                                               which mostly fails is
+                                               tried last */
+
+/** Header of the statistics file */
+struct _lr_MirrorStatsHeader {
+    uint32_t magic;     /*!< LR_MIRRORSTATS_MAGIC */
+    uint32_t version;   /*!< LR_MIRRORSTATS_VERSION */
+    uint32_t count;     /*!< Number of records behind the header */
+    uint32_t reserved;  /*!< Unused */
+};
+
+/** Ranking of a mirror used by lr_mirrorstats_rank */
+struct _lr_MirrorRank {
+    lr_InternalMirror mirror;
+    int group;          /*!< 0 - known, 1 - unknown, 2 - mostly failing */
+    double key;         /*!< Order inside the group (lower is better) */
+};
+
+/** FNV-1a hash of the url */
+static uint64_t
+lr_mirrorstats_hash(const char *url)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (; *url; url++) {
+        hash ^= (unsigned char) *url;
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+/** Read all records from the opened (and locked) file */
+static lr_MirrorStats
+lr_mirrorstats_read(int fd)
+{
+    size_t size;
+    struct _lr_MirrorStatsHeader hdr;
+    lr_MirrorStats stats = lr_malloc0(sizeof(struct _lr_MirrorStats));
+
+    if (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+        return stats;  /* Empty (new) file */
+
+    if (hdr.magic != LR_MIRRORSTATS_MAGIC
+        || hdr.version != LR_MIRRORSTATS_VERSION
+        || hdr.count > LR_MIRRORSTATS_MAXRECORDS)
+    {
+        DPRINTF("%s: Bad header - statistics are ignored\n", __func__);
+        return stats;
+    }
+
+    if (hdr.count == 0)
+        return stats;
+
+    size = hdr.count * sizeof(struct _lr_MirrorStat);
+    stats->stats = lr_malloc(size);
+    if (pread(fd, stats->stats, size, sizeof(hdr)) != (ssize_t) size) {
+        DPRINTF("%s: Truncated file - statistics are ignored\n", __func__);
+        lr_free(stats->stats);
+        stats->stats = NULL;
+        return stats;
+    }
+    stats->count = hdr.count;
+
+    return stats;
+}
+
+/** Write all records to the opened (and locked) file */
+static int
+lr_mirrorstats_write(int fd, lr_MirrorStats stats)
+{
+    size_t size = stats->count * sizeof(struct _lr_MirrorStat);
+    struct _lr_MirrorStatsHeader hdr = {
+        .magic = LR_MIRRORSTATS_MAGIC,
+        .version = LR_MIRRORSTATS_VERSION,
+        .count = stats->count,
+        .reserved = 0,
+    };
+
+    if (pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)
+        || (size && pwrite(fd, stats->stats, size, sizeof(hdr)) != (ssize_t) size)
+        || ftruncate(fd, sizeof(hdr) + size) == -1)
+    {
+        DPRINTF("%s: Cannot write statistics: %s\n", __func__, strerror(errno));
+        return LRE_IO;
+    }
+
+    return LRE_OK;
+}
+
+lr_MirrorStats
+lr_mirrorstats_load(const char *path)
+{
+    int fd;
+    lr_MirrorStats stats;
+
+    fd = open(path, O_RDONLY|O_CLOEXEC);
+    if (fd == -1) {
+        if (errno != ENOENT)
+            DPRINTF("%s: Cannot open %s: %s\n", __func__, path, strerror(errno));
+        return lr_malloc0(sizeof(struct _lr_MirrorStats));
+    }
+
+    /* Do not read the file while other process writes it */
+    if (flock(fd, LOCK_SH) == -1)
+        DPRINTF("%s: flock: %s\n", __func__, strerror(errno));
+
+    stats = lr_mirrorstats_read(fd);
+    close(fd);  /* Releases the lock */
+
+    return stats;
+}
+
+void
+lr_mirrorstats_free(lr_MirrorStats stats)
+{
+    if (!stats)
+        return;
+    lr_free(stats->stats);
+    lr_free(stats);
+}
+
+lr_MirrorStat
+lr_mirrorstats_get(lr_MirrorStats stats, const char *url)
+{
+    uint64_t hash;
+
+    if (!stats || !url)
+        return NULL;
+
+    hash = lr_mirrorstats_hash(url);
+    for (int x = 0; x < stats->count; x++)
+        if (stats->stats[x].url_hash == hash)
+            return &stats->stats[x];
+
+    return NULL;
+}
+
+void
+lr_mirrorstats_rank(lr_MirrorStats stats, lr_InternalMirrorlist iml)
+{
+    int nom;
+    time_t now = time(NULL);
+    struct _lr_MirrorRank *ranks;
+
+    if (!stats || !iml || stats->count == 0)
+        return;
+
+    nom = lr_internalmirrorlist_len(iml);
+    if (nom < 2)
+        return;
+
+    ranks = lr_malloc0(nom * sizeof(struct _lr_MirrorRank));
+    for (int x = 0; x < nom; x++) {
+        lr_MirrorStat st;
+        struct _lr_MirrorRank *rank = &ranks[x];
+
+        rank->mirror = lr_internalmirrorlist_get(iml, x);
+        rank->group = 1;
+        rank->key = 0.0;
+
+        st = lr_mirrorstats_get(stats, rank->mirror->url);
+        if (!st)
+            continue;
+
+        if (st->failures > st->successes
+            && st->last_failure + LR_MIRRORSTATS_BACKOFF > (int64_t) now)
+        {
+            rank->group = 2;
+        } else if (st->successes && st->bytes && st->seconds > 0) {
+            /* Time per byte, penalized by the ratio of failures */
+            rank->group = 0;
+            rank->key = st->seconds / st->bytes
+                        * (st->successes + st->failures) / st->successes;
+        }
+
+        DPRINTF("%s: %s: %u ok, %u failed, %.0f B/s -> group %d\n",
+                __func__, rank->mirror->url, st->successes, st->failures,
+                (st->seconds > 0) ? st->bytes / st->seconds : 0.0,
+                rank->group);
+    }
+
+    /* Insertion sort - it is stable and the list is short */
+    for (int x = 1; x < nom; x++) {
+        struct _lr_MirrorRank rank = ranks[x];
+        int y = x;
+
+        while (y > 0 && (ranks[y-1].group > rank.group
+                         || (ranks[y-1].group == rank.group
+                             && ranks[y-1].key > rank.key))) {
+            ranks[y] = ranks[y-1];
+            y--;
+        }
+        ranks[y] = rank;
+    }
+
+    for (int x = 0; x < nom; x++)
+        iml->mirrors[x] = ranks[x].mirror;
+
+    lr_free(ranks);
+}
+
+int
+lr_mirrorstats_save(const char *path, lr_InternalMirrorlist iml)
+{
+    int fd;
+    int ret;
+    int nom;
+    int changed = 0;
+    lr_MirrorStats stats;
+
+    if (!path || !iml)
+        return LRE_BADFUNCARG;
+
+    nom = lr_internalmirrorlist_len(iml);
+    for (int x = 0; x < nom; x++)
+        if (iml->mirrors[x]->successes || iml->mirrors[x]->fails)
+            changed = 1;
+
+    if (!changed)
+        return LRE_OK;
+
+    fd = open(path, O_RDWR|O_CREAT|O_CLOEXEC, 0644);
+    if (fd == -1) {
+        DPRINTF("%s: Cannot open %s: %s\n", __func__, path, strerror(errno));
+        return LRE_IO;
+    }
+
+    /* Other processes could update the file at the same time */
+    if (flock(fd, LOCK_EX) == -1) {
+        DPRINTF("%s: flock: %s\n", __func__, strerror(errno));
+        close(fd);
+        return LRE_IO;
+    }
+
+    stats = lr_mirrorstats_read(fd);
+
+    for (int x = 0; x < nom; x++) {
+        lr_MirrorStat st;
+        lr_InternalMirror im = iml->mirrors[x];
+
+        if (!im->successes && !im->fails)
+            continue;
+
+        st = lr_mirrorstats_get(stats, im->url);
+        if (!st && stats->count < LR_MIRRORSTATS_MAXRECORDS) {
+            stats->count++;
+            stats->stats = lr_realloc(stats->stats,
+                            stats->count * sizeof(struct _lr_MirrorStat));
+            st = &stats->stats[stats->count-1];
+            memset(st, 0, sizeof(struct _lr_MirrorStat));
+            st->url_hash = lr_mirrorstats_hash(im->url);
+        }
+
+        if (st) {
+            st->successes += im->successes;
+            st->failures += im->fails;
+            st->bytes += im->bytes;
+            st->seconds += im->seconds;
+            if (im->last_failure > st->last_failure)
+                st->last_failure = im->last_failure;
+
+            if (st->successes + st->failures > LR_MIRRORSTATS_MAXCOUNT) {
+                st->successes /= 2;
+                st->failures /= 2;
+                st->bytes /= 2;
+                st->seconds /= 2;
+            }
+        }
+
+        im->successes = 0;
+        im->fails = 0;
+        im->bytes = 0;
+        im->seconds = 0.0;
+        im->last_failure = 0;
+    }
+
+    ret = lr_mirrorstats_write(fd, stats);
+
+    lr_mirrorstats_free(stats);
+    close(fd);  /* Releases the lock */
+
+    return ret;
+}
@@ -0,0 +1,104 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2012  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#ifndef LR_MIRRORSTATS_H
+#define LR_MIRRORSTATS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "internal_mirrorlist.h"
+
+/* Statistics of mirrors are kept in a small binary file shared
+ * by all processes which use the same LRO_MIRRORSTATS path.
+ * The file consists of a header followed by fixed size records
+ * (native byte order). Every update is done under an exclusive
+ * flock() of the file. */
+
+/** Statistics of a mirror */
+struct _lr_MirrorStat {
+    uint64_t url_hash;      /*!< Hash of the mirror url */
+    uint32_t successes;     /*!< Number of successful downloads */
+    uint32_t failures;      /*!< Number of failed downloads */
+    uint64_t bytes;         /*!< Bytes downloaded from the mirror */
+    double seconds;         /*!< Time spent by downloading the bytes */
+    int64_t last_failure;   /*!< Time of the last failure or 0 */
+};
+
+/** Pointer to ::_lr_MirrorStat */
+typedef struct _lr_MirrorStat * lr_MirrorStat;
+
+/** Statistics of all known mirrors */
+struct _lr_MirrorStats {
+    struct _lr_MirrorStat *stats;   /*!< Records */
+    int count;                      /*!< Number of records */
+};
+
+/** Pointer to ::_lr_MirrorStats */
+typedef struct _lr_MirrorStats * lr_MirrorStats;
+
+/**
+ * Load statistics from the file. Missing or corrupted file
+ * results in empty statistics.
+ * @param path          Path to the statistics file.
+ * @return              New allocated statistics.
+ */
+lr_MirrorStats lr_mirrorstats_load(const char *path);
+
+/**
+ * Free statistics.
+ * @param stats         Statistics.
+ */
+void lr_mirrorstats_free(lr_MirrorStats stats);
+
+/**
+ * Get statistics of the mirror.
+ * @param stats         Statistics.
+ * @param url           Url of the mirror.
+ * @return              Statistics of the mirror or NULL if not known.
+ */
+lr_MirrorStat lr_mirrorstats_get(lr_MirrorStats stats, const char *url);
+
+/**
+ * Reorder mirrors by the statistics. Known mirrors go first (from
+ * the fastest one), then mirrors without statistics and the last go
+ * mirrors which mostly failed recently. Mirrors of the same kind keep
+ * their relative order.
+ * @param stats         Statistics.
+ * @param iml           Internal mirrorlist.
+ */
+void lr_mirrorstats_rank(lr_MirrorStats stats, lr_InternalMirrorlist iml);
+
+/**
+ * Add results of downloads collected in the mirrors of the internal
+ * mirrorlist to the statistics file and reset the collected values.
+ * @param path          Path to the statistics file.
+ * @param iml           Internal mirrorlist.
+ * @return              ::lr_Rc value.
+ */
+int lr_mirrorstats_save(const char *path, lr_InternalMirrorlist iml);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -30,39 +30,28 @@
 #include "types.h"
 #include "util.h"
 #include "curl.h"
+#include "checksum.h"
 #include "package_downloader.h"
 #include "handle_internal.h"
+#include "curltargetlist.h"
+#include "cache.h"
 
 /* Do NOT use resume on successfully downloaded files - download will fail */
 
-int
-lr_download_package(lr_Handle handle,
-                    const char *relative_url,
-                    const char *dest,
-                    lr_ChecksumType checksum_type,
-                    const char *checksum,
-                    const char *base_url,
-                    int resume)
+/** Build path of the destination file.
+ * @param handle            Librepo handle.
+ * @param relative_url      Relative part of url.
+ * @param dest              Destination file, directory or NULL.
+ * @return                  Malloced path of the destination file.
+ */
+static char *
+lr_package_dest_path(lr_Handle handle,
+                     const char *relative_url,
+                     const char *dest)
 {
-    int rc = LRE_OK;
-    int fd;
-    long offset = 0;
     char *dest_path;
     char *file_basename;
     char *dest_basename;
-    int open_flags = O_CREAT|O_TRUNC|O_RDWR;
-
-    assert(handle);
-
-    if (handle->repotype == LR_YUMREPO)
-        rc = lr_handle_prepare_internal_mirrorlist(handle, "repodata/repomd.xml");
-    else {
-        DPRINTF("%s: Bad repo type\n", __func__);
-        assert(0);
-    }
-
-    if (rc != LRE_OK)
-        return rc;
 
     file_basename = basename(relative_url);
     dest_basename = (dest) ? basename(dest) : "";
@@ -88,7 +77,99 @@ lr_download_package(lr_Handle handle,
         }
     }
 
-    if (resume) {
+    return dest_path;
+}
+
+/** Check if the file already exists and the checksum cache
+ * (LRO_CHECKSUMCACHE) confirms that it has the expected checksum.
+ * @return                  1 if the file is already downloaded, 0 otherwise.
+ */
+static int
+lr_package_is_cached(lr_Handle handle,
+                     const char *path,
+                     lr_ChecksumType checksum_type,
+                     const char *checksum)
+{
+    int fd, ret;
+    char *cached;
+
+    if (!handle->checksumcache || !(handle->checks & LR_CHECK_CHECKSUM)
+        || !checksum)
+        return 0;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+
+    cached = lr_checksum_cache_get(checksum_type, fd);
+    ret = (cached && !strcmp(cached, checksum));
+    lr_free(cached);
+    close(fd);
+
+    if (ret)
+        DPRINTF("%s: %s is already downloaded\n", __func__, path);
+
+    return ret;
+}
+
+/** Check if the file has more than one hardlink, e.g. it was taken
+ * from the cache (LRO_CACHEDIR). Such a file must not be written to.
+ * @return                  1 if the file is shared, 0 otherwise.
+ */
+static int
+lr_package_is_shared(const char *path)
+{
+    struct stat st;
+
+    if (stat(path, &st))
+        return 0;
+    return st.st_nlink > 1;
+}
+
+int
+lr_download_package(lr_Handle handle,
+                    const char *relative_url,
+                    const char *dest,
+                    lr_ChecksumType checksum_type,
+                    const char *checksum,
+                    const char *base_url,
+                    int resume)
+{
+    int rc = LRE_OK;
+    int fd;
+    long offset = 0;
+    char *dest_path;
+    int open_flags = O_CREAT|O_TRUNC|O_RDWR;
+
+    assert(handle);
+
+    dest_path = lr_package_dest_path(handle, relative_url, dest);
+
+    if (lr_package_is_cached(handle, dest_path, checksum_type, checksum)
+        || lr_cache_get(handle, checksum_type, checksum, dest_path)) {
+        lr_free(dest_path);
+        return LRE_OK;
+    }
+
+    if (handle->repotype == LR_YUMREPO)
+        rc = lr_handle_prepare_internal_mirrorlist(handle, "repodata/repomd.xml");
+    else {
+        DPRINTF("%s: Bad repo type\n", __func__);
+        assert(0);
+    }
+
+    if (rc != LRE_OK) {
+        lr_free(dest_path);
+        return rc;
+    }
+
+    lr_handle_probe_internal_mirrorlist(handle, "repodata/repomd.xml");
+
+    if (lr_package_is_shared(dest_path)) {
+        /* The file is a hardlink (e.g. to a cache entry),
+         * never write into it - download a new file instead */
+        unlink(dest_path);
+    } else if (resume) {
         /* Enable autodetection for resume download */
         offset = -1;                /* Autodetect offset */
         open_flags &= ~O_TRUNC;     /* Do NOT truncate the dest file */
@@ -101,6 +182,32 @@ lr_download_package(lr_Handle handle,
         return LRE_IO;
     }
 
+    if (!base_url && !resume && handle->segments > 1) {
+        /* Big file could be downloaded in segments from more mirrors */
+        int fallback;
+        long long size = 0;
+
+        /* Metalink knows the size only of the file it describes, size of
+         * other files is get by a HEAD request */
+        if (handle->metalink && handle->metalink->size > 0
+            && handle->metalink->filename
+            && !strcmp(basename(relative_url), handle->metalink->filename))
+            size = handle->metalink->size;
+
+        rc = lr_curl_segmented_download(handle, relative_url, fd,
+                                        checksum_type, checksum, size,
+                                        &fallback);
+        if (!fallback) {
+            close(fd);
+            if (rc == LRE_OK)
+                lr_cache_put(handle, checksum_type, checksum, dest_path);
+            lr_free(dest_path);
+            return rc;
+        }
+
+        ftruncate(fd, 0);
+    }
+
     if (!base_url) {
         /* Use internal mirrorlist to download */
         DPRINTF("%s: Trying to download package: [mirror]/%s to: %s (resume: %d)\n",
@@ -121,20 +228,159 @@ lr_download_package(lr_Handle handle,
         DPRINTF("%s: Trying to download package: %s to: %s (resume: %d)\n",
                 __func__, full_url, dest_path, resume);
 
-        rc = lr_curl_single_download_resume(handle, full_url, fd, offset, 1);
+        /* Checksum is checked during the download */
+        rc = lr_curl_single_download_checksum(handle, full_url, fd,
+                                              checksum_type, checksum,
+                                              offset, 1);
         lr_free(full_url);
+    }
+
+    if (rc == LRE_OK)
+        lr_cache_put(handle, checksum_type, checksum, dest_path);
+
+    lr_free(dest_path);
+    return rc;
+}
+
+lr_PackageTarget
+lr_packagetarget_new(const char *relative_url,
+                     const char *dest,
+                     lr_ChecksumType checksum_type,
+                     const char *checksum,
+                     const char *base_url,
+                     int resume)
+{
+    lr_PackageTarget target = lr_malloc0(sizeof(struct _lr_PackageTarget));
+    target->relative_url = lr_strdup(relative_url);
+    target->dest = lr_strdup(dest);
+    target->checksum_type = checksum_type;
+    target->checksum = lr_strdup(checksum);
+    target->base_url = lr_strdup(base_url);
+    target->resume = resume;
+    target->rc = LRE_OK;
+    return target;
+}
+
+void
+lr_packagetarget_free(lr_PackageTarget target)
+{
+    if (!target)
+        return;
+    lr_free(target->relative_url);
+    lr_free(target->dest);
+    lr_free(target->checksum);
+    lr_free(target->base_url);
+    lr_free(target->local_path);
+    lr_free(target);
+}
+
+int
+lr_download_packages(lr_Handle handle, lr_PackageTarget *targets)
+{
+    int rc = LRE_OK;
+    int mirrors_rc = LRE_OK;
+    int count = 0;
+    lr_PackageTarget *downloaded; /* Targets passed to the multi download */
+    lr_CurlTargetList curl_targets;
 
-        /* Check checksum */
-        if (rc == LRE_OK && checksum && checksum_type != LR_CHECKSUM_UNKNOWN) {
-            DPRINTF("%s: Checking checksum\n", __func__);
-            lseek(fd, 0, SEEK_SET);
-            if (lr_checksum_fd_cmp(checksum_type, fd, checksum)) {
-                DPRINTF("%s: Bad checksum\n", __func__);
-                rc = LRE_BADCHECKSUM;
-            }
+    assert(handle);
+
+    if (!targets)
+        return LRE_OK;
+
+    while (targets[count])
+        count++;
+
+    /* Internal mirrorlist is needed only by targets without base_url */
+    for (int x = 0; x < count; x++) {
+        if (targets[x]->base_url)
+            continue;
+        if (handle->repotype == LR_YUMREPO)
+            mirrors_rc = lr_handle_prepare_internal_mirrorlist(handle,
+                                                    "repodata/repomd.xml");
+        else {
+            DPRINTF("%s: Bad repo type\n", __func__);
+            assert(0);
         }
+        if (mirrors_rc == LRE_OK)
+            lr_handle_probe_internal_mirrorlist(handle, "repodata/repomd.xml");
+        break;
     }
 
-    lr_free(dest_path);
+    downloaded = lr_malloc0(sizeof(lr_PackageTarget) * (count + 1));
+    curl_targets = lr_curltargetlist_new();
+
+    for (int x = 0; x < count; x++) {
+        lr_CurlTarget curl_target;
+        lr_PackageTarget target = targets[x];
+
+        lr_free(target->local_path);
+        target->local_path = lr_package_dest_path(handle,
+                                                  target->relative_url,
+                                                  target->dest);
+        if (lr_package_is_cached(handle, target->local_path,
+                                 target->checksum_type, target->checksum)
+            || lr_cache_get(handle, target->checksum_type, target->checksum,
+                            target->local_path)) {
+            target->rc = LRE_OK;
+            continue;
+        }
+        if (!target->base_url && mirrors_rc != LRE_OK) {
+            target->rc = mirrors_rc;
+            continue;
+        }
+
+        DPRINTF("%s: Package: %s%s to: %s (resume: %d)\n", __func__,
+                (target->base_url) ? target->base_url : "[mirror]/",
+                target->relative_url, target->local_path, target->resume);
+
+        if (lr_package_is_shared(target->local_path)) {
+            /* The file is a hardlink (e.g. to a cache entry),
+             * never write into it - download a new file instead */
+            target->resume = 0;
+            unlink(target->local_path);
+        }
+
+        /* File is opened right before its download */
+        curl_target = lr_curltarget_new();
+        curl_target->path = lr_strdup(target->relative_url);
+        curl_target->fd = -1;
+        curl_target->fn = lr_strdup(target->local_path);
+        curl_target->checksum_type = target->checksum_type;
+        curl_target->checksum = lr_strdup(target->checksum);
+        curl_target->base_url = lr_strdup(target->base_url);
+        curl_target->resume = target->resume;
+        lr_curltargetlist_append(curl_targets, curl_target);
+        downloaded[lr_curltargetlist_len(curl_targets) - 1] = target;
+    }
+
+    if (lr_curltargetlist_len(curl_targets) > 0)
+        rc = lr_curl_multi_download(handle, curl_targets);
+
+    /* Propagate results */
+    for (int x = 0; downloaded[x]; x++) {
+        lr_CurlTarget curl_target = lr_curltargetlist_get(curl_targets, x);
+        if (curl_target->downloaded) {
+            downloaded[x]->rc = LRE_OK;
+            lr_cache_put(handle, downloaded[x]->checksum_type,
+                         downloaded[x]->checksum, downloaded[x]->local_path);
+        } else if (curl_target->rc != LRE_OK)
+            downloaded[x]->rc = curl_target->rc;
+        else
+            /* Download was interrupted by an error of the whole batch */
+            downloaded[x]->rc = (rc != LRE_OK) ? rc : LRE_UNKNOWNERROR;
+    }
+
+    lr_curltargetlist_free(curl_targets);
+    lr_free(downloaded);
+
+    /* Return code of the first failed package */
+    rc = LRE_OK;
+    for (int x = 0; x < count; x++)
+        if (targets[x]->rc != LRE_OK) {
+            rc = targets[x]->rc;
+            break;
+        }
+
     return rc;
 }
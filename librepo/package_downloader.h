@@ -62,6 +62,63 @@ int lr_download_package(lr_Handle handle,
                         const char *base_url,
                         int resume);
 
+/** \ingroup package_downloader
+ * Package to download via ::lr_download_packages.
+ */
+struct _lr_PackageTarget {
+    char *relative_url;     /*!< Relative part of url */
+    char *dest;             /*!< Destination file, directory or NULL */
+    lr_ChecksumType checksum_type; /*!< Type of checksum */
+    char *checksum;         /*!< Checksum value or NULL */
+    char *base_url;         /*!< If not NULL, mirrors from handle are ignored
+                                 and this base_url is used for downloading */
+    int resume;             /*!< If != 0 try to resume downloading if dest
+                                 file already exists */
+
+    /* Filled by lr_download_packages */
+    char *local_path;       /*!< Path to the downloaded file */
+    int rc;                 /*!< Librepo return code ::lr_Rc of the download */
+};
+
+typedef struct _lr_PackageTarget *lr_PackageTarget;
+
+/** \ingroup package_downloader
+ * Create new package target. All strings are copied.
+ * @param relative_url      Relative part of url.
+ * @param dest              Destination file, directory
+ *                          or NULL (current working dir is used).
+ * @param checksum_type     Type of checksum.
+ * @param checksum          Checksum value or NULL.
+ * @param base_url          If specified, mirrors from handle are ignored
+ *                          and this base_url is used for downloading.
+ * @param resume            If != 0 try to resume downloading if dest file
+ *                          already exists.
+ * @return                  New package target.
+ */
+lr_PackageTarget lr_packagetarget_new(const char *relative_url,
+                                      const char *dest,
+                                      lr_ChecksumType checksum_type,
+                                      const char *checksum,
+                                      const char *base_url,
+                                      int resume);
+
+/** \ingroup package_downloader
+ * Free package target and its content.
+ * @param target            Package target.
+ */
+void lr_packagetarget_free(lr_PackageTarget target);
+
+/** \ingroup package_downloader
+ * Download packages in parallel. Result of each package download is
+ * stored into rc and local_path of its target.
+ * @param handle            Librepo handle.
+ * @param targets           NULL terminated array of package targets.
+ * @return                  LRE_OK if all packages were successfully
+ *                          downloaded, return code of the first failed
+ *                          package otherwise.
+ */
+int lr_download_packages(lr_Handle handle, lr_PackageTarget *targets);
+
 #ifdef __cplusplus
 }
 #endif
@@ -11,6 +11,39 @@ Module init and cleanup
 
     Reclaims memory that has been obtained through a libcurl call.
 
+Parallel refresh
+================
+
+.. function:: perform_many(handles, results)
+
+    Perform (download or locate) repositories of several
+    :class:`.Handle` objects concurrently. Every handle is performed
+    like by :meth:`~librepo.Handle.perform` and all of them share one
+    DNS cache and SSL sessions. Progress callbacks of the handles
+    are called from other threads than the calling one.
+
+    *handles* is a list of :class:`.Handle` objects and *results*
+    a list of :class:`.Result` objects, one per handle. Every handle
+    and result could be in the lists only once, otherwise
+    :exc:`ValueError` is raised.
+
+    Returns list with a ``(rc, err)`` tuple for each handle.
+    *rc* is one of :ref:`error-codes-label` and *err* is ``None``
+    if the repository was successfully performed, error message otherwise.
+
+    Example::
+
+        handles, results = [], []
+        for url in urls:
+            h = librepo.Handle()
+            h.setopt(librepo.LRO_URL, url)
+            h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+            handles.append(h)
+            results.append(librepo.Result())
+        for url, (rc, err) in zip(urls, librepo.perform_many(handles, results)):
+            if err:
+                print "%s: %s" % (url, err)
+
 Exceptions
 ==========
 
@@ -167,6 +200,101 @@ Constants
     that are present, or use LRO_YUMBLIST and specify files that are not
     present or use this option.
 
+.. data:: LRO_MAXPARALLELDOWNLOADS
+
+    *Integer or None*. Set maximal number of files downloaded in parallel.
+    Other files wait in a queue until some running download finishes.
+    Default value is 3. None as *val* sets the default value.
+
+.. data:: LRO_MAXDOWNLOADSPERMIRROR
+
+    *Integer or None*. Set maximal number of files downloaded in parallel
+    from a single mirror. Default value is 3. None as *val* sets the
+    default value.
+
+.. data:: LRO_WRITEBUFFERSIZE
+
+    *Integer or None*. Size of buffer (in bytes) used to coalesce small
+    writes of downloaded data into bigger ones. 0 means that data are
+    written to the destination file directly as they come.
+    Default value is 0. None as *val* sets the default value.
+
+.. data:: LRO_MIRRORPROBE
+
+    *Integer or None*. Number of mirrors (from the beginning of the
+    mirrorlist) whose connect time, time to first byte and throughput
+    are measured in parallel before the download. The mirrors are then
+    tried from the fastest one. 0 disables the probe.
+    Default value is 0. None as *val* sets the default value.
+
+.. data:: LRO_MIRRORPROBETIMEOUT
+
+    *Integer or None*. Time budget of the mirror probe (see
+    :data:`.LRO_MIRRORPROBE`) in milliseconds. Mirrors which do not
+    respond in time are tried last. Default value is 2000.
+    None as *val* sets the default value.
+
+.. data:: LRO_MIRRORSTATS
+
+    *String or None*. Path to a file with statistics of mirrors
+    (success ratio, average throughput and time of the last failure).
+    The statistics are updated after downloads and they are used to
+    rank mirrors on the next run - fast mirrors are tried first and
+    mirrors which mostly failed during the last day are tried last.
+    The file could be shared by several processes.
+    None disables the statistics (default).
+
+.. data:: LRO_SEGMENTS
+
+    *Integer or None*. Max number of segments (byte ranges) in which
+    a single package (see :meth:`~librepo.Handle.download`) is downloaded
+    from the mirrors in parallel. If the servers do not support range
+    requests, the package is downloaded as a whole. 0 or 1 disables
+    the segmented download. Default value is 0.
+    None as *val* sets the default value.
+
+.. data:: LRO_SEGMENTSIZE
+
+    *Integer or None*. Min size of a segment in bytes
+    (see :data:`.LRO_SEGMENTS`). Smaller files are downloaded as a whole.
+    Default value is 4194304 (4 MiB). None as *val* sets the default value.
+
+.. data:: LRO_IFMODIFIED
+
+    *Boolean*. If True, repomd.xml is downloaded into an existing
+    :data:`.LRO_DESTDIR` only if it was modified since the last download
+    (ETag and Last-Modified of the last download are stored in
+    ``repodata/repomd.xml.validators``). With a metalink, no mirror is
+    contacted if the local repomd.xml matches the checksum from the metalink.
+    If it was not modified, the local repository is kept untouched, the
+    :class:`.Result` describes it and :data:`.LRE_NOTMODIFIED` error
+    is raised. Default is False.
+
+.. data:: LRO_OLDDESTDIR
+
+    *String or None*. :data:`.LRO_DESTDIR` of a previous download of the
+    repository. Metadata files whose checksum in repomd.xml didn't change
+    are hardlinked, reflinked or copied from there instead of being
+    downloaded. None disables it (default).
+
+.. data:: LRO_CACHEDIR
+
+    *String or None*. Directory of a content addressed cache which can be
+    shared by several handles and processes. Metadata files and packages
+    with a known checksum are taken from it (hardlinked, reflinked or
+    copied) before any network access and verified downloads are stored
+    there. It is populated only if :data:`.LRO_CHECKSUM` is enabled.
+    None disables it (default).
+
+.. data:: LRO_DECOMPRESS
+
+    *Integer or None*. Decompress gz, bz2 and xz metadata files while they
+    are downloaded. See :ref:`decompress-constants-label`. The decompressed
+    file is stored without the suffix (``primary.xml.gz`` ->
+    ``primary.xml``) and, if :data:`.LRO_CHECKSUM` is enabled, it is
+    verified against the open-checksum from repomd.xml. None sets
+    the default :data:`.LR_DECOMPRESS_NONE`.
+
 .. data:: LRO_GPGCHECK
 
     *Boolean*. Set True to enable gpg check (if available) of downloaded repo.
@@ -181,6 +309,21 @@ Constants
         checksum related params e.g. in :meth:`~librepo.Handle.download`
         method are ignored and checksum is not checked!
 
+.. data:: LRO_CHECKSUMTHREADS
+
+    *Integer or None*. Set number of threads used to check checksums
+    of a local repository (see :data:`.LRO_LOCAL`). 0 means number
+    of online CPUs. Default value is 1. None as *val* sets the default value.
+
+.. data:: LRO_CHECKSUMCACHE
+
+    *Boolean*. If True, calculated checksums are stored in extended
+    attributes of the files (``user.librepo.checksum.<type>``) together
+    with inode, size and mtime of the file. Next checks of unchanged files
+    (e.g. with :data:`.LRO_LOCAL`) use the stored value instead of reading
+    the whole file. Already downloaded packages with a valid cached
+    checksum are not downloaded again. Default is False.
+
 .. data:: LRO_YUMDLIST
 
     *List of strings*. Some predefined list :ref:`predefined-yumdlists-label`.
@@ -230,6 +373,23 @@ Proxy type constants
 .. data:: LR_PROXY_SOCKS4A
 .. data:: LR_PROXY_SOCKS5_HOSTNAME
 
+.. _decompress-constants-label:
+
+Decompression constants
+-----------------------
+
+.. data:: LR_DECOMPRESS_NONE
+
+    Keep only the compressed metadata files (default).
+
+.. data:: LR_DECOMPRESS_KEEP
+
+    Keep both the compressed and the decompressed files.
+
+.. data:: LR_DECOMPRESS_ONLY
+
+    Keep only the decompressed files. The :class:`.Result` points to them.
+
 .. _repotype-constants-label:
 
 Repo type constants
@@ -395,6 +555,16 @@ LibRepo Error codes.
 
     Repository metadata are not complete.
 
+.. data:: LRE_NOTMODIFIED
+
+    Repository was not modified since the last download
+    (see :data:`.LRO_IFMODIFIED`). The result describes the local
+    repository.
+
+.. data:: LRE_DECOMPRESSION
+
+    Decompression of a downloaded file failed (see :data:`.LRO_DECOMPRESS`).
+
 .. data:: LRE_UNKNOWNERROR
 
     An unknown error.
@@ -416,6 +586,14 @@ LibRepo Result options for use in :meth:`~.Result.getinfo` method.
     Return a dict representing a repomd.xml file of downloaded
     yum repository.
 
+.. data:: LRR_YUM_CHECKSUMS
+
+    Return a dict with result (one of :ref:`error-codes-label`) of
+    the checksum check of each record of the repomd.xml, e.g.
+    ``{"primary": LRE_OK, "filelists": LRE_BADCHECKSUM, ...}``.
+    Checksums are checked (and this is not ``None``) only for
+    a local repository (:data:`.LRO_LOCAL`) with :data:`.LRO_CHECKSUM`.
+
 """
 
 import _librepo
@@ -449,8 +627,22 @@ LRO_DESTDIR         = _librepo.LRO_DESTDIR
 LRO_REPOTYPE        = _librepo.LRO_REPOTYPE
 LRO_CONNECTTIMEOUT  = _librepo.LRO_CONNECTTIMEOUT
 LRO_IGNOREMISSING   = _librepo.LRO_IGNOREMISSING
+LRO_MAXPARALLELDOWNLOADS  = _librepo.LRO_MAXPARALLELDOWNLOADS
+LRO_MAXDOWNLOADSPERMIRROR = _librepo.LRO_MAXDOWNLOADSPERMIRROR
+LRO_WRITEBUFFERSIZE = _librepo.LRO_WRITEBUFFERSIZE
+LRO_MIRRORPROBE     = _librepo.LRO_MIRRORPROBE
+LRO_MIRRORPROBETIMEOUT = _librepo.LRO_MIRRORPROBETIMEOUT
+LRO_MIRRORSTATS     = _librepo.LRO_MIRRORSTATS
+LRO_SEGMENTS        = _librepo.LRO_SEGMENTS
+LRO_SEGMENTSIZE     = _librepo.LRO_SEGMENTSIZE
+LRO_IFMODIFIED      = _librepo.LRO_IFMODIFIED
+LRO_OLDDESTDIR      = _librepo.LRO_OLDDESTDIR
+LRO_CACHEDIR        = _librepo.LRO_CACHEDIR
+LRO_DECOMPRESS      = _librepo.LRO_DECOMPRESS
 LRO_GPGCHECK        = _librepo.LRO_GPGCHECK
 LRO_CHECKSUM        = _librepo.LRO_CHECKSUM
+LRO_CHECKSUMTHREADS = _librepo.LRO_CHECKSUMTHREADS
+LRO_CHECKSUMCACHE   = _librepo.LRO_CHECKSUMCACHE
 LRO_YUMDLIST        = _librepo.LRO_YUMDLIST
 LRO_YUMBLIST        = _librepo.LRO_YUMBLIST
 LRO_SENTINEL        = _librepo.LRO_SENTINEL
@@ -475,8 +667,22 @@ ATTR_TO_LRO = {
     "repotype":         LRO_REPOTYPE,
     "connecttimeout":   LRO_CONNECTTIMEOUT,
     "ignoremissing":    LRO_IGNOREMISSING,
+    "maxparalleldownloads":  LRO_MAXPARALLELDOWNLOADS,
+    "maxdownloadspermirror": LRO_MAXDOWNLOADSPERMIRROR,
+    "writebuffersize":  LRO_WRITEBUFFERSIZE,
+    "mirrorprobe":      LRO_MIRRORPROBE,
+    "mirrorprobetimeout": LRO_MIRRORPROBETIMEOUT,
+    "mirrorstats":      LRO_MIRRORSTATS,
+    "segments":         LRO_SEGMENTS,
+    "segmentsize":      LRO_SEGMENTSIZE,
+    "ifmodified":       LRO_IFMODIFIED,
+    "olddestdir":       LRO_OLDDESTDIR,
+    "cachedir":         LRO_CACHEDIR,
+    "decompress":       LRO_DECOMPRESS,
     "gpgcheck":         LRO_GPGCHECK,
     "checksum":         LRO_CHECKSUM,
+    "checksumthreads":  LRO_CHECKSUMTHREADS,
+    "checksumcache":    LRO_CHECKSUMCACHE,
     "yumdlist":         LRO_YUMDLIST,
     "yumblist":         LRO_YUMBLIST,
 }
@@ -529,6 +735,10 @@ LR_PROXY_SOCKS5             = _librepo.LR_PROXY_SOCKS5
 LR_PROXY_SOCKS4A            = _librepo.LR_PROXY_SOCKS4A
 LR_PROXY_SOCKS5_HOSTNAME    = _librepo.LR_PROXY_SOCKS5_HOSTNAME
 
+LR_DECOMPRESS_NONE  = _librepo.LR_DECOMPRESS_NONE
+LR_DECOMPRESS_KEEP  = _librepo.LR_DECOMPRESS_KEEP
+LR_DECOMPRESS_ONLY  = _librepo.LR_DECOMPRESS_ONLY
+
 LR_YUM_FULL         = None
 LR_YUM_REPOMDONLY   = [None]
 LR_YUM_BASEXML      = ["primary", "filelists", "other", None]
@@ -562,15 +772,19 @@ LRE_GPGNOTSUPPORTED     = _librepo.LRE_GPGNOTSUPPORTED
 LRE_GPGERROR            = _librepo.LRE_GPGERROR
 LRE_BADGPG              = _librepo.LRE_BADGPG
 LRE_INCOMPLETEREPO      = _librepo.LRE_INCOMPLETEREPO
+LRE_NOTMODIFIED         = _librepo.LRE_NOTMODIFIED
+LRE_DECOMPRESSION       = _librepo.LRE_DECOMPRESSION
 LRE_UNKNOWNERROR        = _librepo.LRE_UNKNOWNERROR
 
 LRR_YUM_REPO    = _librepo.LRR_YUM_REPO
 LRR_YUM_REPOMD  = _librepo.LRR_YUM_REPOMD
+LRR_YUM_CHECKSUMS = _librepo.LRR_YUM_CHECKSUMS
 LRR_SENTINEL    = _librepo.LRR_SENTINEL
 
 ATTR_TO_LRR = {
     "yum_repo":     LRR_YUM_REPO,
     "yum_repomd":   LRR_YUM_REPOMD,
+    "yum_checksums": LRR_YUM_CHECKSUMS,
 }
 
 CHECKSUM_UNKNOWN    = _librepo.CHECKSUM_UNKNOWN
@@ -681,6 +895,54 @@ class Handle(_librepo.Handle):
 
         See: :data:`.LRO_IGNOREMISSING`
 
+    .. attribute:: maxparalleldownloads:
+
+        See: :data:`.LRO_MAXPARALLELDOWNLOADS`
+
+    .. attribute:: maxdownloadspermirror:
+
+        See: :data:`.LRO_MAXDOWNLOADSPERMIRROR`
+
+    .. attribute:: writebuffersize:
+
+        See: :data:`.LRO_WRITEBUFFERSIZE`
+
+    .. attribute:: mirrorprobe:
+
+        See: :data:`.LRO_MIRRORPROBE`
+
+    .. attribute:: mirrorprobetimeout:
+
+        See: :data:`.LRO_MIRRORPROBETIMEOUT`
+
+    .. attribute:: mirrorstats:
+
+        See: :data:`.LRO_MIRRORSTATS`
+
+    .. attribute:: segments:
+
+        See: :data:`.LRO_SEGMENTS`
+
+    .. attribute:: segmentsize:
+
+        See: :data:`.LRO_SEGMENTSIZE`
+
+    .. attribute:: ifmodified:
+
+        See: :data:`.LRO_IFMODIFIED`
+
+    .. attribute:: olddestdir:
+
+        See: :data:`.LRO_OLDDESTDIR`
+
+    .. attribute:: cachedir:
+
+        See: :data:`.LRO_CACHEDIR`
+
+    .. attribute:: decompress:
+
+        See: :data:`.LRO_DECOMPRESS`
+
     .. attribute:: gpgcheck:
 
         See: :data:`.LRO_GPGCHECK`
@@ -689,6 +951,14 @@ class Handle(_librepo.Handle):
 
         See: :data:`.LRO_CHECKSUM`
 
+    .. attribute:: checksumthreads:
+
+        See: :data:`.LRO_CHECKSUMTHREADS`
+
+    .. attribute:: checksumcache:
+
+        See: :data:`.LRO_CHECKSUMCACHE`
+
     .. attribute:: yumdlist:
 
         See: :data:`.LRO_YUMDLIST`
@@ -769,6 +1039,86 @@ class Handle(_librepo.Handle):
             checksum_type = checksum_str_to_type(checksum_type)
         self.download_package(url, dest, checksum_type, checksum, base_url, resume)
 
+    def download_packages(self, targets):
+        """Download packages in parallel. Packages are downloaded from
+        repository specified by :meth:`~librepo.Handle.url()` or
+        :meth:`~librepo.Handle.mirrorlist()` method (or from
+        *base_url* of the target, if specified).
+
+        :param targets: List of :class:`.PackageTarget` objects.
+                        Result of each download is stored into
+                        its *rc*, *err* and *local_path* attributes.
+        :returns: ``True`` if all packages were successfully downloaded,
+                  ``False`` otherwise.
+
+        Example::
+
+            h = librepo.Handle()
+            h.setopt(librepo.LRO_URL, "http://ftp.linux.ncsu.edu/pub/fedora/linux/releases/17/Everything/i386/os/")
+            h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+            targets = [librepo.PackageTarget("Packages/s/sl-3.03-12.fc17.i686.rpm"),
+                       librepo.PackageTarget("Packages/l/lynx-2.8.7-9.fc17.i686.rpm")]
+            h.download_packages(targets)
+            for target in targets:
+                if target.err:
+                    print "%s: %s" % (target.relative_url, target.err)
+
+        """
+        args = []
+        for target in targets:
+            checksum_type = target.checksum_type
+            if isinstance(checksum_type, basestring):
+                checksum_type = checksum_str_to_type(checksum_type)
+            args.append((target.relative_url, target.dest, checksum_type,
+                         target.checksum, target.base_url,
+                         1 if target.resume else 0))
+
+        results = _librepo.Handle.download_packages(self, args)
+
+        ok = True
+        for target, (rc, err, local_path) in zip(targets, results):
+            target.rc = rc
+            target.err = err
+            target.local_path = local_path
+            if err:
+                ok = False
+        return ok
+
+class PackageTarget(object):
+    """Package to download via :meth:`~librepo.Handle.download_packages`.
+
+    Params have the same meaning as params of
+    :meth:`~librepo.Handle.download` method.
+
+    **Attributes set by** :meth:`~librepo.Handle.download_packages`:
+
+    .. attribute:: rc
+
+        Return code - one of :ref:`error-codes-label`.
+
+    .. attribute:: err
+
+        ``None`` if the package was successfully downloaded,
+        error message otherwise.
+
+    .. attribute:: local_path
+
+        Path to the downloaded file.
+    """
+
+    def __init__(self, relative_url, dest=None,
+                 checksum_type=CHECKSUM_UNKNOWN, checksum=None,
+                 base_url=None, resume=False):
+        self.relative_url = relative_url
+        self.dest = dest
+        self.checksum_type = checksum_type
+        self.checksum = checksum
+        self.base_url = base_url
+        self.resume = resume
+        self.rc = None
+        self.err = None
+        self.local_path = None
+
 
 class Result(_librepo.Result):
     """Librepo result class
@@ -784,6 +1134,10 @@ class Result(_librepo.Result):
     .. attribute:: yum_repomd
 
         See: :data:`.LRR_YUM_REPOMD`
+
+    .. attribute:: yum_checksums
+
+        See: :data:`.LRR_YUM_CHECKSUMS`
     """
 
     def getinfo(self, option):
@@ -797,3 +1151,9 @@ class Result(_librepo.Result):
         if attr not in ATTR_TO_LRR:
             raise LibrepoException("Unknown attribute: %s" % attr)
         return self.getinfo(ATTR_TO_LRR[attr])
+
+def perform_many(handles, results):
+    """Perform repositories of several handles concurrently.
+    See :func:`perform_many` in the module documentation.
+    """
+    return _librepo.perform_many(list(handles), list(results))
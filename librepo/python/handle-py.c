@@ -64,23 +64,30 @@ progress_callback(void *data, double total_to_download, double now_downloaded)
 {
     _HandleObject *self;
     PyObject *user_data, *arglist, *result;
+    PyGILState_STATE gstate;
 
     self = (_HandleObject *)data;
     if (!self->progress_cb)
         return 0;
 
+    /* Callback could be called from a thread of perform_many */
+    gstate = PyGILState_Ensure();
+
     if (self->progress_cb_data)
         user_data = self->progress_cb_data;
     else
         user_data = Py_None;
 
     arglist = Py_BuildValue("(Odd)", user_data, total_to_download, now_downloaded);
-    if (arglist == NULL)
+    if (arglist == NULL) {
+        PyGILState_Release(gstate);
         return 0;
+    }
 
     result = PyObject_CallObject(self->progress_cb, arglist);
     Py_DECREF(arglist);
     Py_XDECREF(result);
+    PyGILState_Release(gstate);
     return 0;
 }
 
@@ -155,7 +162,10 @@ setopt(_HandleObject *self, PyObject *args)
     case LRO_USERPWD:
     case LRO_PROXY:
     case LRO_PROXYUSERPWD:
-    case LRO_DESTDIR: {
+    case LRO_DESTDIR:
+    case LRO_MIRRORSTATS:
+    case LRO_OLDDESTDIR:
+    case LRO_CACHEDIR: {
         char *str = NULL;
 
         if (PyString_Check(obj)) {
@@ -178,7 +188,9 @@ setopt(_HandleObject *self, PyObject *args)
     case LRO_PROXYAUTH:
     case LRO_GPGCHECK:
     case LRO_IGNOREMISSING:
-    case LRO_CHECKSUM: {
+    case LRO_CHECKSUM:
+    case LRO_CHECKSUMCACHE:
+    case LRO_IFMODIFIED: {
         PY_LONG_LONG d;
 
         if (PyInt_Check(obj))
@@ -234,7 +246,16 @@ setopt(_HandleObject *self, PyObject *args)
     case LRO_PROXYPORT:
     case LRO_RETRIES:
     case LRO_MAXSPEED:
-    case LRO_CONNECTTIMEOUT: {
+    case LRO_CONNECTTIMEOUT:
+    case LRO_MAXPARALLELDOWNLOADS:
+    case LRO_MAXDOWNLOADSPERMIRROR:
+    case LRO_WRITEBUFFERSIZE:
+    case LRO_MIRRORPROBE:
+    case LRO_MIRRORPROBETIMEOUT:
+    case LRO_SEGMENTS:
+    case LRO_SEGMENTSIZE:
+    case LRO_DECOMPRESS:
+    case LRO_CHECKSUMTHREADS: {
         PY_LONG_LONG d;
 
         if (PyInt_Check(obj))
@@ -251,6 +272,24 @@ setopt(_HandleObject *self, PyObject *args)
                 d = 0;
             else if (option == LRO_CONNECTTIMEOUT)
                 d = 300;
+            else if (option == LRO_MAXPARALLELDOWNLOADS)
+                d = 3;
+            else if (option == LRO_MAXDOWNLOADSPERMIRROR)
+                d = 3;
+            else if (option == LRO_WRITEBUFFERSIZE)
+                d = 0;
+            else if (option == LRO_MIRRORPROBE)
+                d = 0;
+            else if (option == LRO_MIRRORPROBETIMEOUT)
+                d = 2000;
+            else if (option == LRO_SEGMENTS)
+                d = 0;
+            else if (option == LRO_SEGMENTSIZE)
+                d = 4194304;
+            else if (option == LRO_DECOMPRESS)
+                d = LR_DECOMPRESS_NONE;
+            else if (option == LRO_CHECKSUMTHREADS)
+                d = 1;
             else
                 assert(0);
         } else {
@@ -485,12 +524,172 @@ download_package(_HandleObject *self, PyObject *args)
     Py_RETURN_NONE;
 }
 
+static PyObject *
+download_packages(_HandleObject *self, PyObject *args)
+{
+    PyObject *list, *ret_list;
+    lr_PackageTarget *targets;
+    Py_ssize_t len;
+
+    if (!PyArg_ParseTuple(args, "O!:download_packages", &PyList_Type, &list))
+        return NULL;
+    if (check_HandleStatus(self))
+        return NULL;
+
+    /* Convert list of tuples to the NULL terminated array of targets */
+    len = PyList_Size(list);
+    targets = lr_malloc0(sizeof(lr_PackageTarget) * (len + 1));
+    for (Py_ssize_t x = 0; x < len; x++) {
+        char *relative_url, *checksum, *dest, *base_url;
+        int resume, checksum_type;
+        PyObject *item = PyList_GetItem(list, x);
+
+        if (!PyArg_ParseTuple(item, "szizzi:download_packages", &relative_url,
+                                                                &dest,
+                                                                &checksum_type,
+                                                                &checksum,
+                                                                &base_url,
+                                                                &resume)) {
+            for (Py_ssize_t y = 0; y < x; y++)
+                lr_packagetarget_free(targets[y]);
+            lr_free(targets);
+            return NULL;
+        }
+
+        targets[x] = lr_packagetarget_new(relative_url, dest, checksum_type,
+                                          checksum, base_url, resume);
+    }
+
+    lr_download_packages(self->handle, targets);
+
+    /* Result of each target: (return_code, error_message, local_path) */
+    ret_list = PyList_New(0);
+    for (Py_ssize_t x = 0; x < len; x++) {
+        lr_PackageTarget target = targets[x];
+        PyObject *item = NULL;
+
+        if (ret_list) {
+            if (target->rc == LRE_OK)
+                item = Py_BuildValue("(iOs)", target->rc, Py_None,
+                                     target->local_path);
+            else
+                item = Py_BuildValue("(iss)", target->rc,
+                                     lr_strerror(target->rc),
+                                     target->local_path);
+            if (!item || PyList_Append(ret_list, item) == -1) {
+                Py_DECREF(ret_list);
+                ret_list = NULL;
+            }
+            Py_XDECREF(item);
+        }
+        lr_packagetarget_free(target);
+    }
+    lr_free(targets);
+
+    return ret_list;
+}
+
+PyObject *
+py_perform_many(PyObject *self, PyObject *args)
+{
+    PyObject *handles_list, *results_list, *ret_list;
+    lr_Handle *handles;
+    lr_Result *results;
+    int *rcs;
+    Py_ssize_t len;
+
+    LR_UNUSED(self);
+
+    if (!PyArg_ParseTuple(args, "O!O!:perform_many", &PyList_Type, &handles_list,
+                                                     &PyList_Type, &results_list))
+        return NULL;
+
+    len = PyList_Size(handles_list);
+    if (PyList_Size(results_list) != len) {
+        PyErr_SetString(PyExc_ValueError,
+                        "Number of handles and results must be the same");
+        return NULL;
+    }
+
+    handles = lr_malloc0(sizeof(lr_Handle) * (len + 1));
+    results = lr_malloc0(sizeof(lr_Result) * (len + 1));
+    rcs = lr_malloc0(sizeof(int) * (len + 1));
+    for (Py_ssize_t x = 0; x < len; x++) {
+        PyObject *handle_obj = PyList_GetItem(handles_list, x);
+        PyObject *result_obj = PyList_GetItem(results_list, x);
+
+        handles[x] = Handle_FromPyObject(handle_obj);
+        if (handles[x] && check_HandleStatus((_HandleObject *) handle_obj))
+            handles[x] = NULL;
+        if (handles[x])
+            results[x] = Result_FromPyObject(result_obj);
+        if (!handles[x] || !results[x]) {
+            lr_free(handles);
+            lr_free(results);
+            lr_free(rcs);
+            return NULL;
+        }
+        for (Py_ssize_t y = 0; y < x; y++)
+            if (handles[y] == handles[x] || results[y] == results[x]) {
+                PyErr_SetString(PyExc_ValueError,
+                                "Every handle and result must be used only once");
+                lr_free(handles);
+                lr_free(results);
+                lr_free(rcs);
+                return NULL;
+            }
+    }
+
+    /* Copies of the lists keep the objects alive while the GIL
+     * is released (the original lists could be modified meanwhile) */
+    handles_list = PyList_GetSlice(handles_list, 0, len);
+    results_list = PyList_GetSlice(results_list, 0, len);
+    if (!handles_list || !results_list) {
+        Py_XDECREF(handles_list);
+        Py_XDECREF(results_list);
+        lr_free(handles);
+        lr_free(results);
+        lr_free(rcs);
+        return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    lr_handle_perform_many(handles, results, (int) len, rcs);
+    Py_END_ALLOW_THREADS
+
+    Py_DECREF(handles_list);
+    Py_DECREF(results_list);
+
+    /* Result of each repository: (return_code, error_message) */
+    ret_list = PyList_New(0);
+    for (Py_ssize_t x = 0; ret_list && x < len; x++) {
+        PyObject *item;
+
+        if (rcs[x] == LRE_OK)
+            item = Py_BuildValue("(iO)", rcs[x], Py_None);
+        else
+            item = Py_BuildValue("(is)", rcs[x], lr_strerror(rcs[x]));
+        if (!item || PyList_Append(ret_list, item) == -1) {
+            Py_DECREF(ret_list);
+            ret_list = NULL;
+        }
+        Py_XDECREF(item);
+    }
+
+    lr_free(handles);
+    lr_free(results);
+    lr_free(rcs);
+
+    return ret_list;
+}
+
 static struct
 PyMethodDef handle_methods[] = {
     { "setopt", (PyCFunction)setopt, METH_VARARGS, NULL },
     { "getinfo", (PyCFunction)getinfo, METH_VARARGS, NULL },
     { "perform", (PyCFunction)perform, METH_VARARGS, NULL },
     { "download_package", (PyCFunction)download_package, METH_VARARGS, NULL },
+    { "download_packages", (PyCFunction)download_packages, METH_VARARGS, NULL },
     { NULL }
 };
 
@@ -28,4 +28,6 @@ extern PyTypeObject Handle_Type;
 
 lr_Handle Handle_FromPyObject(PyObject *o);
 
+PyObject *py_perform_many(PyObject *self, PyObject *args);
+
 #endif
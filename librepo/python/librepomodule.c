@@ -50,6 +50,8 @@ static struct PyMethodDef librepo_methods[] = {
       METH_NOARGS, NULL },
     { "global_cleanup", (PyCFunction)py_global_cleanup,
       METH_NOARGS, NULL },
+    { "perform_many",   (PyCFunction)py_perform_many,
+      METH_VARARGS, NULL },
     { NULL }
 };
 
@@ -60,6 +62,9 @@ init_librepo(void)
     if (!m)
         return;
 
+    /* Callbacks could be called from other threads (perform_many) */
+    PyEval_InitThreads();
+
     /* Exceptions */
     if (!init_exceptions())
         return;
@@ -104,8 +109,22 @@ init_librepo(void)
     PyModule_AddIntConstant(m, "LRO_REPOTYPE", LRO_REPOTYPE);
     PyModule_AddIntConstant(m, "LRO_CONNECTTIMEOUT", LRO_CONNECTTIMEOUT);
     PyModule_AddIntConstant(m, "LRO_IGNOREMISSING", LRO_IGNOREMISSING);
+    PyModule_AddIntConstant(m, "LRO_MAXPARALLELDOWNLOADS", LRO_MAXPARALLELDOWNLOADS);
+    PyModule_AddIntConstant(m, "LRO_MAXDOWNLOADSPERMIRROR", LRO_MAXDOWNLOADSPERMIRROR);
+    PyModule_AddIntConstant(m, "LRO_WRITEBUFFERSIZE", LRO_WRITEBUFFERSIZE);
+    PyModule_AddIntConstant(m, "LRO_MIRRORPROBE", LRO_MIRRORPROBE);
+    PyModule_AddIntConstant(m, "LRO_MIRRORPROBETIMEOUT", LRO_MIRRORPROBETIMEOUT);
+    PyModule_AddIntConstant(m, "LRO_MIRRORSTATS", LRO_MIRRORSTATS);
+    PyModule_AddIntConstant(m, "LRO_SEGMENTS", LRO_SEGMENTS);
+    PyModule_AddIntConstant(m, "LRO_SEGMENTSIZE", LRO_SEGMENTSIZE);
+    PyModule_AddIntConstant(m, "LRO_IFMODIFIED", LRO_IFMODIFIED);
+    PyModule_AddIntConstant(m, "LRO_OLDDESTDIR", LRO_OLDDESTDIR);
+    PyModule_AddIntConstant(m, "LRO_CACHEDIR", LRO_CACHEDIR);
+    PyModule_AddIntConstant(m, "LRO_DECOMPRESS", LRO_DECOMPRESS);
     PyModule_AddIntConstant(m, "LRO_GPGCHECK", LRO_GPGCHECK);
     PyModule_AddIntConstant(m, "LRO_CHECKSUM", LRO_CHECKSUM);
+    PyModule_AddIntConstant(m, "LRO_CHECKSUMTHREADS", LRO_CHECKSUMTHREADS);
+    PyModule_AddIntConstant(m, "LRO_CHECKSUMCACHE", LRO_CHECKSUMCACHE);
     PyModule_AddIntConstant(m, "LRO_YUMDLIST", LRO_YUMDLIST);
     PyModule_AddIntConstant(m, "LRO_YUMBLIST", LRO_YUMBLIST);
     PyModule_AddIntConstant(m, "LRO_SENTINEL", LRO_SENTINEL);
@@ -144,6 +163,11 @@ init_librepo(void)
     PyModule_AddIntConstant(m, "LR_PROXY_SOCKS4A", LR_PROXY_SOCKS4A);
     PyModule_AddIntConstant(m, "LR_PROXY_SOCKS5_HOSTNAME", LR_PROXY_SOCKS5_HOSTNAME);
 
+    /* Decompression of metadata */
+    PyModule_AddIntConstant(m, "LR_DECOMPRESS_NONE", LR_DECOMPRESS_NONE);
+    PyModule_AddIntConstant(m, "LR_DECOMPRESS_KEEP", LR_DECOMPRESS_KEEP);
+    PyModule_AddIntConstant(m, "LR_DECOMPRESS_ONLY", LR_DECOMPRESS_ONLY);
+
     /* Return codes */
     PyModule_AddIntConstant(m, "LRE_OK", LRE_OK);
     PyModule_AddIntConstant(m, "LRE_BADFUNCARG", LRE_BADFUNCARG);
@@ -172,11 +196,14 @@ init_librepo(void)
     PyModule_AddIntConstant(m, "LRE_GPGERROR", LRE_GPGERROR);
     PyModule_AddIntConstant(m, "LRE_BADGPG", LRE_BADGPG);
     PyModule_AddIntConstant(m, "LRE_INCOMPLETEREPO", LRE_INCOMPLETEREPO);
+    PyModule_AddIntConstant(m, "LRE_NOTMODIFIED", LRE_NOTMODIFIED);
+    PyModule_AddIntConstant(m, "LRE_DECOMPRESSION", LRE_DECOMPRESSION);
     PyModule_AddIntConstant(m, "LRE_UNKNOWNERROR", LRE_UNKNOWNERROR);
 
     /* Result option */
     PyModule_AddIntConstant(m, "LRR_YUM_REPO", LRR_YUM_REPO);
     PyModule_AddIntConstant(m, "LRR_YUM_REPOMD", LRR_YUM_REPOMD);
+    PyModule_AddIntConstant(m, "LRR_YUM_CHECKSUMS", LRR_YUM_CHECKSUMS);
     PyModule_AddIntConstant(m, "LRR_SENTINEL", LRR_SENTINEL);
 
     /* Checksums */
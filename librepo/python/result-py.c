@@ -140,6 +140,18 @@ getinfo(_ResultObject *self, PyObject *args)
         return PyObject_FromYumRepoMd(repomd);
     }
 
+    case LRR_YUM_CHECKSUMS: {
+        int *checksums;
+        lr_YumRepoMd repomd;
+        res = lr_result_getinfo(self->result, (lr_ResultInfoOption)option, &checksums);
+        if (res != LRE_OK)
+            RETURN_ERROR(res, NULL);
+        res = lr_result_getinfo(self->result, LRR_YUM_REPOMD, &repomd);
+        if (res != LRE_OK)
+            RETURN_ERROR(res, NULL);
+        return PyObject_FromYumChecksums(repomd, checksums);
+    }
+
     /*
      * Unknown options
      */
@@ -125,3 +125,27 @@ PyObject_FromYumRepoMd(lr_YumRepoMd repomd)
 
     return dict;
 }
+
+PyObject *
+PyObject_FromYumChecksums(lr_YumRepoMd repomd, int *rcs)
+{
+    PyObject *dict;
+
+    if (!repomd || !rcs)
+        Py_RETURN_NONE;
+
+    if ((dict = PyDict_New()) == NULL)
+        return NULL;
+
+    for (int x=0; x < repomd->nor; x++) {
+        PyObject *rc = PyInt_FromLong((long) rcs[x]);
+        if (!rc || PyDict_SetItemString(dict, repomd->records[x]->type, rc)) {
+            Py_XDECREF(rc);
+            Py_DECREF(dict);
+            return NULL;
+        }
+        Py_DECREF(rc);
+    }
+
+    return dict;
+}
@@ -25,5 +25,6 @@
 
 PyObject *PyObject_FromYumRepo(lr_YumRepo repo);
 PyObject *PyObject_FromYumRepoMd(lr_YumRepoMd repomd);
+PyObject *PyObject_FromYumChecksums(lr_YumRepoMd repomd, int *rcs);
 
 #endif
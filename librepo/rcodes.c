@@ -77,6 +77,10 @@ lr_strerror(int rc)
         return "Repository metadata are not complete";
     case LRE_BADGPG:
         return "Bad GPG signature";
+    case LRE_NOTMODIFIED:
+        return "Repository was not modified";
+    case LRE_DECOMPRESSION:
+        return "Decompression error";
     }
 
     return "Unknown error";
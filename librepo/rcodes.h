@@ -73,6 +73,12 @@ typedef enum {
     LRE_GPGERROR,                   /*!< (24) GPG error */
     LRE_BADGPG,                     /*!< (25) Bad GPG signature */
     LRE_INCOMPLETEREPO,             /*!< (26) Repository metadata are not complete */
+    LRE_NOTMODIFIED,                /*!< (27) Repository was not modified
+                                         since the last download
+                                         (LRO_IFMODIFIED), the result
+                                         describes the local one */
+    LRE_DECOMPRESSION,              /*!< (28) Decompression of a downloaded
+                                         file failed (LRO_DECOMPRESS) */
     LRE_UNKNOWNERROR,               /*!< unknown error - sentinel of
                                          error codes enum */
 } lr_Rc; /*!< Return codes */
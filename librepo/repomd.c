@@ -440,48 +440,117 @@ lr_end_handler(void *pdata, const char *element)
     return;
 }
 
-int
-lr_yum_repomd_parse_file(lr_YumRepoMd repomd, int fd)
+/** Incremental (push) parser of repomd.xml */
+struct _lr_YumRepoMdParser {
+    XML_Parser parser;      /*!< expat parser */
+    ParserData pd;          /*!< parser state */
+    lr_YumRepoMd repomd;    /*!< filled repomd object */
+    int ret;                /*!< status of parsing (first error) */
+};
+
+/** Create expat parser and initialize parser data */
+static void
+lr_yum_repomd_parser_setup(lr_YumRepoMdParser p)
 {
-    int ret = LRE_OK;
-    XML_Parser parser;
-    ParserData pd;
     lr_StatesSwitch *sw;
-
-    assert(repomd);
-    DEBUGASSERT(fd >= 0);
+    ParserData *pd = &p->pd;
 
     /* Parser configuration */
-    parser = XML_ParserCreate(NULL);
-    XML_SetUserData(parser, (void *) &pd);
-    XML_SetElementHandler(parser, lr_start_handler, lr_end_handler);
-    XML_SetCharacterDataHandler(parser, lr_char_handler);
+    p->parser = XML_ParserCreate(NULL);
+    XML_SetUserData(p->parser, (void *) pd);
+    XML_SetElementHandler(p->parser, lr_start_handler, lr_end_handler);
+    XML_SetCharacterDataHandler(p->parser, lr_char_handler);
 
     /* Initialization of parser data */
-    memset(&pd, 0, sizeof(pd));
-    pd.ret = LRE_OK;
-    pd.depth = 0;
-    pd.state = STATE_START;
-    pd.statedepth = 0;
-    pd.docontent = 0;
-    pd.content = lr_malloc(CONTENT_REALLOC_STEP);
-    pd.lcontent = 0;
-    pd.acontent = CONTENT_REALLOC_STEP;
-    pd.parser = &parser;
-    pd.repomd = repomd;
+    memset(pd, 0, sizeof(*pd));
+    pd->ret = LRE_OK;
+    pd->depth = 0;
+    pd->state = STATE_START;
+    pd->statedepth = 0;
+    pd->docontent = 0;
+    pd->content = lr_malloc(CONTENT_REALLOC_STEP);
+    pd->lcontent = 0;
+    pd->acontent = CONTENT_REALLOC_STEP;
+    pd->parser = &p->parser;
+    pd->repomd = p->repomd;
     for (sw = stateswitches; sw->from != NUMSTATES; sw++) {
-        if (!pd.swtab[sw->from])
-            pd.swtab[sw->from] = sw;
-        pd.sbtab[sw->to] = sw->from;
+        if (!pd->swtab[sw->from])
+            pd->swtab[sw->from] = sw;
+        pd->sbtab[sw->to] = sw->from;
     }
 
-    /* Parse */
+    p->ret = LRE_OK;
+}
 
-    for (;;) {
-        char *buf;
-        int len;
+/** Free expat parser and parser data */
+static void
+lr_yum_repomd_parser_cleanup(lr_YumRepoMdParser p)
+{
+    lr_free(p->pd.content);
+    p->pd.content = NULL;
+    XML_ParserFree(p->parser);
+    p->parser = NULL;
+}
+
+/** Check result of the last XML_Parse or XML_ParseBuffer call */
+static int
+lr_yum_repomd_parser_check(lr_YumRepoMdParser p, int rc)
+{
+    if (!rc) {
+        DPRINTF("%s: parsing error: %s\n", __func__,
+                XML_ErrorString(XML_GetErrorCode(p->parser)));
+        p->ret = LRE_REPOMDXML;
+    } else if (p->pd.ret != LRE_OK) {
+        p->ret = p->pd.ret;
+    }
+
+    return p->ret;
+}
+
+lr_YumRepoMdParser
+lr_yum_repomd_parser_new(lr_YumRepoMd repomd)
+{
+    lr_YumRepoMdParser p;
+
+    assert(repomd);
 
-        buf = XML_GetBuffer(parser, CHUNK_SIZE);
+    p = lr_malloc0(sizeof(struct _lr_YumRepoMdParser));
+    p->repomd = repomd;
+    lr_yum_repomd_parser_setup(p);
+    return p;
+}
+
+void
+lr_yum_repomd_parser_reset(lr_YumRepoMdParser p)
+{
+    assert(p);
+    lr_yum_repomd_parser_cleanup(p);
+    lr_yum_repomd_clear(p->repomd);
+    lr_yum_repomd_parser_setup(p);
+}
+
+int
+lr_yum_repomd_parser_feed(lr_YumRepoMdParser p, const char *buf, size_t len)
+{
+    assert(p);
+
+    while (len > 0 && p->ret == LRE_OK) {
+        int chunk = (len > CHUNK_SIZE) ? CHUNK_SIZE : (int) len;
+        lr_yum_repomd_parser_check(p, XML_Parse(p->parser, buf, chunk, 0));
+        buf += chunk;
+        len -= chunk;
+    }
+
+    return p->ret;
+}
+
+/** Read the whole file and feed it to the parser */
+static int
+lr_yum_repomd_parser_feed_fd(lr_YumRepoMdParser p, int fd)
+{
+    while (p->ret == LRE_OK) {
+        int len;
+        char *buf = XML_GetBuffer(p->parser, CHUNK_SIZE);
         if (!buf)
             lr_out_of_memory();
 
@@ -489,30 +558,66 @@ lr_yum_repomd_parse_file(lr_YumRepoMd repomd, int fd)
         if (len < 0) {
             DPRINTF("%s: Cannot read for parsing : %s\n",
                     __func__, strerror(errno));
-            ret = LRE_IO;
-            break;
-        }
-
-        if (!XML_ParseBuffer(parser, len, len == 0)) {
-            DPRINTF("%s: parsing error: %s\n",
-                    __func__, XML_ErrorString(XML_GetErrorCode(parser)));
-            ret = LRE_REPOMDXML;
+            p->ret = LRE_IO;
             break;
         }
 
         if (len == 0)
             break;
 
-        if (pd.ret != LRE_OK) {
-            ret = pd.ret;
-            break;
-        }
+        lr_yum_repomd_parser_check(p, XML_ParseBuffer(p->parser, len, 0));
     }
 
-    /* Parser data cleanup */
-    lr_free(pd.content);
-    XML_ParserFree(parser);
+    return p->ret;
+}
+
+int
+lr_yum_repomd_parser_finish(lr_YumRepoMdParser p)
+{
+    assert(p);
+
+    if (p->ret == LRE_OK)
+        lr_yum_repomd_parser_check(p, XML_Parse(p->parser, NULL, 0, 1));
+
+    return p->ret;
+}
+
+void
+lr_yum_repomd_parser_free(lr_YumRepoMdParser p)
+{
+    if (!p)
+        return;
+    lr_yum_repomd_parser_cleanup(p);
+    lr_free(p);
+}
+
+int
+lr_yum_repomd_parse_file(lr_YumRepoMd repomd, int fd)
+{
+    lr_YumRepoMdParser p;
+    int ret;
+
+    DEBUGASSERT(fd >= 0);
+
+    p = lr_yum_repomd_parser_new(repomd);
+    lr_yum_repomd_parser_feed_fd(p, fd);
+    ret = lr_yum_repomd_parser_finish(p);
+    lr_yum_repomd_parser_free(p);
+    return ret;
+}
+
+int
+lr_yum_repomd_parse_buf(lr_YumRepoMd repomd, const char *buf, size_t len)
+{
+    lr_YumRepoMdParser p;
+    int ret;
+
+    assert(buf || len == 0);
 
+    p = lr_yum_repomd_parser_new(repomd);
+    lr_yum_repomd_parser_feed(p, buf, len);
+    ret = lr_yum_repomd_parser_finish(p);
+    lr_yum_repomd_parser_free(p);
     return ret;
 }
 
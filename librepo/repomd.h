@@ -24,6 +24,8 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
+
 #include "types.h"
 
 /** \defgroup repomd        Repomd parser
@@ -97,6 +99,54 @@ void lr_yum_repomd_free(lr_YumRepoMd repomd);
  */
 int lr_yum_repomd_parse_file(lr_YumRepoMd repomd, int fd);
 
+/** Parse repomd.xml from the memory buffer.
+ * @param repomd        Empty repomd object.
+ * @param buf           Content of repomd.xml.
+ * @param len           Length of the content.
+ * @return              Librepo return code ::lr_Rc.
+ */
+int lr_yum_repomd_parse_buf(lr_YumRepoMd repomd, const char *buf, size_t len);
+
+/** Incremental (push) repomd.xml parser. The data could be fed to the
+ * parser in arbitrary pieces as they arrive (e.g. from the network).
+ */
+typedef struct _lr_YumRepoMdParser *lr_YumRepoMdParser;
+
+/** Create new incremental repomd.xml parser.
+ * @param repomd        Empty repomd object which will be filled.
+ * @return              New parser.
+ */
+lr_YumRepoMdParser lr_yum_repomd_parser_new(lr_YumRepoMd repomd);
+
+/** Parse next piece of repomd.xml.
+ * @param parser        Repomd parser.
+ * @param buf           Data.
+ * @param len           Length of the data.
+ * @return              Librepo return code ::lr_Rc. After the first
+ *                      error the rest of the data is ignored and the
+ *                      same error is returned.
+ */
+int lr_yum_repomd_parser_feed(lr_YumRepoMdParser parser,
+                              const char *buf,
+                              size_t len);
+
+/** Throw away everything parsed so far (repomd object is cleared)
+ * and start again from the beginning of the document.
+ * @param parser        Repomd parser.
+ */
+void lr_yum_repomd_parser_reset(lr_YumRepoMdParser parser);
+
+/** Finish parsing - the whole document was fed to the parser.
+ * @param parser        Repomd parser.
+ * @return              Librepo return code ::lr_Rc.
+ */
+int lr_yum_repomd_parser_finish(lr_YumRepoMdParser parser);
+
+/** Free the parser (repomd object is not freed).
+ * @param parser        Repomd parser.
+ */
+void lr_yum_repomd_parser_free(lr_YumRepoMdParser parser);
+
 /** Get repomd record from the repomd object.
  * @param repomd        Repomd record.
  * @param type          Type of record e.g. "primary", "filelists", ...
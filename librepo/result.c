@@ -43,6 +43,7 @@ lr_result_clear(lr_Result result)
         return;
     lr_yum_repomd_free(result->yum_repomd);
     lr_yum_repo_free(result->yum_repo);
+    lr_free(result->yum_checksums);
     memset(result, 0, sizeof(struct _lr_Result));
 }
 
@@ -81,6 +82,13 @@ lr_result_getinfo(lr_Result result, lr_ResultInfoOption option, ...)
         break;
     }
 
+    case LRR_YUM_CHECKSUMS: {
+        int **checksums;
+        checksums = va_arg(arg, int **);
+        *checksums = result->yum_checksums;
+        break;
+    }
+
     default:
         rc = LRE_UNKNOWNOPT;
         break;
@@ -35,6 +35,12 @@ extern "C" {
 typedef enum {
     LRR_YUM_REPO,       /*!< (lr_YumRepo *) Reference to ::lr_YumRepo in result */
     LRR_YUM_REPOMD,     /*!< (lr_YumRepoMd *) Reference to ::lr_YumRepoMd in result */
+    LRR_YUM_CHECKSUMS,  /*!< (int **) Reference to array with return code
+                             (::lr_Rc) of the checksum check of each
+                             record (in order of records in the repomd).
+                             It is set only if checksums of a local
+                             repository (LRO_LOCAL) were checked,
+                             NULL otherwise. */
     LRR_SENTINEL,
 } lr_ResultInfoOption;
 
@@ -31,6 +31,8 @@ struct _lr_Result {
     char            *destdir;
     lr_YumRepoMd    yum_repomd;     /* pointer to struct representingrepomd.xml */
     lr_YumRepo      yum_repo;       /* pointer to struct with info about yum repo */
+    int             *yum_checksums; /* rc of the checksum check of each
+                                       repomd record or NULL */
 };
 
 #ifdef __cplusplus
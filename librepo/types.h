@@ -60,6 +60,14 @@ typedef enum {
     LR_PROXY_SOCKS5_HOSTNAME,   /*!< SOCKS5 proxy */
 } lr_ProxyType;
 
+/** Decompression of downloaded metadata (LRO_DECOMPRESS). */
+typedef enum {
+    LR_DECOMPRESS_NONE,         /*!< Keep compressed files only (Default) */
+    LR_DECOMPRESS_KEEP,         /*!< Keep both compressed and decompressed
+                                     files */
+    LR_DECOMPRESS_ONLY,         /*!< Keep decompressed files only */
+} lr_Decompress;
+
 /* Some common used arrays for LRO_YUMDLIST */
 
 /** Predefined value for LRO_YUMDLIST option - Download whole repo. */
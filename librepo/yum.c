@@ -30,6 +30,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <pthread.h>
 
 #include "setup.h"
 #include "yum.h"
@@ -44,8 +45,13 @@
 #include "yum_internal.h"
 #include "internal_mirrorlist.h"
 #include "curltargetlist.h"
+#include "cache.h"
+#include "decompress.h"
 #include "gpg.h"
 
+/** Validators of the downloaded repomd.xml (LRO_IFMODIFIED) */
+#define LR_YUM_VALIDATORS   "repodata/repomd.xml.validators"
+
 /* helper functions for YumRepo manipulation */
 
 lr_YumRepo
@@ -147,67 +153,307 @@ lr_yum_repomd_record_enabled(lr_Handle handle, const char *type)
     return 1;
 }
 
+/** lr_DataCb which feeds the repomd parser */
+static void
+lr_yum_repomd_data_cb(void *data, const char *buf, size_t len)
+{
+    lr_YumRepoMdParser parser = data;
+
+    if (!buf)
+        lr_yum_repomd_parser_reset(parser);
+    else
+        lr_yum_repomd_parser_feed(parser, buf, len);
+}
+
+/** Select the best known checksum of repomd.xml from the metalink.
+ * @param checksum          The checksum value (not a copy) or NULL.
+ * @return                  Checksum type or LR_CHECKSUM_UNKNOWN.
+ */
+static lr_ChecksumType
+lr_yum_metalink_checksum(lr_Metalink metalink, char **checksum)
+{
+    lr_ChecksumType checksum_type = LR_CHECKSUM_UNKNOWN;
+
+    *checksum = NULL;
+    for (int x = 0; x < metalink->noh; x++) {
+        lr_ChecksumType mtype;
+        lr_MetalinkHash mhash = metalink->hashes[x];
+
+        if (!mhash->type || !mhash->value)
+            continue;
+
+        mtype = lr_checksum_type(mhash->type);
+        if (mtype != LR_CHECKSUM_UNKNOWN && mtype > checksum_type) {
+            checksum_type = mtype;
+            *checksum = mhash->value;
+        }
+    }
+
+    return checksum_type;
+}
+
+/** Download repomd.xml to the fd. The repomd.xml is parsed into
+ * the repomd object while it is downloaded.
+ */
 int
 lr_yum_download_repomd(lr_Handle handle,
                        lr_Metalink metalink,
-                       int fd)
+                       int fd,
+                       lr_YumRepoMd repomd,
+                       lr_CurlValidators validators)
 {
     int rc = LRE_OK;
     lr_ChecksumType checksum_type = LR_CHECKSUM_UNKNOWN;
     char *checksum = NULL;
+    lr_YumRepoMdParser parser;
 
 
     DPRINTF("%s: Downloading repomd.xml via mirrorlist\n", __func__);
 
     if (metalink && (handle->checks & LR_CHECK_CHECKSUM)) {
         /* Select the best checksum type */
-        for (int x = 0; x < metalink->noh; x++) {
-            lr_ChecksumType mtype;
-            lr_MetalinkHash mhash = metalink->hashes[x];
-
-            if (!mhash->type || !mhash->value)
-                continue;
-
-            mtype = lr_checksum_type(mhash->type);
-            if (mtype != LR_CHECKSUM_UNKNOWN && mtype > checksum_type) {
-                checksum_type = mtype;
-                checksum = mhash->value;
-            }
-        }
-
+        checksum_type = lr_yum_metalink_checksum(metalink, &checksum);
         DPRINTF("%s: selected repomd.xml checksum to check: (%s) %s\n",
                 __func__, lr_checksum_type_to_str(checksum_type), checksum);
     }
 
-    rc = lr_curl_single_mirrored_download(handle,
-                                          "repodata/repomd.xml",
-                                          fd,
-                                          checksum_type,
-                                          checksum);
-
-    if (rc != LRE_OK) {
+    parser = lr_yum_repomd_parser_new(repomd);
+    rc = lr_curl_single_mirrored_download_cb(handle,
+                                             "repodata/repomd.xml",
+                                             fd,
+                                             checksum_type,
+                                             checksum,
+                                             (metalink) ? metalink->size : 0,
+                                             validators,
+                                             lr_yum_repomd_data_cb,
+                                             parser);
+
+    if (rc == LRE_NOTMODIFIED) {
+        DPRINTF("%s: repomd.xml was not modified\n", __func__);
+    } else if (rc != LRE_OK) {
         /* Download of repomd.xml was not successful */
         DPRINTF("%s: repomd.xml download was unsuccessful\n", __func__);
-        return rc;
+    } else {
+        /* The whole repomd.xml was already fed to the parser */
+        DPRINTF("%s: Parsing repomd.xml\n", __func__);
+        rc = lr_yum_repomd_parser_finish(parser);
+        if (rc != LRE_OK)
+            DPRINTF("%s: Parsing unsuccessful (%d)\n", __func__, rc);
     }
+    lr_yum_repomd_parser_free(parser);
 
-    return LRE_OK;
+    /* Data parsed from a failed (or rejected) download are not valid */
+    if (rc != LRE_OK)
+        lr_yum_repomd_clear(repomd);
+
+    return rc;
 }
 
-int
-lr_yum_download_repo(lr_Handle handle, lr_YumRepo repo, lr_YumRepoMd repomd)
+/** Parse repomd.xml of the previous copy of the repository
+ * (LRO_OLDDESTDIR).
+ * @return                  Parsed repomd or NULL if it is not available.
+ */
+static lr_YumRepoMd
+lr_yum_old_repomd(lr_Handle handle)
+{
+    int fd;
+    char *path;
+    lr_YumRepoMd repomd;
+
+    if (!handle->olddestdir || !strcmp(handle->olddestdir, handle->destdir))
+        return NULL;
+
+    path = lr_pathconcat(handle->olddestdir, "repodata/repomd.xml", NULL);
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        DPRINTF("%s: open(%s): %s\n", __func__, path, strerror(errno));
+        lr_free(path);
+        return NULL;
+    }
+    lr_free(path);
+
+    repomd = lr_yum_repomd_init();
+    if (lr_yum_repomd_parse_file(repomd, fd) != LRE_OK) {
+        DPRINTF("%s: Cannot parse old repomd.xml\n", __func__);
+        lr_yum_repomd_free(repomd);
+        repomd = NULL;
+    }
+
+    close(fd);
+    return repomd;
+}
+
+/** Reuse the metadata file from the previous copy of the repository
+ * if its checksum didn't change.
+ * @param path              Destination path of the file.
+ * @param decompressed      If not 0, the decompressed file (LRO_DECOMPRESS)
+ *                          is reused and path is its destination path.
+ * @return                  1 if the file was reused, 0 if it has
+ *                          to be downloaded.
+ */
+static int
+lr_yum_reuse_old_file(lr_Handle handle,
+                      lr_YumRepoMd old_repomd,
+                      lr_YumRepoMdRecord record,
+                      const char *path,
+                      int decompressed)
+{
+    char *old_path;
+    lr_YumRepoMdRecord old;
+
+    old = lr_yum_repomd_get_record(old_repomd, record->type);
+    if (!old || !old->location_href
+        || !old->checksum || !record->checksum
+        || !old->checksum_type || !record->checksum_type
+        || strcmp(old->checksum_type, record->checksum_type)
+        || strcmp(old->checksum, record->checksum))
+        return 0;  /* Changed (or unknown) file */
+
+    old_path = lr_pathconcat(handle->olddestdir, old->location_href, NULL);
+    if (decompressed) {
+        char *open_path = lr_decompressed_path(old_path);
+        lr_free(old_path);
+        if (!open_path)
+            return 0;
+        old_path = open_path;
+    }
+
+    /* The old file could be damaged since it was downloaded */
+    if (handle->checks & LR_CHECK_CHECKSUM
+        && lr_yum_check_checksum_of_md_record(record, old_path,
+                                              handle->checksumcache) != LRE_OK)
+    {
+        lr_free(old_path);
+        return 0;
+    }
+
+    if (lr_clone_file(old_path, path)) {
+        DPRINTF("%s: Cannot reuse %s: %s\n",
+                __func__, old_path, strerror(errno));
+        lr_free(old_path);
+        return 0;
+    }
+
+    DPRINTF("%s: %s reused from %s\n", __func__, record->type, old_path);
+    lr_free(old_path);
+    return 1;
+}
+
+/** Decompress the metadata file which was not downloaded but taken
+ * from a local copy (LRO_OLDDESTDIR or LRO_CACHEDIR).
+ */
+static int
+lr_yum_decompress_record(lr_Handle handle,
+                         lr_YumRepoMdRecord record,
+                         const char *path,
+                         const char *open_path)
+{
+    int rc;
+
+    /* The decompressed file may be a hardlink to a cache entry */
+    unlink(open_path);
+    rc = lr_decompress_file(lr_compression_type(path), path, open_path,
+                            lr_checksum_type(record->checksum_open_type),
+                            (handle->checks & LR_CHECK_CHECKSUM)
+                                ? record->checksum_open : NULL,
+                            record->size_open);
+    if (rc != LRE_OK)
+        DPRINTF("%s: Cannot decompress %s: %s\n",
+                __func__, path, lr_strerror(rc));
+    return rc;
+}
+
+/** Take the metadata file from a local copy (LRO_OLDDESTDIR or
+ * LRO_CACHEDIR) instead of downloading it.
+ * With LR_DECOMPRESS_ONLY the decompressed file is looked for first,
+ * because the compressed one is not kept.
+ * @param path              Destination path of the file.
+ * @param open_path         Destination path of the decompressed file
+ *                          or NULL if the file is not decompressed.
+ * @return                  Path of the file which should be used
+ *                          (path or open_path) or NULL if the file
+ *                          has to be downloaded.
+ */
+static const char *
+lr_yum_local_copy(lr_Handle handle,
+                  lr_YumRepoMd old_repomd,
+                  lr_YumRepoMdRecord record,
+                  const char *path,
+                  const char *open_path)
+{
+    int only = (open_path && handle->decompress == LR_DECOMPRESS_ONLY);
+
+    if (only
+        && ((old_repomd
+             && lr_yum_reuse_old_file(handle, old_repomd, record,
+                                      open_path, 1))
+            || lr_cache_get(handle,
+                            lr_checksum_type(record->checksum_open_type),
+                            record->checksum_open, open_path)))
+        return open_path;
+
+    if (!(old_repomd
+          && lr_yum_reuse_old_file(handle, old_repomd, record, path, 0))
+        && !lr_cache_get(handle, lr_checksum_type(record->checksum_type),
+                         record->checksum, path))
+        return NULL;
+
+    if (open_path
+        && lr_yum_decompress_record(handle, record, path, open_path) != LRE_OK)
+        return NULL;
+
+    if (only) {
+        unlink(path);
+        return open_path;
+    }
+    return path;
+}
+
+/** Free decompressors of lr_yum_download_repo */
+static void
+lr_yum_free_decompressors(lr_Decompressor *decompressors, int count)
+{
+    for (int x = 0; x < count; x++)
+        lr_decompressor_free(decompressors[x]);
+    lr_free(decompressors);
+}
+
+/** Download metadata files of all enabled repomd records.
+ * @param signature         If not NULL, repomd.xml.asc is downloaded
+ *                          to this path in parallel with the metadata
+ *                          files. It is downloaded only from the mirror
+ *                          used for repomd.xml.
+ * @param sig_rc            Result of the signature download (LRE_OK if
+ *                          no signature was requested).
+ * @return                  ::lr_Rc value. Failed download of the signature
+ *                          is not an error.
+ */
+static int
+lr_yum_download_repo(lr_Handle handle,
+                     lr_YumRepo repo,
+                     lr_YumRepoMd repomd,
+                     const char *signature,
+                     int *sig_rc)
 {
     int ret = LRE_OK;
     char *destdir;  /* Destination dir */
+    lr_CurlTarget sig_target = NULL;
     lr_CurlTargetList targets = lr_curltargetlist_new();
+    lr_YumRepoMd old_repomd;
+    lr_Decompressor *decompressors; /* Per record, NULL if not decompressed */
 
     destdir = handle->destdir;
     DEBUGASSERT(destdir);
     DEBUGASSERT(strlen(destdir));
 
+    old_repomd = lr_yum_old_repomd(handle);
+    decompressors = lr_malloc0(sizeof(lr_Decompressor) * (repomd->nor + 1));
+
     for (int x = 0; x < repomd->nor; x++) {
-        int fd;
+        int fd = -1;
         char *path;
+        char *open_path = NULL; /* Path of the decompressed file */
+        const char *local_path;
         lr_CurlTarget target;
         lr_YumRepoMdRecord record = repomd->records[x];
 
@@ -215,12 +461,54 @@ lr_yum_download_repo(lr_Handle handle, lr_YumRepo repo, lr_YumRepoMd repomd)
             continue;
 
         path = lr_pathconcat(destdir, record->location_href, NULL);
-        fd = open(path, O_CREAT|O_TRUNC|O_RDWR, 0660);
-        if (fd < 0) {
-            DPRINTF("%s: Cannot create/open %s (%s)\n",
-                    __func__, path, strerror(errno));
+        if (handle->decompress != LR_DECOMPRESS_NONE)
+            open_path = lr_decompressed_path(path);
+
+        local_path = lr_yum_local_copy(handle, old_repomd, record,
+                                       path, open_path);
+        if (local_path) {
+            /* Unchanged or cached file - no download is needed */
+            lr_yum_repo_update(repo, record->type, local_path);
             lr_free(path);
-            return LRE_IO;
+            lr_free(open_path);
+            continue;
+        }
+
+        /* The file may be a hardlink to a file in the old destdir
+         * or in the cache, never truncate and write into it in place */
+        unlink(path);
+        if (!open_path || handle->decompress != LR_DECOMPRESS_ONLY) {
+            fd = open(path, O_CREAT|O_TRUNC|O_RDWR, 0660);
+            if (fd < 0) {
+                DPRINTF("%s: Cannot create/open %s (%s)\n",
+                        __func__, path, strerror(errno));
+                lr_free(path);
+                lr_free(open_path);
+                lr_yum_repomd_free(old_repomd);
+                lr_yum_free_decompressors(decompressors, repomd->nor);
+                return LRE_IO;
+            }
+        }
+
+        if (open_path) {
+            /* Data are decompressed as they arrive */
+            unlink(open_path);
+            decompressors[x] = lr_decompressor_new(
+                            lr_compression_type(path),
+                            open_path,
+                            lr_checksum_type(record->checksum_open_type),
+                            (handle->checks & LR_CHECK_CHECKSUM)
+                                ? record->checksum_open : NULL,
+                            record->size_open);
+            if (!decompressors[x]) {
+                if (fd >= 0)
+                    close(fd);
+                lr_free(path);
+                lr_free(open_path);
+                lr_yum_repomd_free(old_repomd);
+                lr_yum_free_decompressors(decompressors, repomd->nor);
+                return LRE_IO;
+            }
         }
 
         target = lr_curltarget_new();
@@ -228,22 +516,126 @@ lr_yum_download_repo(lr_Handle handle, lr_YumRepo repo, lr_YumRepoMd repomd)
         target->fd = fd;
         target->checksum_type = lr_checksum_type(record->checksum_type);
         target->checksum = lr_strdup(record->checksum);
+        target->expected_size = record->size;
+        if (decompressors[x]) {
+            target->data_cb = lr_decompressor_cb;
+            target->data_end_cb = lr_decompressor_finish_cb;
+            target->data_cb_data = decompressors[x];
+            /* Compressed data are not stored at all */
+            target->in_memory = (fd < 0);
+        }
         lr_curltargetlist_append(targets, target);
 
         /* Becouse path may already exists in repo (while update) */
-        lr_yum_repo_update(repo, record->type, path);
+        lr_yum_repo_update(repo, record->type, (fd < 0) ? open_path : path);
         lr_free(path);
+        lr_free(open_path);
+    }
+
+    lr_yum_repomd_free(old_repomd);
+
+    if (signature) {
+        /* File is opened right before its download */
+        sig_target = lr_curltarget_new();
+        sig_target->path = lr_strdup("repodata/repomd.xml.asc");
+        sig_target->fd = -1;
+        sig_target->fn = lr_strdup(signature);
+        sig_target->checksum_type = LR_CHECKSUM_UNKNOWN;
+        sig_target->base_url = lr_strdup(handle->used_mirror);
+        /* Missing signature is not an error of the mirror */
+        sig_target->optional = 1;
+        lr_curltargetlist_append(targets, sig_target);
     }
 
     if (lr_curltargetlist_len(targets) > 0)
         ret = lr_curl_multi_download(handle, targets);
 
+    /* Failed download of the signature doesn't affect ret */
+    *sig_rc = LRE_OK;
+    if (sig_target && !sig_target->downloaded)
+        *sig_rc = (sig_target->rc != LRE_OK) ? sig_target->rc
+                                             : LRE_UNKNOWNERROR;
+
     lr_curltargetlist_free(targets);
+    /* Decompressed files were verified by lr_curl_multi_download */
+    lr_yum_free_decompressors(decompressors, repomd->nor);
+
+    if (ret == LRE_OK && handle->cachedir) {
+        /* All files were verified, offer them to the cache */
+        for (int x = 0; x < repomd->nor; x++) {
+            lr_YumRepoMdRecord record = repomd->records[x];
+
+            char *repo_path;
+
+            if (!lr_yum_repomd_record_enabled(handle, record->type))
+                continue;
+            repo_path = lr_yum_repo_path(repo, record->type);
+
+            if (handle->decompress != LR_DECOMPRESS_NONE
+                && lr_compression_type(record->location_href)
+                                                != LR_COMPRESSION_NONE) {
+                /* Decompressed file is stored under its open-checksum */
+                char *open_path = (handle->decompress == LR_DECOMPRESS_ONLY)
+                                  ? lr_strdup(repo_path)
+                                  : lr_decompressed_path(repo_path);
+                lr_cache_put(handle,
+                             lr_checksum_type(record->checksum_open_type),
+                             record->checksum_open, open_path);
+                lr_free(open_path);
+                if (handle->decompress == LR_DECOMPRESS_ONLY)
+                    continue;  /* Compressed file is not kept */
+            }
+
+            lr_cache_put(handle, lr_checksum_type(record->checksum_type),
+                         record->checksum, repo_path);
+        }
+    }
+
     return ret;
 }
 
+/** Remove metadata files downloaded by lr_yum_download_repo.
+ * Their paths are removed from the repo as well.
+ */
+static void
+lr_yum_remove_downloaded(lr_Handle handle,
+                         lr_YumRepo repo,
+                         lr_YumRepoMd repomd)
+{
+    int nop = 0;
+
+    for (int x = 0; x < repo->nop; x++) {
+        lr_YumRepoPath repopath = repo->paths[x];
+        char *path = repopath->path;
+
+        if (!lr_yum_repomd_get_record(repomd, repopath->type)
+            || !lr_yum_repomd_record_enabled(handle, repopath->type)) {
+            repo->paths[nop++] = repopath;  /* Not downloaded - keep it */
+            continue;
+        }
+
+        if (unlink(path) && errno != ENOENT)
+            DPRINTF("%s: Cannot remove %s: %s\n",
+                    __func__, path, strerror(errno));
+
+        if (handle->decompress == LR_DECOMPRESS_KEEP) {
+            char *open_path = lr_decompressed_path(path);
+            if (open_path)
+                unlink(open_path);
+            lr_free(open_path);
+        }
+
+        lr_free(repopath->type);
+        lr_free(repopath->path);
+        lr_free(repopath);
+    }
+    repo->nop = nop;
+}
+
 int
-lr_yum_check_checksum_of_md_record(lr_YumRepoMdRecord rec, char *path)
+lr_yum_check_checksum_of_md_record(lr_YumRepoMdRecord rec,
+                                   char *path,
+                                   int caching)
 {
     int ret, fd;
     char *expected_checksum;
@@ -252,11 +644,19 @@ lr_yum_check_checksum_of_md_record(lr_YumRepoMdRecord rec, char *path)
     if (!rec || !path)
         return LRE_OK;
 
-    expected_checksum = rec->checksum;
-    checksum_type = lr_checksum_type(rec->checksum_type);
+    if (lr_compression_type(rec->location_href) != LR_COMPRESSION_NONE
+        && lr_compression_type(path) == LR_COMPRESSION_NONE) {
+        /* Decompressed file (LR_DECOMPRESS_ONLY) */
+        expected_checksum = rec->checksum_open;
+        checksum_type = lr_checksum_type(rec->checksum_open_type);
+    } else {
+        expected_checksum = rec->checksum;
+        checksum_type = lr_checksum_type(rec->checksum_type);
+    }
 
     DPRINTF("%s: Checking checksum of %s (expected: %s [%s])\n",
-                       __func__, path, expected_checksum, rec->checksum_type);
+            __func__, path, expected_checksum,
+            lr_checksum_type_to_str(checksum_type));
 
     if (!expected_checksum) {
         DPRINTF("%s: No checksum in repomd\n", __func__);
@@ -264,7 +664,7 @@ lr_yum_check_checksum_of_md_record(lr_YumRepoMdRecord rec, char *path)
     }
 
     if (checksum_type == LR_CHECKSUM_UNKNOWN) {
-        DPRINTF("%s: Unknown checksum: %s\n", __func__, rec->checksum_type);
+        DPRINTF("%s: Unknown checksum\n", __func__);
         return LRE_UNKNOWNCHECKSUM;
     }
 
@@ -274,7 +674,7 @@ lr_yum_check_checksum_of_md_record(lr_YumRepoMdRecord rec, char *path)
         return LRE_IO;
     }
 
-    ret = lr_checksum_fd_cmp(checksum_type, fd, expected_checksum);
+    ret = lr_checksum_fd_compare(checksum_type, fd, expected_checksum, caching);
 
     close(fd);
 
@@ -288,46 +688,135 @@ lr_yum_check_checksum_of_md_record(lr_YumRepoMdRecord rec, char *path)
     return LRE_OK;
 }
 
-int
-lr_yum_check_repo_checksums(lr_YumRepo repo, lr_YumRepoMd repomd)
+/** Shared state of threads checking checksums of a repository */
+struct _lr_ChecksumJobs {
+    lr_YumRepo repo;
+    lr_YumRepoMd repomd;
+    int *rcs;               /*!< Return code of each record */
+    int caching;            /*!< Use checksum cache */
+    int next;               /*!< Index of the next unchecked record */
+    pthread_mutex_t lock;   /*!< Lock for the next */
+};
+
+static void *
+lr_yum_check_checksums_worker(void *data)
 {
-    for (int x=0; x < repomd->nor; x++) {
-        int ret;
-        lr_YumRepoMdRecord record  = repomd->records[x];
-        char *path = lr_yum_repo_path(repo, record->type);
-        ret = lr_yum_check_checksum_of_md_record(record, path);
-        DPRINTF("%s: Checksum rc: %d (%s)\n", __func__, ret, record->type);
-        if (ret != LRE_OK)
-            return ret;
+    struct _lr_ChecksumJobs *jobs = data;
+
+    while (1) {
+        int x;
+        char *path;
+        lr_YumRepoMdRecord record;
+
+        pthread_mutex_lock(&jobs->lock);
+        x = jobs->next++;
+        pthread_mutex_unlock(&jobs->lock);
+
+        if (x >= jobs->repomd->nor)
+            break;
+
+        record = jobs->repomd->records[x];
+        path = lr_yum_repo_path(jobs->repo, record->type);
+        jobs->rcs[x] = lr_yum_check_checksum_of_md_record(record,
+                                                          path,
+                                                          jobs->caching);
+        DPRINTF("%s: Checksum rc: %d (%s)\n",
+                __func__, jobs->rcs[x], record->type);
     }
 
-    return LRE_OK;
+    return NULL;
 }
 
 int
-lr_yum_use_local(lr_Handle handle, lr_Result result)
+lr_yum_check_repo_checksums(lr_YumRepo repo,
+                            lr_YumRepoMd repomd,
+                            int threads,
+                            int caching,
+                            int *rcs)
+{
+    int ret = LRE_OK;
+    int started = 0;
+    pthread_t *tids;
+    struct _lr_ChecksumJobs jobs;
+
+    assert(repo);
+    assert(repomd);
+
+    if (threads == 0)
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > repomd->nor)
+        threads = repomd->nor;
+
+    if (threads <= 1 && !rcs) {
+        /* Check records one by one and stop on the first error */
+        for (int x=0; x < repomd->nor; x++) {
+            lr_YumRepoMdRecord record  = repomd->records[x];
+            char *path = lr_yum_repo_path(repo, record->type);
+            ret = lr_yum_check_checksum_of_md_record(record, path, caching);
+            DPRINTF("%s: Checksum rc: %d (%s)\n", __func__, ret, record->type);
+            if (ret != LRE_OK)
+                return ret;
+        }
+        return LRE_OK;
+    }
+
+    DPRINTF("%s: Checking %d records by %d threads\n",
+            __func__, repomd->nor, threads);
+
+    jobs.repo = repo;
+    jobs.repomd = repomd;
+    jobs.rcs = rcs ? rcs : lr_malloc0(sizeof(int) * repomd->nor);
+    jobs.caching = caching;
+    jobs.next = 0;
+    pthread_mutex_init(&jobs.lock, NULL);
+
+    /* The calling thread is one of the workers */
+    tids = lr_malloc0(sizeof(pthread_t) * threads);
+    for (int x=0; x < threads-1; x++) {
+        if (pthread_create(&tids[started], NULL,
+                           lr_yum_check_checksums_worker, &jobs)) {
+            DPRINTF("%s: Cannot create thread\n", __func__);
+            break;
+        }
+        started++;
+    }
+
+    lr_yum_check_checksums_worker(&jobs);
+
+    for (int x=0; x < started; x++)
+        pthread_join(tids[x], NULL);
+
+    pthread_mutex_destroy(&jobs.lock);
+    lr_free(tids);
+
+    for (int x=0; x < repomd->nor; x++)
+        if (jobs.rcs[x] != LRE_OK) {
+            ret = jobs.rcs[x];
+            break;
+        }
+
+    if (!rcs)
+        lr_free(jobs.rcs);
+
+    return ret;
+}
+
+/** Locate the repository in the local directory. Its repomd.xml is
+ * parsed (unless LRO_UPDATE is used) and the enabled metadata files
+ * are found.
+ * @param baseurl           Path to the local repository.
+ */
+static int
+lr_yum_locate(lr_Handle handle, lr_Result result, const char *baseurl)
 {
     char *path;
     int rc = LRE_OK;
     int fd;
-    char *baseurl;
     lr_YumRepo repo;
     lr_YumRepoMd repomd;
 
-    DPRINTF("%s: Locating repo..\n", __func__);
-
     repo   = result->yum_repo;
     repomd = result->yum_repomd;
-    baseurl = handle->baseurl;
-
-    /* Do not duplicate repoata, just locate the local one */
-    if (strncmp(baseurl, "file://", 7)) {
-        if (strstr(baseurl, "://"))
-            return LRE_NOTLOCAL;
-    } else {
-        /* Skip file:// in baseurl */
-        baseurl = baseurl+7;
-    }
 
     if (!handle->update) {
         /* Open and parse repomd */
@@ -343,14 +832,13 @@ lr_yum_use_local(lr_Handle handle, lr_Result result)
 
         DPRINTF("%s: Parsing repomd.xml\n", __func__);
         rc = lr_yum_repomd_parse_file(repomd, fd);
+        close(fd);
         if (rc != LRE_OK) {
             DPRINTF("%s: Parsing unsuccessful (%d)\n", __func__, rc);
             lr_free(path);
             return rc;
         }
 
-        close(fd);
-
         /* Fill result object */
         result->destdir = lr_strdup(baseurl);
         repo->destdir = lr_strdup(baseurl);
@@ -387,6 +875,15 @@ lr_yum_use_local(lr_Handle handle, lr_Result result)
             continue; /* This path already exists in repo */
 
         path = lr_pathconcat(baseurl, record->location_href, NULL);
+        if (path && handle->decompress == LR_DECOMPRESS_ONLY
+            && access(path, F_OK) == -1) {
+            /* Only the decompressed file is kept (LRO_DECOMPRESS) */
+            char *open_path = lr_decompressed_path(path);
+            if (open_path) {
+                lr_free(path);
+                path = open_path;
+            }
+        }
         if (path) {
             if (access(path, F_OK) == -1) {
                 /* A repo file is missing */
@@ -405,13 +902,181 @@ lr_yum_use_local(lr_Handle handle, lr_Result result)
     return LRE_OK;
 }
 
+int
+lr_yum_use_local(lr_Handle handle, lr_Result result)
+{
+    char *baseurl;
+
+    DPRINTF("%s: Locating repo..\n", __func__);
+
+    baseurl = handle->baseurl;
+
+    /* Do not duplicate repoata, just locate the local one */
+    if (strncmp(baseurl, "file://", 7)) {
+        if (strstr(baseurl, "://"))
+            return LRE_NOTLOCAL;
+    } else {
+        /* Skip file:// in baseurl */
+        baseurl = baseurl+7;
+    }
+
+    return lr_yum_locate(handle, result, baseurl);
+}
+
+/** Load validators of the local repomd.xml stored by the last download
+ * with LRO_IFMODIFIED. Without the local repomd.xml or the stored
+ * validators the returned object is empty (unconditional download).
+ */
+static lr_CurlValidators
+lr_yum_validators_load(const char *destdir)
+{
+    FILE *f;
+    char line[1024];
+    char *path;
+    lr_CurlValidators validators = lr_curlvalidators_new();
+
+    path = lr_pathconcat(destdir, "repodata/repomd.xml", NULL);
+    if (access(path, F_OK) != 0) {
+        /* Nothing to validate */
+        lr_free(path);
+        return validators;
+    }
+    lr_free(path);
+
+    path = lr_pathconcat(destdir, LR_YUM_VALIDATORS, NULL);
+    f = fopen(path, "r");
+    lr_free(path);
+    if (!f)
+        return validators;
+
+    while (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (!strncmp(line, "ETag: ", 6)) {
+            lr_free(validators->etag);
+            validators->etag = lr_strdup(line + 6);
+        } else if (!strncmp(line, "Last-Modified: ", 15)) {
+            lr_free(validators->last_modified);
+            validators->last_modified = lr_strdup(line + 15);
+        }
+    }
+
+    fclose(f);
+    DPRINTF("%s: ETag: %s Last-Modified: %s\n", __func__,
+            validators->etag, validators->last_modified);
+    return validators;
+}
+
+/** Store validators of the downloaded repomd.xml for the next
+ * conditional download. */
+static void
+lr_yum_validators_save(const char *destdir, lr_CurlValidators validators)
+{
+    FILE *f;
+    char *path = lr_pathconcat(destdir, LR_YUM_VALIDATORS, NULL);
+
+    if (!validators->new_etag && !validators->new_last_modified) {
+        /* Server doesn't support conditional requests */
+        unlink(path);
+        lr_free(path);
+        return;
+    }
+
+    f = fopen(path, "w");
+    if (!f) {
+        DPRINTF("%s: Cannot open %s: %s\n", __func__, path, strerror(errno));
+        lr_free(path);
+        return;
+    }
+
+    if (validators->new_etag)
+        fprintf(f, "ETag: %s\n", validators->new_etag);
+    if (validators->new_last_modified)
+        fprintf(f, "Last-Modified: %s\n", validators->new_last_modified);
+
+    fclose(f);
+    lr_free(path);
+}
+
+/** Fill the result with the repository in the destdir, which is
+ * up to date. If it cannot be used (e.g. a metadata file is missing
+ * or, with LR_CHECK_CHECKSUM, it is damaged), the result is cleared again.
+ * @return                  LRE_NOTMODIFIED if the local repository
+ *                          is used, its error otherwise.
+ */
+static int
+lr_yum_use_unmodified(lr_Handle handle, lr_Result result)
+{
+    int rc = lr_yum_locate(handle, result, handle->destdir);
+
+    /* Files could be damaged (e.g. by an interrupted download) */
+    if (rc == LRE_OK && handle->checks & LR_CHECK_CHECKSUM)
+        rc = lr_yum_check_repo_checksums(result->yum_repo,
+                                         result->yum_repomd,
+                                         handle->checksumthreads,
+                                         handle->checksumcache,
+                                         NULL);
+
+    if (rc != LRE_OK) {
+        DPRINTF("%s: Local repository cannot be used (%d)\n", __func__, rc);
+        lr_yum_repo_clear(result->yum_repo);
+        lr_yum_repomd_clear(result->yum_repomd);
+        lr_free(result->destdir);
+        result->destdir = NULL;
+        return rc;
+    }
+
+    DPRINTF("%s: Local repository is up to date\n", __func__);
+    return LRE_NOTMODIFIED;
+}
+
+/** Compare the local repomd.xml in the destdir with the size and
+ * the checksum from the metalink.
+ * @return                  1 if the local repomd.xml is the current one,
+ *                          0 otherwise.
+ */
+static int
+lr_yum_metalink_matches_local(lr_Handle handle, lr_Metalink metalink)
+{
+    int fd, ret;
+    char *path;
+    char *checksum;
+    struct stat st;
+    lr_ChecksumType checksum_type;
+
+    checksum_type = lr_yum_metalink_checksum(metalink, &checksum);
+    if (checksum_type == LR_CHECKSUM_UNKNOWN)
+        return 0;  /* Nothing to compare with */
+
+    path = lr_pathconcat(handle->destdir, "repodata/repomd.xml", NULL);
+    fd = open(path, O_RDONLY);
+    lr_free(path);
+    if (fd < 0)
+        return 0;
+
+    if (metalink->size > 0
+        && (fstat(fd, &st) == -1 || st.st_size != metalink->size)) {
+        close(fd);
+        return 0;
+    }
+
+    ret = lr_checksum_fd_compare(checksum_type, fd, checksum,
+                                 handle->checksumcache);
+    close(fd);
+    DPRINTF("%s: Local repomd.xml %s the metalink\n",
+            __func__, (ret) ? "doesn't match" : "matches");
+    return !ret;
+}
+
 int
 lr_yum_download_remote(lr_Handle handle, lr_Result result)
 {
     int rc = LRE_OK;
     int fd;
     int create_repodata_dir = 1;
+    int sig_rc = LRE_OK;
     char *path_to_repodata;
+    char *signature = NULL;
+    lr_CurlValidators validators = NULL;
     lr_YumRepo repo;
     lr_YumRepoMd repomd;
 
@@ -421,12 +1086,20 @@ lr_yum_download_remote(lr_Handle handle, lr_Result result)
     if (rc != LRE_OK)
         return rc;
 
+    if (handle->ifmodified && !handle->update && handle->metalink
+        && lr_yum_metalink_matches_local(handle, handle->metalink)
+        && lr_yum_use_unmodified(handle, result) == LRE_NOTMODIFIED)
+        return LRE_NOTMODIFIED;  /* No mirror has to be contacted */
+
+    lr_handle_probe_internal_mirrorlist(handle, "repodata/repomd.xml");
+
     repo   = result->yum_repo;
     repomd = result->yum_repomd;
 
     path_to_repodata = lr_pathconcat(handle->destdir, "repodata", NULL);
 
-    if (handle->update) {  /* Check if should create repodata/ subdir */
+    if (handle->update || handle->ifmodified) {
+        /* Check if should create repodata/ subdir */
         struct stat buf;
         if (stat(path_to_repodata, &buf) != -1)
             if (S_ISDIR(buf.st_mode))
@@ -448,23 +1121,74 @@ lr_yum_download_remote(lr_Handle handle, lr_Result result)
     if (!handle->update) {
         /* Prepare repomd.xml file */
         char *path;
+        char *tmp_path = NULL;
         path = lr_pathconcat(handle->destdir, "/repodata/repomd.xml", NULL);
-        fd = open(path, O_CREAT|O_TRUNC|O_RDWR, 0660);
+        if (handle->ifmodified) {
+            /* Local repomd.xml is kept until the new one is downloaded.
+             * With a metalink, the local repomd.xml was already compared
+             * with it and it doesn't match (or the local repository is
+             * broken) - a mirror must not answer 304 Not Modified. */
+            char *ml_checksum;
+            if (handle->metalink
+                && lr_yum_metalink_checksum(handle->metalink, &ml_checksum)
+                   != LR_CHECKSUM_UNKNOWN)
+                validators = lr_curlvalidators_new();
+            else
+                validators = lr_yum_validators_load(handle->destdir);
+            tmp_path = lr_strconcat(path, ".tmp", NULL);
+        }
+        fd = open((tmp_path) ? tmp_path : path, O_CREAT|O_TRUNC|O_RDWR, 0660);
         if (fd == -1) {
             lr_free(path);
+            lr_free(tmp_path);
+            lr_curlvalidators_free(validators);
             return LRE_IO;
         }
 
-        /* Download repomd.xml */
-        rc = lr_yum_download_repomd(handle, handle->metalink, fd);
+        /* Download and parse repomd.xml */
+        rc = lr_yum_download_repomd(handle, handle->metalink, fd, repomd,
+                                    validators);
+        if (rc == LRE_NOTMODIFIED
+            && lr_yum_use_unmodified(handle, result) != LRE_NOTMODIFIED) {
+            /* Local repository is broken - download it unconditionally */
+            lr_free(validators->etag);
+            lr_free(validators->last_modified);
+            validators->etag = NULL;
+            validators->last_modified = NULL;
+            rc = lr_yum_download_repomd(handle, handle->metalink, fd, repomd,
+                                        validators);
+        }
+        close(fd);
+
+        if (tmp_path) {
+            if (rc != LRE_OK) {
+                unlink(tmp_path);
+            } else {
+                /* Validators of the replaced repomd.xml are not valid
+                 * anymore, the new ones are stored at the end */
+                char *vpath = lr_pathconcat(handle->destdir,
+                                            LR_YUM_VALIDATORS, NULL);
+                unlink(vpath);
+                lr_free(vpath);
+                if (rename(tmp_path, path) == -1) {
+                    DPRINTF("%s: Cannot rename %s: %s\n",
+                            __func__, tmp_path, strerror(errno));
+                    rc = LRE_IO;
+                }
+            }
+            lr_free(tmp_path);
+        }
+
         if (rc != LRE_OK) {
-            close(fd);
             lr_free(path);
+            lr_curlvalidators_free(validators);
             return rc;
         }
 
         /* Check repomd.xml.asc if available.
-         * Try to download and verify GPG signature (repomd.xml.asc).
+         * The signature is downloaded together with the rest of metadata
+         * files and it is verified after the downloading. Metadata files
+         * are removed if the verification fails.
          * Try to download only from the mirror where repomd.xml iself was
          * downloaded. It is because most of yum repositories are not signed
          * and try every mirror for signature is non effective.
@@ -472,55 +1196,9 @@ lr_yum_download_remote(lr_Handle handle, lr_Result result)
          * no clue if 404 for repomd.xml.asc means that no signature exists or
          * it is just error on the mirror and should try the next one.
          **/
-        if (handle->checks & LR_CHECK_GPG) {
-            int fd_sig;
-            char *url, *signature;
-
-            signature = lr_pathconcat(handle->destdir, "repodata/repomd.xml.asc", NULL);
-            fd_sig = open(signature, O_CREAT|O_TRUNC|O_RDWR, 0660);
-            if (fd_sig == -1) {
-                DPRINTF("%s: Cannot open: %s\n", __func__, signature);
-                close(fd);
-                lr_free(path);
-                lr_free(signature);
-                return LRE_IO;
-            }
-
-            url = lr_pathconcat(handle->used_mirror, "repodata/repomd.xml.asc", NULL);
-            rc = lr_curl_single_download(handle, url, fd_sig);
-            lr_free(url);
-            close(fd_sig);
-            if (rc != LRE_OK) {
-                // Signature doesn't exist
-                DPRINTF("%s: GPG signature doesn't exists\n", __func__);
-                unlink(signature);
-                lr_free(signature);
-            } else {
-                // Signature downloaded
-                repo->signature = lr_strdup(signature);
-                rc = lr_gpg_check_signature(signature, path, NULL);
-                if (rc != LRE_OK) {
-                    DPRINTF("%s: GPG signature verification failed\n", __func__);
-                    close(fd);
-                    lr_free(path);
-                    lr_free(signature);
-                    return rc;
-                }
-                DPRINTF("%s: GPG signature successfully verified\n", __func__);
-            }
-        }
-
-        lseek(fd, 0, SEEK_SET);
-
-        /* Parse repomd */
-        DPRINTF("%s: Parsing repomd.xml\n", __func__);
-        rc = lr_yum_repomd_parse_file(repomd, fd);
-        close(fd);
-        if (rc != LRE_OK) {
-            DPRINTF("%s: Parsing unsuccessful (%d)\n", __func__, rc);
-            lr_free(path);
-            return rc;
-        }
+        if (handle->checks & LR_CHECK_GPG && handle->used_mirror)
+            signature = lr_pathconcat(handle->destdir,
+                                      "repodata/repomd.xml.asc", NULL);
 
         /* Fill result object */
         result->destdir = lr_strdup(handle->destdir);
@@ -531,11 +1209,36 @@ lr_yum_download_remote(lr_Handle handle, lr_Result result)
         else
             repo->url = lr_strdup(handle->baseurl);
 
-        DPRINTF("%s: Repomd revision: %s\n", repomd->revision, __func__);
+        DPRINTF("%s: Repomd revision: %s\n", __func__, repomd->revision);
+    }
+
+    /* Download rest of metadata files (and the signature) */
+    rc = lr_yum_download_repo(handle, repo, repomd, signature, &sig_rc);
+
+    if (signature && sig_rc != LRE_OK) {
+        // Signature doesn't exist
+        DPRINTF("%s: GPG signature doesn't exists\n", __func__);
+        unlink(signature);
+    } else if (signature) {
+        // Signature downloaded
+        int gpg_rc;
+
+        repo->signature = lr_strdup(signature);
+        gpg_rc = lr_gpg_check_signature(signature, repo->repomd, NULL);
+        if (gpg_rc != LRE_OK) {
+            DPRINTF("%s: GPG signature verification failed\n", __func__);
+            lr_yum_remove_downloaded(handle, repo, repomd);
+            rc = gpg_rc;
+        } else {
+            DPRINTF("%s: GPG signature successfully verified\n", __func__);
+        }
     }
 
-    /* Download rest of metadata files */
-    if ((rc = lr_yum_download_repo(handle, repo, repomd)) != LRE_OK)
+    lr_free(signature);
+    if (rc == LRE_OK && validators)
+        lr_yum_validators_save(handle->destdir, validators);
+    lr_curlvalidators_free(validators);
+    if (rc != LRE_OK)
         return rc;
 
     DPRINTF("%s: Repository was successfully downloaded\n", __func__);
@@ -580,8 +1283,16 @@ lr_yum_perform(lr_Handle handle, lr_Result result)
         rc = lr_yum_use_local(handle, result);
         if (rc != LRE_OK)
             return rc;
-        if (handle->checks & LR_CHECK_CHECKSUM)
-            rc = lr_yum_check_repo_checksums(repo, repomd);
+        if (handle->checks & LR_CHECK_CHECKSUM) {
+            /* Result of each record is kept in the result */
+            lr_free(result->yum_checksums);
+            result->yum_checksums = lr_malloc0(sizeof(int) * (repomd->nor + 1));
+            rc = lr_yum_check_repo_checksums(repo,
+                                             repomd,
+                                             handle->checksumthreads,
+                                             handle->checksumcache,
+                                             result->yum_checksums);
+        }
     } else {
         /* Download remote/Duplicate local repository */
         rc = lr_yum_download_remote(handle, result);
@@ -25,6 +25,7 @@ extern "C" {
 #endif
 
 #include "rcodes.h"
+#include "repomd.h"
 
 /** \defgroup yum       Yum repo manipulation
  *  \addtogroup yum
@@ -85,6 +86,24 @@ char *lr_yum_repo_path(lr_YumRepo repo, const char *type);
  */
 void lr_yum_repo_append(lr_YumRepo repo, const char *type, const char *path);
 
+/** Check checksums of all files of the repository.
+ * @param repo          Yum repo object.
+ * @param repomd        Repomd of the repository.
+ * @param threads       Number of threads which check the files in
+ *                      parallel. 0 means number of online CPUs.
+ * @param caching       Use checksum cache (see ::lr_checksum_fd_compare).
+ * @param rcs           If not NULL, array of repomd->nor items where
+ *                      the return code (::lr_Rc) of each record check
+ *                      is stored (in order of records in the repomd).
+ * @return              LRE_OK if all checksums match, otherwise return
+ *                      code of the first (in repomd order) failed record.
+ */
+int lr_yum_check_repo_checksums(lr_YumRepo repo,
+                                lr_YumRepoMd repomd,
+                                int threads,
+                                int caching,
+                                int *rcs);
+
 /** @} */
 
 #ifdef __cplusplus
@@ -27,9 +27,21 @@ extern "C" {
 #include "rcodes.h"
 #include "result.h"
 #include "handle.h"
+#include "repomd.h"
 
 int lr_yum_perform(lr_Handle handle, lr_Result result);
 
+/** Check checksum of the file against the repomd record. The decompressed
+ * file (LR_DECOMPRESS_ONLY) is checked against the open-checksum.
+ * @param rec           Repomd record of the file.
+ * @param path          Path to the file.
+ * @param caching       Use the checksum cache (LRO_CHECKSUMCACHE).
+ * @return              ::lr_Rc value.
+ */
+int lr_yum_check_checksum_of_md_record(lr_YumRepoMdRecord rec,
+                                       char *path,
+                                       int caching);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,153 @@
+/* Simple benchmark of checksum calculation speed.
+ *
+ * Usage: checksum_benchmark [size_in_MiB] [file]
+ *
+ * Creates (or uses the given) file and for every supported checksum
+ * type prints the throughput of lr_checksum_fd() and the throughput
+ * of a plain read() loop with a small buffer for comparison.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "librepo/util.h"
+#include "librepo/checksum.h"
+
+#define DEFAULT_SIZE_MIB    256
+#define SMALL_BUFFER_SIZE   2048
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char *
+small_buffer_checksum(lr_ChecksumType type, int fd)
+{
+    ssize_t readed;
+    char buf[SMALL_BUFFER_SIZE];
+    char *checksum;
+    lr_ChecksumCtx ctx = lr_checksumctx_new(type);
+
+    while ((readed = read(fd, buf, SMALL_BUFFER_SIZE)) > 0)
+        lr_checksumctx_update(ctx, buf, readed);
+
+    checksum = lr_checksumctx_final(ctx);
+    lr_checksumctx_free(ctx);
+    return checksum;
+}
+
+static int
+create_file(const char *path, size_t size)
+{
+    char buf[65536];
+    FILE *f = fopen(path, "w");
+
+    if (!f)
+        return 1;
+
+    for (size_t x = 0; x < sizeof(buf); x++)
+        buf[x] = (char) rand();
+
+    while (size > 0) {
+        size_t len = (size < sizeof(buf)) ? size : sizeof(buf);
+        if (fwrite(buf, 1, len, f) != len) {
+            fclose(f);
+            return 1;
+        }
+        size -= len;
+    }
+
+    fclose(f);
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    size_t size_mib = DEFAULT_SIZE_MIB;
+    char tmp_path[] = "/tmp/librepo_checksum_benchmark_XXXXXX";
+    const char *path = NULL;
+    struct stat st;
+    lr_ChecksumType types[] = { LR_CHECKSUM_MD5, LR_CHECKSUM_SHA1,
+                                LR_CHECKSUM_SHA224, LR_CHECKSUM_SHA256,
+                                LR_CHECKSUM_SHA384, LR_CHECKSUM_SHA512 };
+
+    if (argc > 1)
+        size_mib = atoi(argv[1]);
+
+    if (argc > 2) {
+        path = argv[2];
+    } else {
+        int fd = mkstemp(tmp_path);
+        if (fd < 0) {
+            perror("mkstemp");
+            return 1;
+        }
+        close(fd);
+        path = tmp_path;
+        if (create_file(path, size_mib * 1024 * 1024)) {
+            fprintf(stderr, "Cannot create %s\n", path);
+            unlink(path);
+            return 1;
+        }
+    }
+
+    if (stat(path, &st)) {
+        perror("stat");
+        return 1;
+    }
+
+    printf("File: %s (%lld bytes)\n", path, (long long) st.st_size);
+    printf("%-8s %15s %15s\n", "Type", "lr_checksum_fd", "read() 2KiB");
+
+    for (size_t x = 0; x < sizeof(types) / sizeof(types[0]); x++) {
+        double t, t_lr, t_small;
+        char *c1, *c2;
+        int fd;
+
+        // Warm up the page cache, so the both variants are equal
+        fd = open(path, O_RDONLY);
+        lr_free(small_buffer_checksum(types[x], fd));
+        close(fd);
+
+        fd = open(path, O_RDONLY);
+        t = now();
+        c1 = lr_checksum_fd(types[x], fd);
+        t_lr = now() - t;
+        close(fd);
+
+        fd = open(path, O_RDONLY);
+        t = now();
+        c2 = small_buffer_checksum(types[x], fd);
+        t_small = now() - t;
+        close(fd);
+
+        if (!c1 || !c2 || strcmp(c1, c2))
+            fprintf(stderr, "Checksum mismatch for %s!\n",
+                    lr_checksum_type_to_str(types[x]));
+
+        printf("%-8s %10.1f MB/s %10.1f MB/s\n",
+               lr_checksum_type_to_str(types[x]),
+               st.st_size / t_lr / 1e6,
+               st.st_size / t_small / 1e6);
+
+        lr_free(c1);
+        lr_free(c2);
+    }
+
+    if (path == tmp_path)
+        unlink(path);
+
+    return 0;
+}
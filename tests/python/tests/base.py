@@ -18,7 +18,9 @@ class TestCaseWithFlask(TestCase):
 
     @classmethod
     def setUpClass(cls):
-        cls.server = Process(target=cls.application.run)
+        # Threaded server serves parallel requests (e.g. mirror probes)
+        cls.server = Process(target=cls.application.run,
+                             kwargs={"threaded": True})
         cls.server.start()
         time.sleep(0.5)
 
@@ -1,5 +1,7 @@
 REPOS_YUM = "yum/static/"
 HARMCHECKSUM = "yum/harm_checksum/%s/"
+GROWN = "yum/grown/%s/"
+OVERSIZED = "yum/oversized/%s/"
 MISSINGFILE = "yum/not_found/%s/"
 BADURL = "yum/badurl/"
 BADGPG = "yum/badgpg/"
@@ -30,6 +32,12 @@ MIRRORLIST_GOOD_02 = MIRRORLIST_DIR+"good_02"
 MIRRORLIST_NOURLS = MIRRORLIST_DIR+"nourls"
 MIRRORLIST_BADFIRSTURL = MIRRORLIST_DIR+"badfirsturl"
 MIRRORLIST_FIRSTURLHASCORRUPTEDFILES = MIRRORLIST_DIR+"firsturlhascorruptedfiles"
+MIRRORLIST_FIRSTURLHASMISSINGFILES = MIRRORLIST_DIR+"firsturlhasmissingfiles"
+MIRRORLIST_FIRSTURLHASOVERSIZEDFILES = MIRRORLIST_DIR+"firsturlhasoversizedfiles"
+MIRRORLIST_BADFIRSTURL_NORANGE = MIRRORLIST_DIR+"badfirsturl_norange"
+MIRRORLIST_SECONDURLHASGROWNFILES = MIRRORLIST_DIR+"secondurlhasgrownfiles"
+MIRRORLIST_SLOWFIRSTURL = MIRRORLIST_DIR+"slowfirsturl"
+MIRRORLIST_SLOWURLS = MIRRORLIST_DIR+"slowurls"
 
 # PACKAGE_<repo_id>_<package_id>
 REPO_YUM_01_PACKAGES = REPO_YUM_01_PATH
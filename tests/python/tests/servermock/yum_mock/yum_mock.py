@@ -1,6 +1,7 @@
 from flask import Blueprint, render_template, abort, send_file, request, Response
 from functools import wraps
 import os
+import time
 import config
 import StringIO
 
@@ -29,6 +30,61 @@ def harm_checksum(keyword, path):
         # File probably doesn't exist or we can't read it
         abort(404)
 
+@yum_mock.route('/oversized/<keyword>/<path:path>')
+def oversized(keyword, path):
+    """Same as harm_checksum, but the content is sent without
+    Content-Length. The bigger file could be recognized only by
+    the amount of received data."""
+
+    if "static/" not in path:
+        abort(400)
+    path = path[path.find("static/"):]
+
+    try:
+        with yum_mock.open_resource(path) as f:
+            data = f.read()
+    except IOError:
+        # File probably doesn't exist or we can't read it
+        abort(404)
+
+    if keyword in os.path.basename(path):
+        data = "%s\n\n" % data
+
+    def generate():
+        yield data
+
+    return Response(generate())
+
+@yum_mock.route('/grown/<keyword>/<path:path>')
+def grown(keyword, path):
+    """Same as harm_checksum, but range requests are supported. Such
+    mirror looks like a mirror with other version of the file."""
+
+    if "static/" not in path:
+        abort(400)
+    path = path[path.find("static/"):]
+
+    try:
+        with yum_mock.open_resource(path) as f:
+            data = f.read()
+    except IOError:
+        # File probably doesn't exist or we can't read it
+        abort(404)
+
+    if keyword in os.path.basename(path):
+        data = "%s\n\n" % data
+
+    ranges = request.headers.get("Range", "")
+    if not ranges.startswith("bytes="):
+        return data
+    start, end = ranges[len("bytes="):].split("-")
+    start = int(start)
+    end = min(int(end), len(data) - 1) if end else len(data) - 1
+    if start >= len(data):
+        abort(416)
+    return Response(data[start:end+1], 206,
+                    {"Content-Range": "bytes %d-%d/%d" % (start, end, len(data))})
+
 @yum_mock.route("/not_found/<keyword>/<path:path>")
 def not_found(keyword, path):
     """For each file containing keyword in the filename, http status
@@ -53,6 +109,22 @@ def badurl(path):
     """Just return 404 for each url with this prefix"""
     abort(404)
 
+@yum_mock.route("/slow/<int:delay>/<path:path>")
+def slow(delay, path):
+    """Wait delay milliseconds before content of a file (from the static
+    dir) is returned"""
+    if "static/" not in path:
+        abort(400)
+    path = path[path.find("static/"):]
+
+    time.sleep(delay / 1000.0)
+    try:
+        with yum_mock.open_resource(path) as f:
+            return f.read()
+    except IOError:
+        # File probably doesn't exist or we can't read it
+        abort(404)
+
 @yum_mock.route("/badgpg/<path:path>")
 def badgpg(path):
     """Instead of <path>/repomd.xml.asc returns
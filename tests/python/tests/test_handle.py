@@ -182,10 +182,38 @@ class TestCaseHandle(unittest.TestCase):
         h.maxspeed = None
         h.setopt(librepo.LRO_CONNECTTIMEOUT, None)  # None sets default value
         h.connecttimeout = None
+        h.setopt(librepo.LRO_MAXPARALLELDOWNLOADS, None)  # None sets default value
+        h.maxparalleldownloads = None
+        h.setopt(librepo.LRO_MAXDOWNLOADSPERMIRROR, None) # None sets default value
+        h.maxdownloadspermirror = None
+        h.setopt(librepo.LRO_WRITEBUFFERSIZE, None)  # None sets default value
+        h.writebuffersize = None
+        h.setopt(librepo.LRO_MIRRORPROBE, None)  # None sets default value
+        h.mirrorprobe = None
+        h.setopt(librepo.LRO_MIRRORPROBETIMEOUT, None)  # None sets default value
+        h.mirrorprobetimeout = None
+        h.setopt(librepo.LRO_MIRRORSTATS, None)
+        h.mirrorstats = None
+        h.setopt(librepo.LRO_SEGMENTS, None)  # None sets default value
+        h.segments = None
+        h.setopt(librepo.LRO_SEGMENTSIZE, None)  # None sets default value
+        h.segmentsize = None
+        h.setopt(librepo.LRO_IFMODIFIED, None)
+        h.ifmodified = None
+        h.setopt(librepo.LRO_OLDDESTDIR, None)
+        h.olddestdir = None
+        h.setopt(librepo.LRO_CACHEDIR, None)
+        h.cachedir = None
+        h.setopt(librepo.LRO_DECOMPRESS, None)
+        h.decompress = None
         h.setopt(librepo.LRO_GPGCHECK, None)
         h.gpgcheck = None
         h.setopt(librepo.LRO_CHECKSUM, None)
         h.checksum = None
+        h.setopt(librepo.LRO_CHECKSUMTHREADS, None)  # None sets default value
+        h.checksumthreads = None
+        h.setopt(librepo.LRO_CHECKSUMCACHE, None)
+        h.checksumcache = None
 
         def callback(data, total_to_download, downloaded):
             pass
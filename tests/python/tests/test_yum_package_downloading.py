@@ -142,3 +142,188 @@ class TestCaseYumPackageDownloading(TestCaseWithFlask):
         pkg = os.path.join(self.tmpdir, config.PACKAGE_01_01)
         self.assertTrue(os.path.isfile(pkg))
 
+
+    def test_download_packages(self):
+        h = librepo.Handle()
+
+        url = "%s%s" % (MOCKURL, config.REPO_YUM_01_PATH)
+        h.setopt(librepo.LRO_URL, url)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_DESTDIR, self.tmpdir)
+        h.setopt(librepo.LRO_CHECKSUM, True)
+
+        targets = [
+            librepo.PackageTarget(config.PACKAGE_01_01,
+                                  checksum=config.PACKAGE_01_01_SHA256,
+                                  checksum_type=librepo.CHECKSUM_SHA256),
+            librepo.PackageTarget(config.PACKAGE_01_01,
+                                  dest=os.path.join(self.tmpdir, "pkg.rpm"),
+                                  checksum=config.PACKAGE_01_01_SHA256,
+                                  checksum_type="sha256"),
+            librepo.PackageTarget(config.PACKAGE_01_01,
+                                  dest=os.path.join(self.tmpdir, "bad.rpm"),
+                                  checksum="badchecksum",
+                                  checksum_type=librepo.CHECKSUM_SHA256),
+        ]
+        self.assertFalse(h.download_packages(targets))
+
+        self.assertEqual(targets[0].rc, librepo.LRE_OK)
+        self.assertEqual(targets[0].err, None)
+        self.assertEqual(targets[0].local_path,
+                         os.path.join(self.tmpdir, config.PACKAGE_01_01))
+        self.assertTrue(os.path.isfile(targets[0].local_path))
+
+        self.assertEqual(targets[1].rc, librepo.LRE_OK)
+        self.assertTrue(os.path.isfile(os.path.join(self.tmpdir, "pkg.rpm")))
+
+        self.assertEqual(targets[2].rc, librepo.LRE_BADCHECKSUM)
+        self.assertTrue(targets[2].err)
+
+    def test_download_packages_with_baseurl(self):
+        h = librepo.Handle()
+
+        url = "%s%s" % (MOCKURL, config.BADURL)
+        baseurl = "%s%s" % (MOCKURL, config.REPO_YUM_01_PATH)
+        h.setopt(librepo.LRO_URL, url)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_DESTDIR, self.tmpdir)
+        h.setopt(librepo.LRO_CHECKSUM, True)
+
+        targets = [librepo.PackageTarget(config.PACKAGE_01_01,
+                                         checksum=config.PACKAGE_01_01_SHA256,
+                                         checksum_type=librepo.CHECKSUM_SHA256,
+                                         base_url=baseurl)]
+        self.assertTrue(h.download_packages(targets))
+
+        pkg = os.path.join(self.tmpdir, config.PACKAGE_01_01)
+        self.assertTrue(os.path.isfile(pkg))
+
+    def test_download_package_with_writebuffer(self):
+        h = librepo.Handle()
+
+        url = "%s%s" % (MOCKURL, config.REPO_YUM_01_PATH)
+        h.setopt(librepo.LRO_URL, url)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_DESTDIR, self.tmpdir)
+        h.setopt(librepo.LRO_CHECKSUM, True)
+        h.setopt(librepo.LRO_WRITEBUFFERSIZE, 1024*1024)
+        h.download(config.PACKAGE_01_01,
+                   checksum=config.PACKAGE_01_01_SHA256,
+                   checksum_type=librepo.CHECKSUM_SHA256)
+
+        pkg = os.path.join(self.tmpdir, config.PACKAGE_01_01)
+        self.assertTrue(os.path.isfile(pkg))
+
+    def test_download_package_reuse_handle(self):
+        # Connections of the handle are reused by all its downloads
+        h = librepo.Handle()
+
+        url = "%s%s" % (MOCKURL, config.REPO_YUM_01_PATH)
+        h.setopt(librepo.LRO_URL, url)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_CHECKSUM, True)
+
+        for x in range(3):
+            destdir = os.path.join(self.tmpdir, str(x))
+            os.mkdir(destdir)
+            h.setopt(librepo.LRO_DESTDIR, destdir)
+            h.perform(librepo.Result())
+            h.download(config.PACKAGE_01_01,
+                       checksum=config.PACKAGE_01_01_SHA256,
+                       checksum_type=librepo.CHECKSUM_SHA256)
+
+            pkg = os.path.join(destdir, config.PACKAGE_01_01)
+            self.assertTrue(os.path.isfile(pkg))
+
+    def test_download_package_segmented(self):
+        h = librepo.Handle()
+
+        url = "%s%s" % (MOCKURL, config.REPO_YUM_01_PATH)
+        h.setopt(librepo.LRO_URL, url)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_DESTDIR, self.tmpdir)
+        h.setopt(librepo.LRO_CHECKSUM, True)
+        h.setopt(librepo.LRO_SEGMENTS, 4)
+        h.setopt(librepo.LRO_SEGMENTSIZE, 1024)
+        h.download(config.PACKAGE_01_01,
+                   checksum=config.PACKAGE_01_01_SHA256,
+                   checksum_type=librepo.CHECKSUM_SHA256)
+
+        pkg = os.path.join(self.tmpdir, config.PACKAGE_01_01)
+        self.assertTrue(os.path.isfile(pkg))
+
+    def test_download_package_segmented_no_range_support(self):
+        # Server ignores range requests - package is downloaded as a whole
+        h = librepo.Handle()
+
+        url = "%s%s%s" % (MOCKURL, config.HARMCHECKSUM % "foo",
+                          config.REPO_YUM_01_PATH)
+        h.setopt(librepo.LRO_URL, url)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_DESTDIR, self.tmpdir)
+        h.setopt(librepo.LRO_CHECKSUM, True)
+        h.setopt(librepo.LRO_SEGMENTS, 4)
+        h.setopt(librepo.LRO_SEGMENTSIZE, 1024)
+        h.download(config.PACKAGE_01_01,
+                   checksum=config.PACKAGE_01_01_SHA256,
+                   checksum_type=librepo.CHECKSUM_SHA256)
+
+        pkg = os.path.join(self.tmpdir, config.PACKAGE_01_01)
+        self.assertTrue(os.path.isfile(pkg))
+
+    def test_download_package_segmented_failed(self):
+        # No segment could be downloaded (the first mirror is bad,
+        # the second one ignores range requests) - the whole package
+        # is downloaded by the usual way
+        h = librepo.Handle()
+
+        url = "%s%s" % (MOCKURL, config.MIRRORLIST_BADFIRSTURL_NORANGE)
+        h.setopt(librepo.LRO_MIRRORLIST, url)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_DESTDIR, self.tmpdir)
+        h.setopt(librepo.LRO_CHECKSUM, True)
+        h.setopt(librepo.LRO_SEGMENTS, 4)
+        h.setopt(librepo.LRO_SEGMENTSIZE, 1024)
+        h.download(config.PACKAGE_01_01,
+                   checksum=config.PACKAGE_01_01_SHA256,
+                   checksum_type=librepo.CHECKSUM_SHA256)
+
+        pkg = os.path.join(self.tmpdir, config.PACKAGE_01_01)
+        self.assertTrue(os.path.isfile(pkg))
+
+    def test_download_package_segmented_other_version(self):
+        # The second mirror has a bigger file - its ranges are rejected
+        # and the segments are downloaded from the first mirror
+        h = librepo.Handle()
+
+        url = "%s%s" % (MOCKURL, config.MIRRORLIST_SECONDURLHASGROWNFILES)
+        h.setopt(librepo.LRO_MIRRORLIST, url)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_DESTDIR, self.tmpdir)
+        h.setopt(librepo.LRO_CHECKSUM, True)
+        h.setopt(librepo.LRO_SEGMENTS, 4)
+        h.setopt(librepo.LRO_SEGMENTSIZE, 1024)
+        h.download(config.PACKAGE_01_01,
+                   checksum=config.PACKAGE_01_01_SHA256,
+                   checksum_type=librepo.CHECKSUM_SHA256)
+
+        pkg = os.path.join(self.tmpdir, config.PACKAGE_01_01)
+        self.assertTrue(os.path.isfile(pkg))
+
+    @unittest.skipUnless(os.path.exists("/dev/full"), "requires /dev/full")
+    def test_download_package_no_space_left(self):
+        h = librepo.Handle()
+
+        url = "%s%s" % (MOCKURL, config.REPO_YUM_01_PATH)
+        h.setopt(librepo.LRO_URL, url)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        try:
+            h.download(config.PACKAGE_01_01, dest="/dev/full")
+        except librepo.LibrepoException as err:
+            self.assertEqual(err.args[0], librepo.LRE_IO)
+        else:
+            self.fail("LibrepoException not raised")
+
+        target = librepo.PackageTarget(config.PACKAGE_01_01, dest="/dev/full")
+        self.assertFalse(h.download_packages([target]))
+        self.assertEqual(target.rc, librepo.LRE_IO)
@@ -6,6 +6,7 @@ import unittest
 import tempfile
 import shutil
 import gpgme
+import gzip
 import librepo
 
 PUB_KEY = TEST_DATA+"/key.pub"
@@ -442,6 +443,266 @@ class TestCaseYumRepoDownloading(TestCaseWithFlask):
         self.assertTrue(yum_repo)
         self.assertTrue(yum_repomd)
 
+    def test_download_repo_01_if_modified(self):
+        url = "%s%s" % (MOCKURL, config.REPO_YUM_01_PATH)
+
+        h = librepo.Handle()
+        h.setopt(librepo.LRO_URL, url)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_DESTDIR, self.tmpdir)
+        h.setopt(librepo.LRO_IFMODIFIED, True)
+        h.perform(librepo.Result())
+
+        validators = os.path.join(self.tmpdir, "repodata/repomd.xml.validators")
+        self.assertTrue(os.path.isfile(validators))
+
+        # Repository didn't change since the first download
+        h = librepo.Handle()
+        h.setopt(librepo.LRO_URL, url)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_DESTDIR, self.tmpdir)
+        h.setopt(librepo.LRO_IFMODIFIED, True)
+        try:
+            h.perform(librepo.Result())
+        except librepo.LibrepoException as err:
+            self.assertEqual(err.args[0], librepo.LRE_NOTMODIFIED)
+        else:
+            self.fail("LibrepoException not raised")
+
+        self.assertTrue(os.path.getsize(
+            os.path.join(self.tmpdir, "repodata/repomd.xml")))
+
+    def test_download_repo_01_if_modified_damaged(self):
+        url = "%s%s" % (MOCKURL, config.REPO_YUM_01_PATH)
+
+        h = librepo.Handle()
+        r = librepo.Result()
+        h.setopt(librepo.LRO_URL, url)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_DESTDIR, self.tmpdir)
+        h.setopt(librepo.LRO_IFMODIFIED, True)
+        h.setopt(librepo.LRO_CHECKSUM, True)
+        h.perform(r)
+
+        # Truncate the primary
+        primary = r.getinfo(librepo.LRR_YUM_REPO)["primary"]
+        content = open(primary).read()
+        open(primary, "w").write(content[:len(content)/2])
+
+        # Repository didn't change, but the local copy is damaged
+        h = librepo.Handle()
+        r = librepo.Result()
+        h.setopt(librepo.LRO_URL, url)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_DESTDIR, self.tmpdir)
+        h.setopt(librepo.LRO_IFMODIFIED, True)
+        h.setopt(librepo.LRO_CHECKSUM, True)
+        h.perform(r)
+
+        self.assertEqual(open(primary).read(), content)
+
+    def test_download_repo_01_with_old_destdir(self):
+        url = "%s%s" % (MOCKURL, config.REPO_YUM_01_PATH)
+        olddir = os.path.join(self.tmpdir, "old")
+        newdir = os.path.join(self.tmpdir, "new")
+        os.mkdir(olddir)
+        os.mkdir(newdir)
+
+        h = librepo.Handle()
+        h.setopt(librepo.LRO_URL, url)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_DESTDIR, olddir)
+        h.perform(librepo.Result())
+
+        h = librepo.Handle()
+        r = librepo.Result()
+        h.setopt(librepo.LRO_URL, url)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_DESTDIR, newdir)
+        h.setopt(librepo.LRO_OLDDESTDIR, olddir)
+        h.setopt(librepo.LRO_CHECKSUM, True)
+        h.perform(r)
+
+        yum_repo = r.getinfo(librepo.LRR_YUM_REPO)
+        primary = yum_repo["primary"]
+        old_primary = primary.replace(newdir, olddir)
+        self.assertTrue(primary.startswith(newdir))
+        self.assertEqual(open(primary).read(), open(old_primary).read())
+        # The file was reused (hardlinked), not downloaded again
+        self.assertEqual(os.stat(primary).st_ino, os.stat(old_primary).st_ino)
+
+    def test_download_repo_01_with_cachedir(self):
+        url = "%s%s" % (MOCKURL, config.REPO_YUM_01_PATH)
+        cachedir = os.path.join(self.tmpdir, "cache")
+        dirs = [os.path.join(self.tmpdir, "a"), os.path.join(self.tmpdir, "b")]
+        primaries = []
+
+        for destdir in dirs:
+            os.mkdir(destdir)
+            h = librepo.Handle()
+            r = librepo.Result()
+            h.setopt(librepo.LRO_URL, url)
+            h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+            h.setopt(librepo.LRO_DESTDIR, destdir)
+            h.setopt(librepo.LRO_CACHEDIR, cachedir)
+            h.setopt(librepo.LRO_CHECKSUM, True)
+            h.perform(r)
+            primaries.append(r.getinfo(librepo.LRR_YUM_REPO)["primary"])
+
+        entrydir = os.path.join(cachedir, "sha1")
+        entries = [os.stat(os.path.join(entrydir, x)).st_ino
+                   for x in os.listdir(entrydir)]
+        self.assertEqual(open(primaries[0]).read(), open(primaries[1]).read())
+        # Downloaded file was copied to the cache, it is left untouched
+        self.assertEqual(os.stat(primaries[0]).st_nlink, 1)
+        self.assertTrue(os.stat(primaries[0]).st_mode & 0200)
+        # The second repo was taken from the cache, not downloaded again
+        self.assertTrue(os.stat(primaries[1]).st_ino in entries)
+        # Cache entries are read-only
+        self.assertFalse(os.stat(primaries[1]).st_mode & 0222)
+
+        # Broken entry is never used, even without LRO_CHECKSUM
+        content = open(primaries[1]).read()
+        os.chmod(primaries[1], 0644)
+        open(primaries[1], "a").write("foobar")
+        destdir = os.path.join(self.tmpdir, "c")
+        os.mkdir(destdir)
+        h = librepo.Handle()
+        r = librepo.Result()
+        h.setopt(librepo.LRO_URL, url)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_DESTDIR, destdir)
+        h.setopt(librepo.LRO_CACHEDIR, cachedir)
+        h.setopt(librepo.LRO_CHECKSUM, False)
+        h.perform(r)
+        primary = r.getinfo(librepo.LRR_YUM_REPO)["primary"]
+        self.assertNotEqual(os.stat(primary).st_ino,
+                            os.stat(primaries[1]).st_ino)
+        self.assertEqual(open(primary).read(), content)
+
+    def test_download_repo_01_decompressed(self):
+        url = "%s%s" % (MOCKURL, config.REPO_YUM_01_PATH)
+
+        for mode in (librepo.LR_DECOMPRESS_KEEP, librepo.LR_DECOMPRESS_ONLY):
+            destdir = os.path.join(self.tmpdir, str(mode))
+            os.mkdir(destdir)
+            h = librepo.Handle()
+            r = librepo.Result()
+            h.setopt(librepo.LRO_URL, url)
+            h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+            h.setopt(librepo.LRO_DESTDIR, destdir)
+            h.setopt(librepo.LRO_CHECKSUM, True)
+            h.setopt(librepo.LRO_DECOMPRESS, mode)
+            h.perform(r)
+
+            yum_repo = r.getinfo(librepo.LRR_YUM_REPO)
+            compressed = yum_repo["primary"]
+            if mode == librepo.LR_DECOMPRESS_ONLY:
+                self.assertTrue(compressed.endswith("primary.xml"))
+                self.assertFalse(os.path.exists(compressed + ".gz"))
+                decompressed = compressed
+            else:
+                self.assertTrue(compressed.endswith("primary.xml.gz"))
+                decompressed = compressed[:-3]
+                self.assertEqual(gzip.open(compressed).read(),
+                                 open(decompressed).read())
+            self.assertTrue(open(decompressed).read().startswith("<?xml"))
+
+    def test_download_repo_01_decompressed_if_modified(self):
+        url = "%s%s" % (MOCKURL, config.REPO_YUM_01_PATH)
+
+        h = librepo.Handle()
+        h.setopt(librepo.LRO_URL, url)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_DESTDIR, self.tmpdir)
+        h.setopt(librepo.LRO_IFMODIFIED, True)
+        h.setopt(librepo.LRO_DECOMPRESS, librepo.LR_DECOMPRESS_ONLY)
+        h.perform(librepo.Result())
+
+        # Only decompressed files are in the local repository
+        h = librepo.Handle()
+        r = librepo.Result()
+        h.setopt(librepo.LRO_URL, url)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_DESTDIR, self.tmpdir)
+        h.setopt(librepo.LRO_IFMODIFIED, True)
+        h.setopt(librepo.LRO_DECOMPRESS, librepo.LR_DECOMPRESS_ONLY)
+        try:
+            h.perform(r)
+        except librepo.LibrepoException as err:
+            self.assertEqual(err.args[0], librepo.LRE_NOTMODIFIED)
+        else:
+            self.fail("LibrepoException not raised")
+
+        yum_repo = r.getinfo(librepo.LRR_YUM_REPO)
+        self.assertTrue(yum_repo["primary"].endswith("primary.xml"))
+        self.assertTrue(os.path.isfile(yum_repo["primary"]))
+
+    def test_download_repo_01_decompressed_with_old_destdir_and_cachedir(self):
+        url = "%s%s" % (MOCKURL, config.REPO_YUM_01_PATH)
+        cachedir = os.path.join(self.tmpdir, "cache")
+        dirs = [os.path.join(self.tmpdir, x) for x in ("a", "b", "c")]
+        primaries = []
+
+        for x, destdir in enumerate(dirs):
+            os.mkdir(destdir)
+            h = librepo.Handle()
+            r = librepo.Result()
+            h.setopt(librepo.LRO_URL, url)
+            h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+            h.setopt(librepo.LRO_DESTDIR, destdir)
+            h.setopt(librepo.LRO_CHECKSUM, True)
+            h.setopt(librepo.LRO_DECOMPRESS, librepo.LR_DECOMPRESS_ONLY)
+            if x == 1:
+                h.setopt(librepo.LRO_CACHEDIR, cachedir)
+            elif x == 2:
+                h.setopt(librepo.LRO_OLDDESTDIR, dirs[1])
+            h.perform(r)
+            primaries.append(r.getinfo(librepo.LRR_YUM_REPO)["primary"])
+
+        # Decompressed file was stored to the cache...
+        self.assertTrue(primaries[1].endswith("primary.xml"))
+        self.assertTrue(os.listdir(os.path.join(cachedir, "sha1")))
+        # ...and reused from the old destdir
+        self.assertEqual(os.stat(primaries[1]).st_ino,
+                         os.stat(primaries[2]).st_ino)
+
+        # Second download with the same cache doesn't download anything
+        destdir = os.path.join(self.tmpdir, "d")
+        os.mkdir(destdir)
+        h = librepo.Handle()
+        r = librepo.Result()
+        h.setopt(librepo.LRO_URL, url)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_DESTDIR, destdir)
+        h.setopt(librepo.LRO_CHECKSUM, True)
+        h.setopt(librepo.LRO_DECOMPRESS, librepo.LR_DECOMPRESS_ONLY)
+        h.setopt(librepo.LRO_CACHEDIR, cachedir)
+        h.perform(r)
+        primary = r.getinfo(librepo.LRR_YUM_REPO)["primary"]
+        entrydir = os.path.join(cachedir, "sha1")
+        entries = [os.stat(os.path.join(entrydir, x)).st_ino
+                   for x in os.listdir(entrydir)]
+        self.assertTrue(os.stat(primary).st_ino in entries)
+        self.assertEqual(open(primary).read(), open(primaries[0]).read())
+
+    def test_download_repo_01_decompressed_via_mirrorlist_firsturlhascorruptedfiles(self):
+        h = librepo.Handle()
+        r = librepo.Result()
+
+        url = "%s%s" % (MOCKURL, config.MIRRORLIST_FIRSTURLHASCORRUPTEDFILES)
+        h.setopt(librepo.LRO_MIRRORLIST, url)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_DESTDIR, self.tmpdir)
+        h.setopt(librepo.LRO_CHECKSUM, False)
+        h.setopt(librepo.LRO_DECOMPRESS, librepo.LR_DECOMPRESS_ONLY)
+        # Broken primary.xml.gz cannot be decompressed,
+        # it is downloaded from the next mirror
+        h.perform(r)
+
+        yum_repo = r.getinfo(librepo.LRR_YUM_REPO)
+        self.assertTrue(open(yum_repo["primary"]).read().startswith("<?xml"))
+
     def test_download_corrupted_repo_01_with_checksum_check(self):
         h = librepo.Handle()
         r = librepo.Result()
@@ -496,6 +757,29 @@ class TestCaseYumRepoDownloading(TestCaseWithFlask):
         self.assertTrue(yum_repo)
         self.assertTrue(yum_repomd)
         self.assertTrue("signature" not in yum_repo or yum_repo["signature"])
+        # Metadata downloaded together with the signature were removed
+        self.assertEqual(sorted(os.listdir(self.tmpdir+"/repodata")),
+                         ["repomd.xml", "repomd.xml.asc"])
+        # and they are not in the result anymore
+        self.assertTrue("primary" not in yum_repo)
+        self.assertTrue("filelists" not in yum_repo)
+
+    def test_download_repo_with_gpg_check_no_signature(self):
+        h = librepo.Handle()
+        r = librepo.Result()
+
+        url = "%s%s" % (MOCKURL, config.REPO_YUM_02_PATH)
+        h.setopt(librepo.LRO_URL, url)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_DESTDIR, self.tmpdir)
+        h.setopt(librepo.LRO_GPGCHECK, True)
+        h.perform(r)
+
+        yum_repo = r.getinfo(librepo.LRR_YUM_REPO)
+        self.assertTrue(os.path.isfile(yum_repo["primary"]))
+        self.assertEqual(yum_repo["signature"], None)
+        # 404 of the missing signature is not an error of the mirror
+        self.assertEqual(h.lastbadstatuscode, 0)
 
     def test_download_repo_01_with_missing_file(self):
         h = librepo.Handle()
@@ -577,6 +861,91 @@ class TestCaseYumRepoDownloading(TestCaseWithFlask):
         self.assertTrue(yum_repo)
         self.assertTrue(yum_repomd)
 
+    def test_download_repo_01_via_metalink_if_modified(self):
+        url = "%s%s" % (MOCKURL, config.METALINK_GOOD_01)
+
+        h = librepo.Handle()
+        h.setopt(librepo.LRO_MIRRORLIST, url)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_DESTDIR, self.tmpdir)
+        h.setopt(librepo.LRO_IFMODIFIED, True)
+        h.perform(librepo.Result())
+
+        # Local repomd.xml matches the metalink
+        h = librepo.Handle()
+        r = librepo.Result()
+        h.setopt(librepo.LRO_MIRRORLIST, url)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_DESTDIR, self.tmpdir)
+        h.setopt(librepo.LRO_IFMODIFIED, True)
+        try:
+            h.perform(r)
+        except librepo.LibrepoException as err:
+            self.assertEqual(err.args[0], librepo.LRE_NOTMODIFIED)
+        else:
+            self.fail("LibrepoException not raised")
+
+        yum_repo = r.getinfo(librepo.LRR_YUM_REPO)
+        self.assertEqual(yum_repo["destdir"], self.tmpdir)
+        self.assertTrue(os.path.isfile(yum_repo["primary"]))
+
+    def test_download_repo_01_via_metalink_if_modified_damaged(self):
+        url = "%s%s" % (MOCKURL, config.METALINK_GOOD_01)
+
+        h = librepo.Handle()
+        r = librepo.Result()
+        h.setopt(librepo.LRO_MIRRORLIST, url)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_DESTDIR, self.tmpdir)
+        h.setopt(librepo.LRO_IFMODIFIED, True)
+        h.setopt(librepo.LRO_CHECKSUM, True)
+        h.perform(r)
+
+        # Truncate the primary
+        primary = r.getinfo(librepo.LRR_YUM_REPO)["primary"]
+        content = open(primary).read()
+        open(primary, "w").write(content[:len(content)/2])
+
+        # Local repomd.xml matches the metalink, but the primary is damaged
+        h = librepo.Handle()
+        r = librepo.Result()
+        h.setopt(librepo.LRO_MIRRORLIST, url)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_DESTDIR, self.tmpdir)
+        h.setopt(librepo.LRO_IFMODIFIED, True)
+        h.setopt(librepo.LRO_CHECKSUM, True)
+        h.perform(r)
+
+        self.assertEqual(open(primary).read(), content)
+
+    def test_download_repo_01_via_metalink_if_modified_mismatch(self):
+        url = "%s%s" % (MOCKURL, config.METALINK_GOOD_01)
+
+        h = librepo.Handle()
+        h.setopt(librepo.LRO_MIRRORLIST, url)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_DESTDIR, self.tmpdir)
+        h.setopt(librepo.LRO_IFMODIFIED, True)
+        h.perform(librepo.Result())
+
+        # Local repomd.xml doesn't match the metalink, the mirror
+        # must not be asked conditionally (it would answer 304)
+        repomd = os.path.join(self.tmpdir, "repodata/repomd.xml")
+        orig = open(repomd).read()
+        open(repomd, "w").write(orig.replace("1347459931", "1347459932"))
+
+        h = librepo.Handle()
+        r = librepo.Result()
+        h.setopt(librepo.LRO_MIRRORLIST, url)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_DESTDIR, self.tmpdir)
+        h.setopt(librepo.LRO_IFMODIFIED, True)
+        h.perform(r)
+
+        self.assertEqual(open(repomd).read(), orig)
+        yum_repomd = r.getinfo(librepo.LRR_YUM_REPOMD)
+        self.assertEqual(yum_repomd["revision"], "1347459931")
+
     def test_download_repo_01_via_metalink_badfilename(self):
         h = librepo.Handle()
         r = librepo.Result()
@@ -788,6 +1157,137 @@ class TestCaseYumRepoDownloading(TestCaseWithFlask):
             if yum_repo[key] and (key not in ("url", "destdir")):
                 self.assertTrue(os.path.isfile(yum_repo[key]))
 
+    def test_download_repo_01_via_mirrorlist_firsturlhasmissingfiles(self):
+        # Only primary.xml is missing on the first mirror - it is
+        # downloaded from the second one, other files from the first one
+        h = librepo.Handle()
+        r = librepo.Result()
+
+        url = "%s%s" % (MOCKURL, config.MIRRORLIST_FIRSTURLHASMISSINGFILES)
+        h.setopt(librepo.LRO_MIRRORLIST, url)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_DESTDIR, self.tmpdir)
+        h.setopt(librepo.LRO_CHECKSUM, True)
+        h.perform(r)
+
+        yum_repo   = r.getinfo(librepo.LRR_YUM_REPO)
+        yum_repomd = r.getinfo(librepo.LRR_YUM_REPOMD)
+
+        self.assertTrue(yum_repo)
+        self.assertTrue(yum_repomd)
+        self.assertEqual(yum_repo["url"],
+            "http://127.0.0.1:5000/yum/not_found/primary.xml/static/01/")
+
+        # Test if all mentioned files really exist
+        self.assertTrue(os.path.isdir(yum_repo["destdir"]))
+        for key in yum_repo.iterkeys():
+            if yum_repo[key] and (key not in ("url", "destdir")):
+                self.assertTrue(os.path.isfile(yum_repo[key]))
+
+    def test_download_repo_01_via_mirrorlist_firsturlhasbadlength(self):
+        # Content-Length of primary.xml on the first mirror doesn't match
+        # the size from repomd.xml - it is downloaded from the second one
+        h = librepo.Handle()
+        r = librepo.Result()
+
+        url = "%s%s" % (MOCKURL, config.MIRRORLIST_FIRSTURLHASCORRUPTEDFILES)
+        h.setopt(librepo.LRO_MIRRORLIST, url)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_DESTDIR, self.tmpdir)
+        h.setopt(librepo.LRO_CHECKSUM, True)
+        h.perform(r)
+
+        yum_repo   = r.getinfo(librepo.LRR_YUM_REPO)
+        yum_repomd = r.getinfo(librepo.LRR_YUM_REPOMD)
+
+        self.assertTrue(yum_repo)
+        self.assertTrue(yum_repomd)
+        self.assertEqual(os.path.getsize(yum_repo["primary"]),
+                         yum_repomd["primary"]["size"])
+
+    def test_download_repo_01_via_mirrorlist_firsturlhasoversizedfiles(self):
+        # The first mirror sends more data of primary.xml than expected
+        # without Content-Length - it is downloaded from the second one
+        h = librepo.Handle()
+        r = librepo.Result()
+
+        url = "%s%s" % (MOCKURL, config.MIRRORLIST_FIRSTURLHASOVERSIZEDFILES)
+        h.setopt(librepo.LRO_MIRRORLIST, url)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_DESTDIR, self.tmpdir)
+        h.setopt(librepo.LRO_CHECKSUM, True)
+        h.perform(r)
+
+        yum_repo   = r.getinfo(librepo.LRR_YUM_REPO)
+        yum_repomd = r.getinfo(librepo.LRR_YUM_REPOMD)
+
+        self.assertTrue(yum_repo)
+        self.assertTrue(yum_repomd)
+        self.assertEqual(yum_repo["url"],
+            "http://127.0.0.1:5000/yum/oversized/primary.xml/static/01/")
+        self.assertEqual(os.path.getsize(yum_repo["primary"]),
+                         yum_repomd["primary"]["size"])
+
+    def test_download_repo_01_via_mirrorlist_firsturlhascorruptedfiles_one_by_one(self):
+        h = librepo.Handle()
+        r = librepo.Result()
+
+        url = "%s%s" % (MOCKURL, config.MIRRORLIST_FIRSTURLHASCORRUPTEDFILES)
+        h.setopt(librepo.LRO_MIRRORLIST, url)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_DESTDIR, self.tmpdir)
+        h.setopt(librepo.LRO_CHECKSUM, True)
+        h.setopt(librepo.LRO_MAXPARALLELDOWNLOADS, 1)
+        h.setopt(librepo.LRO_MAXDOWNLOADSPERMIRROR, 1)
+        h.perform(r)
+
+        yum_repo   = r.getinfo(librepo.LRR_YUM_REPO)
+        yum_repomd = r.getinfo(librepo.LRR_YUM_REPOMD)
+
+        self.assertTrue(yum_repo)
+        self.assertTrue(yum_repomd)
+
+        # Test if all mentioned files really exist
+        self.assertTrue(os.path.isdir(yum_repo["destdir"]))
+        for key in yum_repo.iterkeys():
+            if yum_repo[key] and (key not in ("url", "destdir")):
+                self.assertTrue(os.path.isfile(yum_repo[key]))
+
+    def test_download_repo_01_via_mirrorlist_mirror_probe(self):
+        h = librepo.Handle()
+        r = librepo.Result()
+
+        url = "%s%s" % (MOCKURL, config.MIRRORLIST_SLOWFIRSTURL)
+        h.setopt(librepo.LRO_MIRRORLIST, url)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_DESTDIR, self.tmpdir)
+        h.setopt(librepo.LRO_MIRRORPROBE, 2)
+        h.setopt(librepo.LRO_MIRRORPROBETIMEOUT, 5000)
+        h.perform(r)
+
+        # The faster second mirror is used first
+        yum_repo = r.getinfo(librepo.LRR_YUM_REPO)
+        self.assertEqual(yum_repo["url"], "http://127.0.0.1:5000/yum/static/01/")
+        self.assertTrue(os.path.isfile(yum_repo["primary"]))
+
+    def test_download_repo_01_via_mirrorlist_mirror_probe_timeout(self):
+        h = librepo.Handle()
+        r = librepo.Result()
+
+        url = "%s%s" % (MOCKURL, config.MIRRORLIST_SLOWURLS)
+        h.setopt(librepo.LRO_MIRRORLIST, url)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_DESTDIR, self.tmpdir)
+        h.setopt(librepo.LRO_MIRRORPROBE, 2)
+        h.setopt(librepo.LRO_MIRRORPROBETIMEOUT, 50)
+        h.perform(r)
+
+        # No mirror responded in time - the original order is kept
+        yum_repo = r.getinfo(librepo.LRR_YUM_REPO)
+        self.assertEqual(yum_repo["url"],
+            "http://127.0.0.1:5000/yum/slow/300/static/01/")
+        self.assertTrue(os.path.isfile(yum_repo["primary"]))
+
 # Update test
 
     def test_download_and_update_repo_01(self):
@@ -865,6 +1365,40 @@ class TestCaseYumRepoDownloading(TestCaseWithFlask):
         self.assertTrue(yum_repo)
         self.assertTrue(yum_repomd)
 
+    def test_download_repos_perform_many(self):
+        handles = []
+        results = []
+        paths = (config.REPO_YUM_01_PATH, config.REPO_YUM_02_PATH,
+                 config.BADURL, config.REPO_YUM_01_PATH)
+        for x, path in enumerate(paths):
+            destdir = os.path.join(self.tmpdir, str(x))
+            os.mkdir(destdir)
+            h = librepo.Handle()
+            h.setopt(librepo.LRO_URL, "%s%s" % (MOCKURL, path))
+            h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+            h.setopt(librepo.LRO_DESTDIR, destdir)
+            h.setopt(librepo.LRO_CHECKSUM, True)
+            handles.append(h)
+            results.append(librepo.Result())
+
+        ret = librepo.perform_many(handles, results)
+
+        self.assertEqual(len(ret), 4)
+        self.assertEqual(ret[0], (librepo.LRE_OK, None))
+        self.assertEqual(ret[1], (librepo.LRE_OK, None))
+        self.assertNotEqual(ret[2][0], librepo.LRE_OK)
+        self.assertEqual(ret[3], (librepo.LRE_OK, None))
+        for x in (0, 1, 3):
+            yum_repo = results[x].getinfo(librepo.LRR_YUM_REPO)
+            self.assertEqual(yum_repo["destdir"],
+                             os.path.join(self.tmpdir, str(x)))
+            self.assertTrue(os.path.isfile(yum_repo["primary"]))
+
+        # Every handle could be used only once
+        self.assertRaises(ValueError, librepo.perform_many,
+                          [handles[0], handles[0]],
+                          [librepo.Result(), librepo.Result()])
+
 # Progressbar test
 
     def test_download_repo_01_with_progressbar(self):
@@ -154,3 +154,132 @@ class TestCaseYumRepoLocating(TestCase):
         self.assertEqual(yum_repomd, yum_repomd_downloaded)
 
 
+    def test_locate_repo_01_decompressed(self):
+        # At first, download the repository with decompressed files only
+        h = librepo.Handle()
+        r = librepo.Result()
+
+        h.setopt(librepo.LRO_URL, REPO_YUM_01_PATH)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_DESTDIR, self.tmpdir)
+        h.setopt(librepo.LRO_CHECKSUM, True)
+        h.setopt(librepo.LRO_DECOMPRESS, librepo.LR_DECOMPRESS_ONLY)
+        h.perform(r)
+
+        yum_repo_downloaded = r.getinfo(librepo.LRR_YUM_REPO)
+
+        # Decompressed files are checked against their open-checksum
+        h = librepo.Handle()
+        r = librepo.Result()
+
+        h.setopt(librepo.LRO_URL, self.tmpdir)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_LOCAL, True)
+        h.setopt(librepo.LRO_CHECKSUM, True)
+        h.setopt(librepo.LRO_DECOMPRESS, librepo.LR_DECOMPRESS_ONLY)
+        h.perform(r)
+
+        yum_repo = r.getinfo(librepo.LRR_YUM_REPO)
+        self.assertTrue(yum_repo["primary"].endswith("primary.xml"))
+        yum_repo_downloaded["url"] = None
+        self.assertEqual(yum_repo, yum_repo_downloaded)
+
+        # Corrupted decompressed file is detected
+        open(yum_repo["primary"], "a").write("foobar")
+        h = librepo.Handle()
+        r = librepo.Result()
+
+        h.setopt(librepo.LRO_URL, self.tmpdir)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_LOCAL, True)
+        h.setopt(librepo.LRO_CHECKSUM, True)
+        h.setopt(librepo.LRO_DECOMPRESS, librepo.LR_DECOMPRESS_ONLY)
+        self.assertRaises(librepo.LibrepoException, h.perform, (r))
+
+    def test_locate_repo_02_checksum_threads(self):
+        h = librepo.Handle()
+        r = librepo.Result()
+
+        h.setopt(librepo.LRO_URL, REPO_YUM_02_PATH)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_LOCAL, True)
+        h.setopt(librepo.LRO_CHECKSUM, True)
+        h.setopt(librepo.LRO_CHECKSUMTHREADS, 4)
+        h.perform(r)
+
+        yum_repo   = r.getinfo(librepo.LRR_YUM_REPO)
+        self.assertTrue(yum_repo["primary"])
+        checksums = r.getinfo(librepo.LRR_YUM_CHECKSUMS)
+        self.assertTrue(checksums)
+        self.assertEqual(set(checksums.values()), set([librepo.LRE_OK]))
+
+        # Number of threads by number of CPUs
+        h.setopt(librepo.LRO_CHECKSUMTHREADS, 0)
+        r = librepo.Result()
+        h.perform(r)
+
+    def test_locate_corrupted_repo_02_checksum_threads(self):
+        repo = os.path.join(self.tmpdir, "repo")
+        shutil.copytree(REPO_YUM_02_PATH, repo)
+        primary = os.path.join(repo, "repodata",
+            "5a8e6bbb940b151103b3970a26e32b8965da9e90a798b1b80ee4325308149d8d-primary.xml.gz")
+        open(primary, "a").write("foobar")
+
+        h = librepo.Handle()
+        r = librepo.Result()
+
+        h.setopt(librepo.LRO_URL, repo)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_LOCAL, True)
+        h.setopt(librepo.LRO_CHECKSUM, True)
+        h.setopt(librepo.LRO_CHECKSUMTHREADS, 4)
+        self.assertRaises(librepo.LibrepoException, h.perform, (r))
+
+        # Result of each record is available
+        checksums = r.getinfo(librepo.LRR_YUM_CHECKSUMS)
+        self.assertEqual(checksums["primary"], librepo.LRE_BADCHECKSUM)
+        self.assertEqual(checksums["filelists"], librepo.LRE_OK)
+        self.assertEqual(checksums["other"], librepo.LRE_OK)
+
+    def test_locate_repo_02_checksum_cache(self):
+        repo = os.path.join(self.tmpdir, "repo")
+        shutil.copytree(REPO_YUM_02_PATH, repo)
+
+        h = librepo.Handle()
+        h.setopt(librepo.LRO_URL, repo)
+        h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+        h.setopt(librepo.LRO_LOCAL, True)
+        h.setopt(librepo.LRO_CHECKSUM, True)
+        h.setopt(librepo.LRO_CHECKSUMCACHE, True)
+
+        # The first run calculates and caches checksums, the second uses them
+        h.perform(librepo.Result())
+        h.perform(librepo.Result())
+
+        # Modification of the file invalidates its cached checksum
+        primary = os.path.join(repo, "repodata",
+            "5a8e6bbb940b151103b3970a26e32b8965da9e90a798b1b80ee4325308149d8d-primary.xml.gz")
+        open(primary, "a").write("foobar")
+        self.assertRaises(librepo.LibrepoException, h.perform, (librepo.Result()))
+
+    def test_locate_repos_perform_many(self):
+        handles = []
+        results = []
+        for path in (REPO_YUM_01_PATH, REPO_YUM_02_PATH, "/nonexistent/repo"):
+            h = librepo.Handle()
+            h.setopt(librepo.LRO_URL, path)
+            h.setopt(librepo.LRO_REPOTYPE, librepo.LR_YUMREPO)
+            h.setopt(librepo.LRO_LOCAL, True)
+            h.setopt(librepo.LRO_CHECKSUM, True)
+            handles.append(h)
+            results.append(librepo.Result())
+
+        ret = librepo.perform_many(handles, results)
+
+        self.assertEqual(len(ret), 3)
+        self.assertEqual(ret[0], (librepo.LRE_OK, None))
+        self.assertEqual(ret[1], (librepo.LRE_OK, None))
+        self.assertNotEqual(ret[2][0], librepo.LRE_OK)
+        self.assertTrue(ret[2][1])
+        self.assertTrue(results[0].getinfo(librepo.LRR_YUM_REPO)["primary"])
+        self.assertTrue(results[1].getinfo(librepo.LRR_YUM_REPO)["primary"])
@@ -83,12 +83,177 @@ START_TEST(test_checksum_fd)
 }
 END_TEST
 
+START_TEST(test_checksumctx)
+{
+    lr_ChecksumCtx ctx;
+    char *checksum;
+
+    fail_if(lr_checksumctx_new(LR_CHECKSUM_UNKNOWN) != NULL);
+
+    /* Data passed by parts */
+    ctx = lr_checksumctx_new(LR_CHECKSUM_SHA256);
+    fail_if(ctx == NULL);
+    fail_if(lr_checksumctx_update(ctx, "foo\n", 4));
+    fail_if(lr_checksumctx_update(ctx, "", 0));
+    fail_if(lr_checksumctx_update(ctx, "bar\n\n", 5));
+    checksum = lr_checksumctx_final(ctx);
+    fail_if(checksum == NULL);
+    fail_if(strcmp(checksum, CHKS_VAL_01_SHA256),
+        "Checksum is %s instead of %s", checksum, CHKS_VAL_01_SHA256);
+    lr_free(checksum);
+    lr_checksumctx_free(ctx);
+}
+END_TEST
+
+START_TEST(test_checksum_fd_bigfile)
+{
+    int fd;
+    char *file, *data, *checksum, *expected;
+    size_t len = 6*1024*1024 + 123;  // Bigger than mmap threshold
+    off_t offset = 5000;             // Not page aligned
+    lr_ChecksumCtx ctx;
+    FILE *fp;
+
+    file = lr_pathconcat(test_globals.tmpdir, "/test_checksum_big", NULL);
+    data = lr_malloc(len);
+    for (size_t x = 0; x < len; x++)
+        data[x] = (char) (x * 7 + x / 4096);
+
+    fp = fopen(file, "w");
+    fail_if(fp == NULL);
+    fail_unless(fwrite(data, 1, len, fp) == len);
+    fclose(fp);
+
+    // Whole file
+    ctx = lr_checksumctx_new(LR_CHECKSUM_SHA256);
+    lr_checksumctx_update(ctx, data, len);
+    expected = lr_checksumctx_final(ctx);
+    lr_checksumctx_free(ctx);
+    test_checksum(file, LR_CHECKSUM_SHA256, expected);
+    lr_free(expected);
+
+    // Rest of the file from the current offset
+    ctx = lr_checksumctx_new(LR_CHECKSUM_SHA256);
+    lr_checksumctx_update(ctx, data + offset, len - offset);
+    expected = lr_checksumctx_final(ctx);
+    lr_checksumctx_free(ctx);
+
+    fail_if((fd = open(file, O_RDONLY)) < 0);
+    fail_if(lseek(fd, offset, SEEK_SET) != offset);
+    ctx = lr_checksumctx_new(LR_CHECKSUM_SHA256);
+    fail_if(lr_checksumctx_update_fd(ctx, fd));
+    fail_if(lseek(fd, 0, SEEK_CUR) != (off_t) len);
+    checksum = lr_checksumctx_final(ctx);
+    fail_if(strcmp(checksum, expected),
+        "Checksum is %s instead of %s", checksum, expected);
+    lr_checksumctx_free(ctx);
+    lr_free(checksum);
+    lr_free(expected);
+    close(fd);
+
+    fail_if(remove(file) != 0, "Cannot delete temporary test file");
+    lr_free(data);
+    lr_free(file);
+}
+END_TEST
+
+START_TEST(test_checksum_fd_multi)
+{
+    int fd;
+    char *file;
+    char *checksums[4];
+    lr_ChecksumType types[] = { LR_CHECKSUM_MD5, LR_CHECKSUM_SHA1,
+                                LR_CHECKSUM_SHA256, LR_CHECKSUM_SHA512 };
+    lr_ChecksumType bad_types[] = { LR_CHECKSUM_SHA1, LR_CHECKSUM_UNKNOWN };
+    char *expected[] = { CHKS_VAL_01_MD5, CHKS_VAL_01_SHA1,
+                         CHKS_VAL_01_SHA256, CHKS_VAL_01_SHA512 };
+
+    file = lr_pathconcat(test_globals.tmpdir, "/test_checksum_multi", NULL);
+    build_test_file(file, CHKS_CONTENT_01);
+
+    fail_if((fd = open(file, O_RDONLY)) < 0);
+    fail_if(lr_checksum_fd_multi(types, 4, fd, checksums));
+    for (int x = 0; x < 4; x++) {
+        fail_if(checksums[x] == NULL);
+        fail_if(strcmp(checksums[x], expected[x]),
+            "Checksum is %s instead of %s", checksums[x], expected[x]);
+        lr_free(checksums[x]);
+    }
+    close(fd);
+
+    // Unknown checksum type
+    fail_if((fd = open(file, O_RDONLY)) < 0);
+    fail_unless(lr_checksum_fd_multi(bad_types, 2, fd, checksums));
+    fail_if(checksums[0] != NULL);
+    fail_if(checksums[1] != NULL);
+    close(fd);
+
+    fail_if(remove(file) != 0, "Cannot delete temporary test file");
+    lr_free(file);
+}
+END_TEST
+
+START_TEST(test_checksum_cache)
+{
+    int fd;
+    char *file, *cached;
+
+    file = lr_pathconcat(test_globals.tmpdir, "/test_checksum_cache", NULL);
+    build_test_file(file, CHKS_CONTENT_01);
+    fail_if((fd = open(file, O_RDWR)) < 0);
+
+    fail_if(lr_checksum_cache_get(LR_CHECKSUM_SHA256, fd) != NULL);
+
+    if (lr_checksum_cache_set(LR_CHECKSUM_SHA256, fd, CHKS_VAL_01_SHA256)) {
+        /* Extended attributes are not supported by the filesystem */
+        close(fd);
+        remove(file);
+        lr_free(file);
+        return;
+    }
+
+    cached = lr_checksum_cache_get(LR_CHECKSUM_SHA256, fd);
+    fail_if(cached == NULL);
+    fail_if(strcmp(cached, CHKS_VAL_01_SHA256));
+    lr_free(cached);
+    fail_if(lr_checksum_cache_get(LR_CHECKSUM_SHA1, fd) != NULL);
+
+    /* Cached value is used instead of the real checksum */
+    lr_checksum_cache_set(LR_CHECKSUM_SHA1, fd, "fake");
+    fail_if(lr_checksum_fd_compare(LR_CHECKSUM_SHA1, fd, "fake", 1));
+    fail_unless(lr_checksum_fd_compare(LR_CHECKSUM_SHA1, fd, "fake", 0));
+
+    /* Change of the file invalidates the cache */
+    fail_if(lseek(fd, 0, SEEK_END) < 0);
+    fail_if(write(fd, "x", 1) != 1);
+    fail_if(lr_checksum_cache_get(LR_CHECKSUM_SHA256, fd) != NULL);
+    fail_if(lr_checksum_cache_get(LR_CHECKSUM_SHA1, fd) != NULL);
+
+    /* Comparison with caching stores the calculated checksum */
+    fail_if(lseek(fd, 0, SEEK_SET) < 0);
+    fail_unless(lr_checksum_fd_compare(LR_CHECKSUM_SHA256, fd,
+                                       CHKS_VAL_01_SHA256, 1));
+    cached = lr_checksum_cache_get(LR_CHECKSUM_SHA256, fd);
+    fail_if(cached == NULL);
+    fail_if(!strcmp(cached, CHKS_VAL_01_SHA256));
+    lr_free(cached);
+
+    close(fd);
+    fail_if(remove(file) != 0, "Cannot delete temporary test file");
+    lr_free(file);
+}
+END_TEST
+
 Suite *
 checksum_suite(void)
 {
     Suite *s = suite_create("cheksum");
     TCase *tc = tcase_create("Main");
     tcase_add_test(tc, test_checksum_fd);
+    tcase_add_test(tc, test_checksumctx);
+    tcase_add_test(tc, test_checksum_fd_bigfile);
+    tcase_add_test(tc, test_checksum_fd_multi);
+    tcase_add_test(tc, test_checksum_cache);
     suite_add_tcase(s, tc);
     return s;
 }
@@ -23,6 +23,13 @@ START_TEST(test_curltarget)
     fail_if(t == NULL);
     fail_if(t->path != NULL);
     fail_if(t->checksum != NULL);
+    fail_if(t->expected_size != 0);
+    fail_if(t->fn != NULL);
+    fail_if(t->base_url != NULL);
+    fail_if(t->resume != 0);
+    fail_if(t->in_memory != 0);
+    fail_if(t->data != NULL);
+    fail_if(t->data_len != 0);
     lr_curltarget_free(t);
 }
 END_TEST
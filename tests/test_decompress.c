@@ -0,0 +1,149 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#include "librepo/util.h"
+#include "librepo/rcodes.h"
+#include "librepo/decompress.h"
+
+#include "fixtures.h"
+#include "testsys.h"
+#include "test_decompress.h"
+
+#define PRIMARY_GZ      "repo_yum_01/repodata/4543ad62e4d86337cd1949346f9aec976b847b58-primary.xml.gz"
+#define PRIMARY_OPEN    "68457ceb8e20bda004d46e0a4dfa4a69ce71db48"
+#define PRIMARY_SIZE    3385
+#define PRIMARY_DB_BZ2  "repo_yum_01/repodata/735cd6294df08bdf28e2ba113915ca05a151118e-primary.sqlite.bz2"
+#define PRIMARY_DB_OPEN "ba636386312e1b597fc4feb182d04c059b2a77d5"
+#define PRIMARY_DB_SIZE 23552
+
+/* Read the whole file to the malloced buffer */
+static char *
+read_file(const char *path, size_t *len)
+{
+    int fd;
+    struct stat st;
+    char *buf;
+
+    fail_if((fd = open(path, O_RDONLY)) < 0);
+    fail_if(fstat(fd, &st) != 0);
+    buf = lr_malloc(st.st_size);
+    fail_unless(read(fd, buf, st.st_size) == st.st_size);
+    close(fd);
+    *len = st.st_size;
+    return buf;
+}
+
+START_TEST(test_decompressed_path)
+{
+    char *path;
+
+    fail_unless(lr_compression_type("primary.xml.gz") == LR_COMPRESSION_GZ);
+    fail_unless(lr_compression_type("a.sqlite.bz2") == LR_COMPRESSION_BZ2);
+    fail_unless(lr_compression_type("a.xml.xz") == LR_COMPRESSION_XZ);
+    fail_unless(lr_compression_type("repomd.xml") == LR_COMPRESSION_NONE);
+    fail_unless(lr_compression_type(NULL) == LR_COMPRESSION_NONE);
+
+    path = lr_decompressed_path("/foo/primary.xml.gz");
+    fail_if(strcmp(path, "/foo/primary.xml"));
+    lr_free(path);
+    path = lr_decompressed_path("other.sqlite.bz2");
+    fail_if(strcmp(path, "other.sqlite"));
+    lr_free(path);
+    fail_unless(lr_decompressed_path("repomd.xml") == NULL);
+    fail_unless(lr_decompressed_path(".gz") == NULL);
+}
+END_TEST
+
+START_TEST(test_decompress_file)
+{
+    int rc;
+    char *src, *dst;
+    struct stat st;
+
+    dst = lr_pathconcat(test_globals.tmpdir, "/decompressed", NULL);
+
+    src = lr_pathconcat(test_globals.testdata_dir, PRIMARY_GZ, NULL);
+    rc = lr_decompress_file(LR_COMPRESSION_GZ, src, dst, LR_CHECKSUM_SHA1,
+                            PRIMARY_OPEN, PRIMARY_SIZE);
+    fail_if(rc != LRE_OK, "%s", lr_strerror(rc));
+    fail_if(stat(dst, &st) != 0);
+    fail_unless(st.st_size == PRIMARY_SIZE);
+
+    /* Bad checksum - the output is removed */
+    rc = lr_decompress_file(LR_COMPRESSION_GZ, src, dst, LR_CHECKSUM_SHA1,
+                            PRIMARY_DB_OPEN, 0);
+    fail_unless(rc == LRE_BADCHECKSUM);
+    fail_unless(access(dst, F_OK) != 0);
+
+    /* Bad compression */
+    rc = lr_decompress_file(LR_COMPRESSION_BZ2, src, dst, LR_CHECKSUM_SHA1,
+                            NULL, 0);
+    fail_unless(rc == LRE_DECOMPRESSION);
+    lr_free(src);
+
+    src = lr_pathconcat(test_globals.testdata_dir, PRIMARY_DB_BZ2, NULL);
+    rc = lr_decompress_file(LR_COMPRESSION_BZ2, src, dst, LR_CHECKSUM_SHA1,
+                            PRIMARY_DB_OPEN, PRIMARY_DB_SIZE);
+    fail_if(rc != LRE_OK, "%s", lr_strerror(rc));
+    fail_if(remove(dst) != 0);
+    lr_free(src);
+
+    lr_free(dst);
+}
+END_TEST
+
+START_TEST(test_decompressor_restart)
+{
+    int rc;
+    size_t len;
+    char *src, *dst, *data;
+    lr_Decompressor d;
+
+    src = lr_pathconcat(test_globals.testdata_dir, PRIMARY_GZ, NULL);
+    dst = lr_pathconcat(test_globals.tmpdir, "/decompressed", NULL);
+    data = read_file(src, &len);
+
+    /* Truncated data */
+    d = lr_decompressor_new(LR_COMPRESSION_GZ, dst, LR_CHECKSUM_SHA1,
+                            PRIMARY_OPEN, PRIMARY_SIZE);
+    fail_if(d == NULL);
+    lr_decompressor_cb(d, data, len / 2);
+    fail_unless(lr_decompressor_finish(d) == LRE_DECOMPRESSION);
+    lr_decompressor_free(d);
+
+    /* Broken data followed by a restart and the whole file
+     * passed in small pieces */
+    d = lr_decompressor_new(LR_COMPRESSION_GZ, dst, LR_CHECKSUM_SHA1,
+                            PRIMARY_OPEN, PRIMARY_SIZE);
+    lr_decompressor_cb(d, data + 10, len - 10);
+    lr_decompressor_cb(d, NULL, 0);
+    for (size_t x = 0; x < len; x += 100)
+        lr_decompressor_cb(d, data + x, (len - x < 100) ? len - x : 100);
+    rc = lr_decompressor_finish(d);
+    fail_if(rc != LRE_OK, "%s", lr_strerror(rc));
+    lr_decompressor_free(d);
+
+    fail_if(remove(dst) != 0);
+    lr_free(data);
+    lr_free(src);
+    lr_free(dst);
+}
+END_TEST
+
+Suite *
+decompress_suite(void)
+{
+    Suite *s = suite_create("decompress");
+    TCase *tc = tcase_create("Main");
+    tcase_add_test(tc, test_decompressed_path);
+    tcase_add_test(tc, test_decompress_file);
+    tcase_add_test(tc, test_decompressor_restart);
+    suite_add_tcase(s, tc);
+    return s;
+}
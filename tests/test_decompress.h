@@ -0,0 +1,8 @@
+#ifndef LR_TEST_DECOMPRESS_H
+#define LR_TEST_DECOMPRESS_H
+
+#include <check.h>
+
+Suite *decompress_suite(void);
+
+#endif
@@ -6,9 +6,14 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <curl/curl.h>
 
 #include "librepo/rcodes.h"
+#include "librepo/util.h"
 #include "librepo/handle.h"
+#include "librepo/handle_internal.h"
+#include "librepo/result.h"
+#include "librepo/package_downloader.h"
 
 #include "fixtures.h"
 #include "testsys.h"
@@ -102,6 +107,54 @@ START_TEST(test_handle_getinfo)
 }
 END_TEST
 
+START_TEST(test_handle_reuse)
+{
+    // Transfers of all downloads made with the handle share one
+    // connection cache, it must not break any subsequent download
+    int ret;
+    char *url, *destdir, *dest;
+    CURLSH *share;
+    lr_Handle h;
+    lr_Result r;
+
+    url = lr_pathconcat(test_globals.testdata_dir, "repo_yum_01/", NULL);
+    h = lr_handle_init();
+    fail_if(lr_handle_setopt(h, LRO_URL, url) != LRE_OK);
+    fail_if(lr_handle_setopt(h, LRO_REPOTYPE, LR_YUMREPO) != LRE_OK);
+
+    for (int x = 0; x < 3; x++) {
+        char name[32];
+
+        snprintf(name, sizeof(name), "/reuse_%d", x);
+        destdir = lr_pathconcat(test_globals.tmpdir, name, NULL);
+        fail_if(mkdir(destdir, 0700));
+        fail_if(lr_handle_setopt(h, LRO_DESTDIR, destdir) != LRE_OK);
+
+        r = lr_result_init();
+        ret = lr_handle_perform(h, r);
+        fail_if(ret != LRE_OK);
+        lr_result_free(r);
+
+        dest = lr_pathconcat(destdir, "repomd.xml", NULL);
+        ret = lr_download_package(h, "repodata/repomd.xml", dest,
+                                  LR_CHECKSUM_UNKNOWN, NULL, NULL, 0);
+        fail_if(ret != LRE_OK);
+        fail_if(access(dest, R_OK));
+        lr_free(dest);
+        lr_free(destdir);
+    }
+
+    // No transfer uses the share after the downloads, it could be freed
+    share = h->curl_share_handle;
+    fail_if(share == NULL);
+    h->curl_share_handle = NULL;
+    fail_if(curl_share_cleanup(share) != CURLSHE_OK);
+
+    lr_handle_free(h);
+    lr_free(url);
+}
+END_TEST
+
 Suite *
 handle_suite(void)
 {
@@ -109,6 +162,7 @@ handle_suite(void)
     TCase *tc = tcase_create("Main");
     tcase_add_test(tc, test_handle);
     tcase_add_test(tc, test_handle_getinfo);
+    tcase_add_test(tc, test_handle_reuse);
     suite_add_tcase(s, tc);
     return s;
 }
@@ -142,6 +142,39 @@ START_TEST(test_internalimirrorlist_append_metalink)
 }
 END_TEST
 
+START_TEST(test_internalimirrorlist_sort_by_probe)
+{
+    lr_InternalMirrorlist iml = NULL;
+
+    iml = lr_internalmirrorlist_new();
+    lr_internalmirrorlist_sort_by_probe(iml);
+    lr_internalmirrorlist_append_url(iml, "http://a");
+    lr_internalmirrorlist_append_url(iml, "http://b");
+    lr_internalmirrorlist_append_url(iml, "http://c");
+    lr_internalmirrorlist_append_url(iml, "http://d");
+    lr_internalmirrorlist_append_url(iml, "http://e");
+    fail_if(lr_internalmirrorlist_get(iml, 0)->probe_time >= 0);
+
+    // Nothing probed - order is kept
+    lr_internalmirrorlist_sort_by_probe(iml);
+    fail_if(strcmp(lr_internalmirrorlist_get_url(iml, 0), "http://a"));
+    fail_if(strcmp(lr_internalmirrorlist_get_url(iml, 4), "http://e"));
+
+    // a and c failed, d was not probed
+    iml->mirrors[1]->probe_time = 0.5;  // b
+    iml->mirrors[4]->probe_time = 0.2;  // e
+    lr_internalmirrorlist_sort_by_probe(iml);
+    fail_if(strcmp(lr_internalmirrorlist_get_url(iml, 0), "http://e"));
+    fail_if(strcmp(lr_internalmirrorlist_get_url(iml, 1), "http://b"));
+    fail_if(strcmp(lr_internalmirrorlist_get_url(iml, 2), "http://a"));
+    fail_if(strcmp(lr_internalmirrorlist_get_url(iml, 3), "http://c"));
+    fail_if(strcmp(lr_internalmirrorlist_get_url(iml, 4), "http://d"));
+    fail_if(lr_internalmirrorlist_len(iml) != 5);
+
+    lr_internalmirrorlist_free(iml);
+}
+END_TEST
+
 Suite *
 internal_mirrorlist_suite(void)
 {
@@ -149,6 +182,7 @@ internal_mirrorlist_suite(void)
     TCase *tc = tcase_create("Main");
     tcase_add_test(tc, test_internalimirrorlist_append_mirrorlist);
     tcase_add_test(tc, test_internalimirrorlist_append_metalink);
+    tcase_add_test(tc, test_internalimirrorlist_sort_by_probe);
     suite_add_tcase(s, tc);
     return s;
 }
@@ -12,11 +12,14 @@
 #include "testsys.h"
 #include "test_checksum.h"
 #include "test_curltargetlist.h"
+#include "test_decompress.h"
 #include "test_gpg.h"
 #include "test_handle.h"
 #include "test_internal_mirrorlist.h"
 #include "test_metalink.h"
 #include "test_mirrorlist.h"
+#include "test_mirrorstats.h"
+#include "test_package_downloader.h"
 #include "test_repomd.h"
 #include "test_util.h"
 
@@ -60,11 +63,14 @@ main(int argc, const char **argv)
 
     SRunner *sr = srunner_create(checksum_suite());
     srunner_add_suite(sr, curltargetlist_suite());
+    srunner_add_suite(sr, decompress_suite());
     srunner_add_suite(sr, gpg_suite());
     srunner_add_suite(sr, handle_suite());
     srunner_add_suite(sr, internal_mirrorlist_suite());
     srunner_add_suite(sr, metalink_suite());
     srunner_add_suite(sr, mirrorlist_suite());
+    srunner_add_suite(sr, mirrorstats_suite());
+    srunner_add_suite(sr, package_downloader_suite());
     srunner_add_suite(sr, repomd_suite());
     srunner_add_suite(sr, util_suite());
     srunner_run_all(sr, CK_NORMAL);
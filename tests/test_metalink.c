@@ -360,6 +360,91 @@ START_TEST(test_metalink_really_bad_03)
 }
 END_TEST
 
+START_TEST(test_metalink_buf)
+{
+    int fd;
+    int ret;
+    char *path;
+    char buf[65536];
+    ssize_t len;
+    lr_Metalink ml = NULL;
+
+    path = lr_pathconcat(test_globals.testdata_dir, METALINK_DIR,
+                         "metalink_good_01", NULL);
+    fd = open(path, O_RDONLY);
+    lr_free(path);
+    fail_if(fd < 0);
+    len = read(fd, buf, sizeof(buf));
+    close(fd);
+    fail_if(len <= 0 || len == sizeof(buf));
+
+    ml = lr_metalink_init();
+    fail_if(ml == NULL);
+    ret = lr_metalink_parse_buf(ml, buf, len, REPOMD);
+    fail_if(ret != LRE_OK);
+    fail_if(ml->filename == NULL);
+    fail_if(strcmp(ml->filename, "repomd.xml"));
+    fail_if(ml->timestamp != 1337942396);
+    fail_if(ml->size != 4309);
+    fail_if(ml->noh != 4);
+    fail_if(ml->nou != 106);
+    lr_metalink_free(ml);
+
+    /* Truncated metalink */
+    ml = lr_metalink_init();
+    ret = lr_metalink_parse_buf(ml, buf, len / 2, REPOMD);
+    fail_if(ret == LRE_OK);
+    lr_metalink_free(ml);
+}
+END_TEST
+
+START_TEST(test_metalink_parser_incremental)
+{
+    int fd;
+    int ret;
+    char *path;
+    char buf[65536];
+    ssize_t len;
+    lr_Metalink ml = NULL;
+    lr_MetalinkParser parser;
+
+    path = lr_pathconcat(test_globals.testdata_dir, METALINK_DIR,
+                         "metalink_good_01", NULL);
+    fd = open(path, O_RDONLY);
+    lr_free(path);
+    fail_if(fd < 0);
+    len = read(fd, buf, sizeof(buf));
+    close(fd);
+    fail_if(len <= 0 || len == sizeof(buf));
+
+    ml = lr_metalink_init();
+    parser = lr_metalink_parser_new(ml, REPOMD);
+    fail_if(parser == NULL);
+
+    /* Start of the document from an interrupted download */
+    ret = lr_metalink_parser_feed(parser, buf, len / 2);
+    fail_if(ret != LRE_OK);
+    lr_metalink_parser_reset(parser);
+    fail_if(ml->nou != 0);
+    fail_if(ml->noh != 0);
+
+    for (ssize_t x = 0; x < len; x += 100) {
+        size_t chunk = (len - x > 100) ? 100 : len - x;
+        ret = lr_metalink_parser_feed(parser, buf + x, chunk);
+        fail_if(ret != LRE_OK);
+    }
+    ret = lr_metalink_parser_finish(parser);
+    fail_if(ret != LRE_OK);
+    lr_metalink_parser_free(parser);
+
+    fail_if(ml->filename == NULL);
+    fail_if(strcmp(ml->filename, "repomd.xml"));
+    fail_if(ml->noh != 4);
+    fail_if(ml->nou != 106);
+    lr_metalink_free(ml);
+}
+END_TEST
+
 Suite *
 metalink_suite(void)
 {
@@ -374,6 +459,8 @@ metalink_suite(void)
     tcase_add_test(tc, test_metalink_really_bad_01);
     tcase_add_test(tc, test_metalink_really_bad_02);
     tcase_add_test(tc, test_metalink_really_bad_03);
+    tcase_add_test(tc, test_metalink_buf);
+    tcase_add_test(tc, test_metalink_parser_incremental);
     suite_add_tcase(s, tc);
     return s;
 }
@@ -92,6 +92,32 @@ START_TEST(test_mirrorlist_03)
 }
 END_TEST
 
+START_TEST(test_mirrorlist_buf)
+{
+    int ret;
+    lr_Mirrorlist ml = NULL;
+    const char buf[] = "# comment\n"
+                       "http://foo.bar/fedora/linux/\n"
+                       "\n"
+                       "  ftp://ftp.bar.foo/Fedora/17/";  /* No trailing \n */
+
+    ml = lr_mirrorlist_init();
+    fail_if(ml == NULL);
+    ret = lr_mirrorlist_parse_buf(ml, buf, sizeof(buf) - 1);
+    fail_if(ret != LRE_OK);
+    fail_if(ml->nou != 2);
+    fail_if(strcmp(ml->urls[0], "http://foo.bar/fedora/linux/"));
+    fail_if(strcmp(ml->urls[1], "ftp://ftp.bar.foo/Fedora/17/"));
+    lr_mirrorlist_free(ml);
+
+    ml = lr_mirrorlist_init();
+    ret = lr_mirrorlist_parse_buf(ml, "", 0);
+    fail_if(ret != LRE_OK);
+    fail_if(ml->nou != 0);
+    lr_mirrorlist_free(ml);
+}
+END_TEST
+
 Suite *
 mirrorlist_suite(void)
 {
@@ -101,6 +127,7 @@ mirrorlist_suite(void)
     tcase_add_test(tc, test_mirrorlist_01);
     tcase_add_test(tc, test_mirrorlist_02);
     tcase_add_test(tc, test_mirrorlist_03);
+    tcase_add_test(tc, test_mirrorlist_buf);
     suite_add_tcase(s, tc);
     return s;
 }
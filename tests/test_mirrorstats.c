@@ -0,0 +1,134 @@
+#include <time.h>
+#include <unistd.h>
+
+#include "testsys.h"
+#include "fixtures.h"
+#include "test_mirrorstats.h"
+#include "librepo/rcodes.h"
+#include "librepo/util.h"
+#include "librepo/internal_mirrorlist.h"
+#include "librepo/mirrorstats.h"
+
+START_TEST(test_mirrorstats_load_missing)
+{
+    char *path;
+    lr_MirrorStats stats;
+
+    path = lr_pathconcat(test_globals.tmpdir, "/mirrorstats_missing", NULL);
+    stats = lr_mirrorstats_load(path);
+    fail_if(stats == NULL);
+    fail_if(stats->count != 0);
+    fail_if(lr_mirrorstats_get(stats, "http://foo") != NULL);
+    lr_mirrorstats_free(stats);
+    lr_free(path);
+}
+END_TEST
+
+START_TEST(test_mirrorstats_save_and_load)
+{
+    int ret;
+    char *path;
+    lr_MirrorStat st;
+    lr_MirrorStats stats;
+    lr_InternalMirrorlist iml;
+
+    path = lr_pathconcat(test_globals.tmpdir, "/mirrorstats_save", NULL);
+
+    iml = lr_internalmirrorlist_new();
+    lr_internalmirrorlist_append_url(iml, "http://a");
+    lr_internalmirrorlist_append_url(iml, "http://b");
+    lr_internalmirrorlist_append_url(iml, "http://c");
+    iml->mirrors[0]->successes = 2;
+    iml->mirrors[0]->bytes = 2000;
+    iml->mirrors[0]->seconds = 1.0;
+    iml->mirrors[1]->fails = 1;
+    iml->mirrors[1]->last_failure = 100;
+
+    ret = lr_mirrorstats_save(path, iml);
+    fail_if(ret != LRE_OK);
+    // Saved results are reset
+    fail_if(iml->mirrors[0]->successes != 0);
+    fail_if(iml->mirrors[0]->bytes != 0);
+    fail_if(iml->mirrors[1]->fails != 0);
+
+    // Results are added to the existing ones
+    iml->mirrors[0]->successes = 1;
+    iml->mirrors[0]->fails = 1;
+    iml->mirrors[0]->bytes = 1000;
+    iml->mirrors[0]->seconds = 1.0;
+    iml->mirrors[0]->last_failure = 50;
+    ret = lr_mirrorstats_save(path, iml);
+    fail_if(ret != LRE_OK);
+
+    stats = lr_mirrorstats_load(path);
+    fail_if(stats->count != 2);  // Nothing was noted for http://c
+    st = lr_mirrorstats_get(stats, "http://a");
+    fail_if(st == NULL);
+    fail_if(st->successes != 3);
+    fail_if(st->failures != 1);
+    fail_if(st->bytes != 3000);
+    fail_if(st->seconds < 1.9 || st->seconds > 2.1);
+    fail_if(st->last_failure != 50);
+    st = lr_mirrorstats_get(stats, "http://b");
+    fail_if(st == NULL);
+    fail_if(st->successes != 0);
+    fail_if(st->failures != 1);
+    fail_if(st->last_failure != 100);
+    fail_if(lr_mirrorstats_get(stats, "http://c") != NULL);
+    lr_mirrorstats_free(stats);
+
+    lr_internalmirrorlist_free(iml);
+    unlink(path);
+    lr_free(path);
+}
+END_TEST
+
+START_TEST(test_mirrorstats_rank)
+{
+    char *path;
+    lr_MirrorStats stats;
+    lr_InternalMirrorlist iml;
+
+    path = lr_pathconcat(test_globals.tmpdir, "/mirrorstats_rank", NULL);
+
+    iml = lr_internalmirrorlist_new();
+    lr_internalmirrorlist_append_url(iml, "http://failing");
+    lr_internalmirrorlist_append_url(iml, "http://unknown");
+    lr_internalmirrorlist_append_url(iml, "http://slow");
+    lr_internalmirrorlist_append_url(iml, "http://fast");
+    iml->mirrors[0]->fails = 3;
+    iml->mirrors[0]->last_failure = time(NULL);
+    iml->mirrors[2]->successes = 1;
+    iml->mirrors[2]->bytes = 1000;
+    iml->mirrors[2]->seconds = 10.0;
+    iml->mirrors[3]->successes = 1;
+    iml->mirrors[3]->bytes = 1000;
+    iml->mirrors[3]->seconds = 1.0;
+    fail_if(lr_mirrorstats_save(path, iml) != LRE_OK);
+
+    stats = lr_mirrorstats_load(path);
+    lr_mirrorstats_rank(stats, iml);
+    lr_mirrorstats_free(stats);
+
+    fail_if(strcmp(lr_internalmirrorlist_get_url(iml, 0), "http://fast"));
+    fail_if(strcmp(lr_internalmirrorlist_get_url(iml, 1), "http://slow"));
+    fail_if(strcmp(lr_internalmirrorlist_get_url(iml, 2), "http://unknown"));
+    fail_if(strcmp(lr_internalmirrorlist_get_url(iml, 3), "http://failing"));
+
+    lr_internalmirrorlist_free(iml);
+    unlink(path);
+    lr_free(path);
+}
+END_TEST
+
+Suite *
+mirrorstats_suite(void)
+{
+    Suite *s = suite_create("mirrorstats");
+    TCase *tc = tcase_create("Main");
+    tcase_add_test(tc, test_mirrorstats_load_missing);
+    tcase_add_test(tc, test_mirrorstats_save_and_load);
+    tcase_add_test(tc, test_mirrorstats_rank);
+    suite_add_tcase(s, tc);
+    return s;
+}
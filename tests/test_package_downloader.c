@@ -0,0 +1,116 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "librepo/rcodes.h"
+#include "librepo/util.h"
+#include "librepo/handle.h"
+#include "librepo/package_downloader.h"
+
+#include "fixtures.h"
+#include "testsys.h"
+#include "test_package_downloader.h"
+
+static void
+write_file(const char *path, const char *content)
+{
+    FILE *f = fopen(path, "w");
+    fail_if(f == NULL);
+    fputs(content, f);
+    fclose(f);
+}
+
+static int
+file_equals(const char *path, const char *content)
+{
+    char buf[256];
+    size_t len;
+    FILE *f = fopen(path, "r");
+
+    if (!f)
+        return 0;
+    len = fread(buf, 1, sizeof(buf) - 1, f);
+    buf[len] = '\0';
+    fclose(f);
+    return !strcmp(buf, content);
+}
+
+START_TEST(test_download_packages_failover)
+{
+    // Only the package missing on the first mirror is downloaded
+    // from the second one, the others are not downloaded again
+    int ret;
+    char *dir, *m0, *m1, *destdir, *mirrorlist, *path, *url;
+    lr_Handle h;
+    lr_PackageTarget targets[4];
+    const char *names[] = {"a.rpm", "b.rpm", "c.rpm"};
+
+    dir = lr_pathconcat(test_globals.tmpdir, "/failover", NULL);
+    m0 = lr_pathconcat(dir, "/m0", NULL);
+    m1 = lr_pathconcat(dir, "/m1", NULL);
+    destdir = lr_pathconcat(dir, "/dest", NULL);
+    fail_if(mkdir(dir, 0700));
+    fail_if(mkdir(m0, 0700));
+    fail_if(mkdir(m1, 0700));
+    fail_if(mkdir(destdir, 0700));
+
+    for (int x = 0; x < 3; x++) {
+        if (x < 2) {  // c.rpm is missing on the first mirror
+            path = lr_pathconcat(m0, names[x], NULL);
+            write_file(path, "mirror 0\n");
+            lr_free(path);
+        }
+        path = lr_pathconcat(m1, names[x], NULL);
+        write_file(path, "mirror 1\n");
+        lr_free(path);
+    }
+
+    path = lr_pathconcat(dir, "/mirrorlist", NULL);
+    url = lr_malloc(strlen(m0) + strlen(m1) + 32);
+    sprintf(url, "file://%s/\nfile://%s/\n", m0, m1);
+    write_file(path, url);
+    lr_free(url);
+    mirrorlist = lr_strconcat("file://", path, NULL);
+    lr_free(path);
+
+    h = lr_handle_init();
+    fail_if(lr_handle_setopt(h, LRO_MIRRORLIST, mirrorlist) != LRE_OK);
+    fail_if(lr_handle_setopt(h, LRO_REPOTYPE, LR_YUMREPO) != LRE_OK);
+    fail_if(lr_handle_setopt(h, LRO_DESTDIR, destdir) != LRE_OK);
+
+    for (int x = 0; x < 3; x++)
+        targets[x] = lr_packagetarget_new(names[x], NULL, LR_CHECKSUM_UNKNOWN,
+                                          NULL, NULL, 0);
+    targets[3] = NULL;
+
+    ret = lr_download_packages(h, targets);
+    fail_if(ret != LRE_OK);
+    for (int x = 0; x < 3; x++) {
+        fail_if(targets[x]->rc != LRE_OK);
+        fail_if(!file_equals(targets[x]->local_path,
+                             (x < 2) ? "mirror 0\n" : "mirror 1\n"));
+        lr_packagetarget_free(targets[x]);
+    }
+
+    lr_handle_free(h);
+    lr_free(mirrorlist);
+    lr_free(destdir);
+    lr_free(m1);
+    lr_free(m0);
+    lr_free(dir);
+}
+END_TEST
+
+Suite *
+package_downloader_suite(void)
+{
+    Suite *s = suite_create("package_downloader");
+    TCase *tc = tcase_create("Main");
+    tcase_add_test(tc, test_download_packages_failover);
+    suite_add_tcase(s, tc);
+    return s;
+}
@@ -48,12 +48,99 @@ START_TEST(test_repomd_parsing)
 }
 END_TEST
 
+START_TEST(test_repomd_parsing_buf)
+{
+    int rc;
+    lr_YumRepoMd repomd;
+    lr_YumRepoMdRecord rec;
+    const char buf[] =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<repomd xmlns=\"http://linux.duke.edu/metadata/repo\">\n"
+        "  <revision>1355393568</revision>\n"
+        "  <data type=\"primary\">\n"
+        "    <checksum type=\"sha256\">abcdef</checksum>\n"
+        "    <location href=\"repodata/primary.xml.gz\"/>\n"
+        "    <timestamp>1355393567</timestamp>\n"
+        "    <size>956</size>\n"
+        "  </data>\n"
+        "</repomd>\n";
+
+    repomd = lr_yum_repomd_init();
+    fail_if(!repomd);
+    rc = lr_yum_repomd_parse_buf(repomd, buf, sizeof(buf) - 1);
+    fail_if(rc != LRE_OK);
+    fail_if(repomd->nor != 1);
+    rec = lr_yum_repomd_get_record(repomd, "primary");
+    fail_if(!rec);
+    fail_if(strcmp(rec->location_href, "repodata/primary.xml.gz"));
+    fail_if(strcmp(rec->checksum, "abcdef"));
+    fail_if(rec->size != 956);
+    lr_yum_repomd_free(repomd);
+
+    /* Truncated document */
+    repomd = lr_yum_repomd_init();
+    rc = lr_yum_repomd_parse_buf(repomd, buf, 60);
+    fail_if(rc == LRE_OK);
+    lr_yum_repomd_free(repomd);
+}
+END_TEST
+
+START_TEST(test_repomd_parser_incremental)
+{
+    int fd, rc;
+    ssize_t len;
+    char buf[32768];
+    char *repomd_path;
+    lr_YumRepoMd repomd;
+    lr_YumRepoMdParser parser;
+
+    repomd_path = lr_pathconcat(test_globals.testdata_dir,
+                                "repo_yum_02/repodata/repomd.xml",
+                                NULL);
+    fd = open(repomd_path, O_RDONLY);
+    lr_free(repomd_path);
+    fail_if(fd < 0);
+    len = read(fd, buf, sizeof(buf));
+    close(fd);
+    fail_if(len <= 0 || len == sizeof(buf));
+
+    repomd = lr_yum_repomd_init();
+    parser = lr_yum_repomd_parser_new(repomd);
+    fail_if(!parser);
+
+    /* Garbage from a failed attempt is thrown away by reset */
+    rc = lr_yum_repomd_parser_feed(parser, buf, len / 2);
+    fail_if(rc != LRE_OK);
+    rc = lr_yum_repomd_parser_feed(parser, "<<<", 3);
+    fail_if(rc == LRE_OK);
+    lr_yum_repomd_parser_reset(parser);
+    fail_if(repomd->nor != 0);
+
+    /* Feed the document in small pieces */
+    for (ssize_t x = 0; x < len; x += 7) {
+        size_t chunk = (len - x > 7) ? 7 : len - x;
+        rc = lr_yum_repomd_parser_feed(parser, buf + x, chunk);
+        fail_if(rc != LRE_OK);
+    }
+    rc = lr_yum_repomd_parser_finish(parser);
+    fail_if(rc != LRE_OK);
+    lr_yum_repomd_parser_free(parser);
+
+    fail_if(repomd->nor != 12);
+    fail_if(!lr_yum_repomd_get_record(repomd, "primary"));
+    fail_if(!lr_yum_repomd_get_record(repomd, "deltainfo"));
+    lr_yum_repomd_free(repomd);
+}
+END_TEST
+
 Suite *
 repomd_suite(void)
 {
     Suite *s = suite_create("repomd");
     TCase *tc = tcase_create("Main");
     tcase_add_test(tc, test_repomd_parsing);
+    tcase_add_test(tc, test_repomd_parsing_buf);
+    tcase_add_test(tc, test_repomd_parser_incremental);
     suite_add_tcase(s, tc);
     return s;
 }